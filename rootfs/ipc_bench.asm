@@ -0,0 +1,125 @@
+BITS 32
+ORG 0x400000
+
+%include "ipc.asm"
+
+ROUNDS equ 10000
+
+; IPC round trip benchmark: spawns ipc_echo.bin, times ROUNDS calls
+; with the vdso clock and prints the average in ns
+_start:
+    mov eax, 0x200      ; SYS_SPAWN
+    mov ebx, server_path
+    int 0x80
+    test eax, eax
+    js fail
+    mov [server_pid], eax
+
+    call vdso_monotonic_ns
+    mov [start_ns], eax
+    mov [start_ns + 4], edx
+
+    mov dword [rounds_left], ROUNDS
+round:
+    mov eax, IPC_CALL
+    mov ebx, [server_pid]
+    mov ecx, [rounds_left]
+    xor edx, edx
+    xor esi, esi
+    xor edi, edi
+    int IPC_VECTOR
+    test eax, eax
+    jnz fail
+    dec dword [rounds_left]
+    jnz round
+
+    call vdso_monotonic_ns
+    sub eax, [start_ns]
+    sbb edx, [start_ns + 4]
+    mov ecx, ROUNDS
+    div ecx             ; ns per round trip
+
+    mov edi, number_end
+    call utoa
+
+    mov [digits], esi
+    mov [digits_len], ecx
+
+    mov eax, 4          ; SYS_WRITE
+    mov ebx, 1          ; STDOUT
+    mov ecx, prefix
+    mov edx, prefix_len
+    int 0x80
+    mov eax, 4
+    mov ebx, 1
+    mov ecx, [digits]
+    mov edx, [digits_len]
+    int 0x80
+    mov eax, 4
+    mov ebx, 1
+    mov ecx, suffix
+    mov edx, suffix_len
+    int 0x80
+
+    ; Stop the server and reap it
+    mov eax, IPC_CALL
+    mov ebx, [server_pid]
+    mov ecx, IPC_ECHO_STOP
+    int IPC_VECTOR
+
+    mov eax, 7          ; SYS_WAITPID
+    mov ebx, [server_pid]
+    xor ecx, ecx
+    xor edx, edx
+    int 0x80
+
+    mov eax, 1          ; SYS_EXIT
+    mov ebx, 0
+    int 0x80
+
+fail:
+    mov eax, 1          ; SYS_EXIT
+    mov ebx, 1
+    int 0x80
+
+; eax = value, edi = end of the buffer
+; Returns esi = first digit, ecx = digit count
+utoa:
+    mov esi, edi
+    mov ebx, 10
+utoa_next:
+    xor edx, edx
+    div ebx
+    add dl, '0'
+    dec esi
+    mov [esi], dl
+    test eax, eax
+    jnz utoa_next
+    mov ecx, edi
+    sub ecx, esi
+    ret
+
+%include "vdso.asm"
+
+server_path:
+    db "ipc_echo.bin", 0
+prefix:
+    db "IPC round trip: "
+prefix_len equ $ - prefix
+suffix:
+    db " ns", 0x0D, 0x0A
+suffix_len equ $ - suffix
+
+server_pid:
+    dd 0
+rounds_left:
+    dd 0
+start_ns:
+    dd 0, 0
+digits:
+    dd 0
+digits_len:
+    dd 0
+number:
+    times 10 db 0
+number_end:
@@ -0,0 +1,30 @@
+BITS 32
+ORG 0x400000
+
+%include "ipc.asm"
+
+; Echo server for ipc_bench: replies with the message it got
+_start:
+    mov eax, IPC_RECEIVE
+    xor ebx, ebx        ; From anyone
+    int IPC_VECTOR
+
+serve:
+    test eax, eax
+    jnz _start          ; Sender went away, wait for the next one
+
+    cmp ecx, IPC_ECHO_STOP
+    je stop
+
+    ; ebx is still the caller, the words go back as they are
+    mov eax, IPC_REPLY_WAIT
+    int IPC_VECTOR
+    jmp serve
+
+stop:
+    mov eax, IPC_REPLY
+    int IPC_VECTOR
+
+    mov eax, 1          ; SYS_EXIT
+    mov ebx, 0
+    int 0x80
@@ -9,17 +9,20 @@ fi
 # Create build directory if it doesn't exist
 mkdir -p ../build
 
-# Assemble the program
-nasm -f bin ../rootfs/example.asm -o ../build/example.bin
+# Assemble every program in rootfs
+for src in ../rootfs/*.asm; do
+    name=$(basename "$src" .asm)
+    nasm -f bin -i ../user/lib/ "$src" -o "../build/$name.bin"
 
-# Check if assembly was successful
-if [ $? -eq 0 ]; then
-    echo "Successfully assembled example.bin"
-    
-    # Copy to rootfs
-    cp ../build/example.bin ../rootfs/
-    echo "Copied example.bin to rootfs/"
-else
-    echo "Failed to assemble example.asm"
-    exit 1
-fi
+    # Check if assembly was successful
+    if [ $? -eq 0 ]; then
+        echo "Successfully assembled $name.bin"
+        
+        # Copy to rootfs
+        cp "../build/$name.bin" ../rootfs/
+        echo "Copied $name.bin to rootfs/"
+    else
+        echo "Failed to assemble $name.asm"
+        exit 1
+    fi
+done
@@ -0,0 +1,79 @@
+; ap_trampoline.asm - application processor startup code
+;
+; Copied to SMP_TRAMPOLINE_BASE by smp_init(), the SIPI starts each AP here
+; in real mode. It switches to protected mode with paging (same kernel page
+; directory as the BSP), loads the stack from the parameter block and calls
+; the C entry point with its argument.
+
+[BITS 16]
+
+section .text
+
+global ap_trampoline_start
+global ap_trampoline_params
+global ap_trampoline_end
+
+AP_TRAMPOLINE_BASE  equ 0x8000
+
+; Address of a label once the code is copied to AP_TRAMPOLINE_BASE
+%define AP_REL(label) (AP_TRAMPOLINE_BASE + (label) - ap_trampoline_start)
+
+ap_trampoline_start:
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax
+
+    lgdt [AP_REL(ap_trampoline_gdt_ptr)]
+    mov eax, cr0
+    or eax, 1           ; CR0.PE
+    mov cr0, eax
+    jmp dword 0x08:AP_REL(ap_trampoline_32)
+
+[BITS 32]
+ap_trampoline_32:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    mov eax, cr4
+    or eax, 0x10        ; CR4.PSE: the kernel maps itself with 4MB pages
+    mov cr4, eax
+    mov eax, [AP_REL(ap_trampoline_params)]        ; cr3
+    mov cr3, eax
+    mov eax, cr0
+    or eax, 0x80010000  ; CR0.PG | CR0.WP
+    mov cr0, eax
+
+    mov esp, [AP_REL(ap_trampoline_params) + 4]    ; stack
+    push dword [AP_REL(ap_trampoline_params) + 12] ; arg
+    mov eax, [AP_REL(ap_trampoline_params) + 8]    ; entry
+    call eax
+
+ap_trampoline_hang:
+    cli
+    hlt
+    jmp ap_trampoline_hang
+
+align 8
+ap_trampoline_gdt:
+    dq 0
+    dq 0x00CF9A000000FFFF   ; Flat code, same selector as the kernel's
+    dq 0x00CF92000000FFFF   ; Flat data
+
+ap_trampoline_gdt_ptr:
+    dw 3 * 8 - 1
+    dd AP_REL(ap_trampoline_gdt)
+
+; Filled in by smp_init() before every SIPI, see smp_trampoline_params_t
+align 4
+ap_trampoline_params:
+    dd 0                ; cr3
+    dd 0                ; stack
+    dd 0                ; entry
+    dd 0                ; arg
+
+ap_trampoline_end:
@@ -0,0 +1,96 @@
+#ifndef K_ARCH_CPU_H
+#define K_ARCH_CPU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// CPUID leaf 1 EDX feature bits
+#define CPUID_FEAT_EDX_TSC      (1 << 4)
+#define CPUID_FEAT_EDX_MSR      (1 << 5)
+#define CPUID_FEAT_EDX_APIC     (1 << 9)
+#define CPUID_FEAT_EDX_FXSR     (1 << 24)
+#define CPUID_FEAT_EDX_SSE      (1 << 25)
+
+// Control register bits
+#define CR0_MP                  (1 << 1)    // WAIT honours TS
+#define CR0_EM                  (1 << 2)    // No FPU, every FP instruction traps
+#define CR0_TS                  (1 << 3)    // Task switched, next FP instruction raises #NM
+#define CR0_NE                  (1 << 5)    // Native FP error reporting (#MF)
+#define CR4_OSFXSR              (1 << 9)    // FXSAVE/FXRSTOR and SSE enabled
+#define CR4_OSXMMEXCPT          (1 << 10)   // SIMD exceptions raise #XM
+
+// Model specific registers
+#define MSR_APIC_BASE           0x1B
+
+static inline void cpuid(uint32_t leaf, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx)
+{
+    __asm__ volatile ("cpuid"
+                      : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+                      : "a"(leaf), "c"(0));
+}
+
+static inline bool cpu_has_feature_edx(uint32_t feature)
+{
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    return (edx & feature) != 0;
+}
+
+static inline uint64_t rdmsr(uint32_t msr)
+{
+    uint32_t lo, hi;
+    __asm__ volatile ("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value)
+{
+    __asm__ volatile ("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+static inline uint64_t rdtsc(void)
+{
+    uint32_t lo, hi;
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline uint32_t read_cr0(void)
+{
+    uint32_t value;
+    __asm__ volatile ("mov %%cr0, %0" : "=r"(value));
+    return value;
+}
+
+static inline void write_cr0(uint32_t value)
+{
+    __asm__ volatile ("mov %0, %%cr0" : : "r"(value) : "memory");
+}
+
+static inline uint32_t read_cr4(void)
+{
+    uint32_t value;
+    __asm__ volatile ("mov %%cr4, %0" : "=r"(value));
+    return value;
+}
+
+static inline void write_cr4(uint32_t value)
+{
+    __asm__ volatile ("mov %0, %%cr4" : : "r"(value) : "memory");
+}
+
+// Disable interrupts, returning the previous EFLAGS for irq_restore
+static inline uint32_t irq_save(void)
+{
+    uint32_t eflags;
+    __asm__ volatile ("pushf\n\tpop %0\n\tcli" : "=r"(eflags) : : "memory");
+    return eflags;
+}
+
+static inline void irq_restore(uint32_t eflags)
+{
+    if (eflags & 0x200)
+        __asm__ volatile ("sti" : : : "memory");
+}
+
+#endif
@@ -15,101 +15,30 @@ idt_load:
     pop ebp
     ret
 
-; Exception handlers - these create a common stack frame
-; and call a C handler function
-
-global isr0, isr1, isr2, isr3, isr4, isr5, isr6, isr7, isr8
-global isr10, isr11, isr12, isr13, isr14, isr16, isr128
-
-; Handlers that don't push error codes
-isr0:
+; Entry stubs for all 256 vectors, generated. Each one pushes a dummy
+; error code where the CPU does not push one, then the vector number,
+; so interrupt_handler always sees the same frame layout.
+; The CPU pushes an error code for 8, 10-14, 17, 21, 29 and 30.
+
+global isr_stub_table
+
+%assign i 0
+%rep 256
+isr_stub_%+i:
+%if i == 8 || (i >= 10 && i <= 14) || i == 17 || i == 21 || i == 29 || i == 30
+%else
     push dword 0    ; Dummy error code
-    push dword 0    ; Interrupt number
+%endif
+    push dword i    ; Interrupt number
     jmp isr_common
+%assign i i+1
+%endrep
 
-isr1:
-    push dword 0
-    push dword 1
-    jmp isr_common
-
-isr2:
-    push dword 0
-    push dword 2
-    jmp isr_common
-
-isr3:
-    push dword 0
-    push dword 3
-    jmp isr_common
-
-isr4:
-    push dword 0
-    push dword 4
-    jmp isr_common
-
-isr5:
-    push dword 0
-    push dword 5
-    jmp isr_common
-
-isr6:
-    push dword 0
-    push dword 6
-    jmp isr_common
-
-isr7:
-    push dword 0
-    push dword 7
-    jmp isr_common
-
-; Handlers that automatically push error codes
-isr8:
-    push dword 8    ; Double fault pushes error code
-    jmp isr_common
-
-isr10:
-    push dword 10   ; Invalid TSS pushes error code
-    jmp isr_common
-
-isr11:
-    push dword 11   ; Segment not present pushes error code
-    jmp isr_common
-
-isr12:
-    push dword 12   ; Stack fault pushes error code
-    jmp isr_common
-
-isr13:
-    push dword 13   ; GPF pushes error code
-    jmp isr_common
-
-isr14:
-    push dword 14   ; Page fault pushes error code
-    jmp isr_common
-
-isr16:
-    push dword 0
-    push dword 16
-    jmp isr_common
-
-; System call handler
-isr128:
-    push dword 0
-    push dword 128
-    jmp isr_common
-
-; Hardware interrupt handlers
-global irq0, irq1
-
-irq0:
-    push dword 0
-    push dword 32
-    jmp irq_common
+; APIC spurious interrupt - must not be acknowledged with an EOI
+global irq_spurious
 
-irq1:
-    push dword 0  
-    push dword 33
-    jmp irq_common
+irq_spurious:
+    iret
 
 ; Common interrupt handler
 extern interrupt_handler
@@ -128,13 +57,17 @@ isr_common:
     mov ds, ax
     mov es, ax
     mov fs, ax
+    mov ax, 0x30    ; Per-CPU data (GDT_PERCPU_SEL), based at this CPU's cpu_t
     mov gs, ax
     
     ; Call C handler
     push esp        ; Pass pointer to stack frame
     call interrupt_handler
     add esp, 4      ; Clean up stack
-    
+
+; New processes start here, with their initial interrupt_frame_t on the stack
+global interrupt_return
+interrupt_return:
     ; Restore segment registers
     pop gs
     pop fs
@@ -150,41 +83,12 @@ isr_common:
     ; Return from interrupt
     iret
 
-; Common IRQ handler  
-extern irq_handler
-irq_common:
-    ; Save all registers
-    pushad
-    
-    ; Save segment registers
-    push ds
-    push es
-    push fs
-    push gs
-    
-    ; Load kernel data segment
-    mov ax, 0x10
-    mov ds, ax
-    mov es, ax
-    mov fs, ax
-    mov gs, ax
-    
-    ; Call C handler
-    push esp
-    call irq_handler
-    add esp, 4
-    
-    ; Restore segment registers
-    pop gs
-    pop fs
-    pop es
-    pop ds
-    
-    ; Restore general registers
-    popad
-    
-    ; Clean up error code and interrupt number
-    add esp, 8
-    
-    ; Return from interrupt  
-    iret
\ No newline at end of file
+section .rodata
+
+; Stub addresses indexed by vector, used by idt_setup()
+isr_stub_table:
+%assign i 0
+%rep 256
+    dd isr_stub_%+i
+%assign i i+1
+%endrep
@@ -17,6 +17,15 @@ header_start:
     dw 0
     dd 8
 
+    ; framebuffer (tag 5), optional: without one we stay in VGA text mode
+    dw 5
+    dw 1
+    dd 20
+    dd 1024             ; width
+    dd 768              ; height
+    dd 32               ; depth
+    dd 0                ; tags are 8-byte aligned
+
     ; end tag
     dw 0
     dw 0
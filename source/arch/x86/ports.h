@@ -0,0 +1,19 @@
+#ifndef K_ARCH_PORTS_H
+#define K_ARCH_PORTS_H
+
+#include <stdint.h>
+
+// Port I/O functions
+static inline void outb(uint16_t port, uint8_t value)
+{
+    __asm__ volatile ("outb %0, %1" : : "a"(value), "Nd"(port));
+}
+
+static inline uint8_t inb(uint16_t port)
+{
+    uint8_t ret;
+    __asm__ volatile ("inb %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+#endif
@@ -0,0 +1,31 @@
+[BITS 32]
+
+section .text
+
+global context_switch
+
+; void context_switch(uintptr_t* old_esp, uintptr_t new_esp, volatile uint32_t* old_on_cpu)
+; Saves the callee-saved registers on the current kernel stack, stores the
+; stack pointer in *old_esp and resumes whatever was saved at new_esp.
+; *old_on_cpu is cleared once the old stack is no longer touched, another
+; CPU waiting to resume the old process may take over from that point.
+; A fresh process stack is prepared so that the ret lands in interrupt_return.
+context_switch:
+    mov eax, [esp + 4]  ; old_esp
+    mov edx, [esp + 8]  ; new_esp
+    mov ecx, [esp + 12] ; old_on_cpu
+
+    push ebp
+    push ebx
+    push esi
+    push edi
+
+    mov [eax], esp
+    mov esp, edx
+    mov dword [ecx], 0  ; Stores are not reordered with older stores on x86
+
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
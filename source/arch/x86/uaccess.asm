@@ -0,0 +1,96 @@
+[BITS 32]
+
+section .text
+
+global uaccess_copy
+global uaccess_strncpy
+
+; Every instruction that touches user memory gets an entry in .ex_table.
+; If it faults, interrupt_handler looks up the faulting EIP and resumes
+; at the paired fixup label instead of treating it as a kernel bug.
+%macro EX_TABLE_ENTRY 2
+    section .ex_table progbits alloc noexec nowrite align=4
+    dd %1, %2
+    section .text
+%endmacro
+
+; size_t uaccess_copy(void* dst, const void* src, size_t len)
+; Block copy (dwords, then the tail bytes).
+; Returns the number of bytes that could NOT be copied, 0 on success.
+uaccess_copy:
+    push edi
+    push esi
+
+    mov edi, [esp + 12] ; dst
+    mov esi, [esp + 16] ; src
+    mov ecx, [esp + 20] ; len
+    mov edx, ecx
+    shr ecx, 2          ; dword count
+    and edx, 3          ; tail bytes
+    cld
+
+uaccess_copy_dwords:
+    rep movsd
+
+    mov ecx, edx
+uaccess_copy_bytes:
+    rep movsb
+
+    xor eax, eax
+    pop esi
+    pop edi
+    ret
+
+uaccess_copy_dwords_fault:
+    ; ECX still holds the dwords left, EDX the tail bytes
+    lea eax, [edx + ecx * 4]
+    pop esi
+    pop edi
+    ret
+
+uaccess_copy_bytes_fault:
+    mov eax, ecx
+    pop esi
+    pop edi
+    ret
+
+EX_TABLE_ENTRY uaccess_copy_dwords, uaccess_copy_dwords_fault
+EX_TABLE_ENTRY uaccess_copy_bytes,  uaccess_copy_bytes_fault
+
+; int uaccess_strncpy(char* dst, const char* src, size_t max)
+; Copies up to max bytes including the terminator.
+; Returns the string length, max if no terminator was found, -1 on fault.
+uaccess_strncpy:
+    push edi
+    push esi
+
+    mov edi, [esp + 12] ; dst
+    mov esi, [esp + 16] ; src
+    mov ecx, [esp + 20] ; max
+    xor edx, edx
+
+uaccess_strncpy_next:
+    cmp edx, ecx
+    jae uaccess_strncpy_done
+
+uaccess_strncpy_load:
+    mov al, [esi + edx]
+    mov [edi + edx], al
+    test al, al
+    jz uaccess_strncpy_done
+    inc edx
+    jmp uaccess_strncpy_next
+
+uaccess_strncpy_done:
+    mov eax, edx
+    pop esi
+    pop edi
+    ret
+
+uaccess_strncpy_fault:
+    mov eax, -1
+    pop esi
+    pop edi
+    ret
+
+EX_TABLE_ENTRY uaccess_strncpy_load, uaccess_strncpy_fault
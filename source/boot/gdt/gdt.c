@@ -23,23 +23,47 @@ static uint32_t calculate_gdt_checksum(void)
     return checksum;
 }
 
-void gdt_set_entry(int index, uint32_t base, uint32_t limit, uint8_t access, uint8_t gran)
+void gdt_set_entry_in(gdt_entry_t* table, int index, uint32_t base, uint32_t limit, uint8_t access, uint8_t gran)
 {
     if (index < 0 || index >= GDT_ENTRIES_COUNT)
         return;
         
     // Set base address
-    gdt_entries[index].base_low = base & 0xFFFF;
-    gdt_entries[index].base_middle = (base >> 16) & 0xFF;
-    gdt_entries[index].base_high = (base >> 24) & 0xFF;
+    table[index].base_low = base & 0xFFFF;
+    table[index].base_middle = (base >> 16) & 0xFF;
+    table[index].base_high = (base >> 24) & 0xFF;
     
     // Set limit
-    gdt_entries[index].limit_low = limit & 0xFFFF;
-    gdt_entries[index].granularity = (limit >> 16) & 0x0F;
+    table[index].limit_low = limit & 0xFFFF;
+    table[index].granularity = (limit >> 16) & 0x0F;
     
     // Set granularity and access
-    gdt_entries[index].granularity |= gran & 0xF0;
-    gdt_entries[index].access = access;
+    table[index].granularity |= gran & 0xF0;
+    table[index].access = access;
+}
+
+void gdt_set_entry(int index, uint32_t base, uint32_t limit, uint8_t access, uint8_t gran)
+{
+    gdt_set_entry_in(gdt_entries, index, base, limit, access, gran);
+}
+
+// Application processors start from a copy of the boot GDT, with their own TSS entry
+void gdt_clone(gdt_entry_t* table, gdt_ptr_t* ptr)
+{
+    for (int i = 0; i < GDT_ENTRIES_COUNT; i++)
+        table[i] = gdt_entries[i];
+
+    ptr->limit = (sizeof(gdt_entry_t) * GDT_ENTRIES_COUNT) - 1;
+    ptr->base = (uint32_t)table;
+}
+
+// Per-CPU segment base; a null table means the boot GDT (the BSP's)
+void gdt_set_percpu_base(gdt_entry_t* table, uint32_t base)
+{
+    gdt_set_entry_in(table ? table : gdt_entries, GDT_PERCPU_ENTRY, base, 0xFFFFF, 0x92, 0xCF);
+
+    if (!table && gdt_initialized)
+        gdt_checksum = calculate_gdt_checksum();
 }
 
 bool gdt_setup(void)
@@ -83,8 +107,11 @@ bool gdt_setup(void)
                   0xFFFFF,              // Limit (4GB with 4K granularity)
                   0xF2,                 // Present, Ring 3, Data, Writable
                   0xCF);                // 4K granularity, 32-bit, limit[19:16] = 0xF
+
+    // Per-CPU data segment: like kernel data, the base is set by smp_init_bsp
+    gdt_set_entry(GDT_PERCPU_ENTRY, 0, 0xFFFFF, 0x92, 0xCF);
     
-    // Set up GDT pointer with all 5 entries
+    // Set up GDT pointer with all entries
     gdt_ptr.limit = (sizeof(gdt_entry_t) * GDT_ENTRIES_COUNT) - 1;
     gdt_ptr.base = (uint32_t)&gdt_entries;
     
@@ -47,13 +47,18 @@ typedef struct __attribute__((packed))
 #define GDT_KERNEL_DATA_ENTRY 2
 #define GDT_USER_CODE_ENTRY   3
 #define GDT_USER_DATA_ENTRY   4
-#define GDT_ENTRIES_COUNT     6
+#define GDT_ENTRIES_COUNT     7
 #define GDT_TSS_ENTRY         5
 #define GDT_TSS_SEL           0x28
+#define GDT_PERCPU_ENTRY      6       // Kernel data, based at the CPU's cpu_t
+#define GDT_PERCPU_SEL        0x30    // Loaded into GS while in the kernel
 
 bool gdt_setup(void);
 bool gdt_verify_integrity(void);
 void gdt_set_entry(int index, uint32_t base, uint32_t limit, uint8_t access, uint8_t gran);
+void gdt_set_entry_in(gdt_entry_t* table, int index, uint32_t base, uint32_t limit, uint8_t access, uint8_t gran);
+void gdt_clone(gdt_entry_t* table, gdt_ptr_t* ptr);
+void gdt_set_percpu_base(gdt_entry_t* table, uint32_t base);
 
 extern void gdt_load(uint32_t gdt_ptr);
 
@@ -1,4 +1,5 @@
 #include "idt.h"
+#include "../../system/smp/smp.h"
 
 // IDT table - statically allocated and aligned
 static idt_entry_t idt_entries[IDT_ENTRIES_COUNT] __attribute__((aligned(8)));
@@ -7,6 +8,9 @@ static idt_ptr_t idt_ptr __attribute__((aligned(4)));
 // TSS structure for hardware task switching support
 static tss_entry_t tss __attribute__((aligned(4)));
 
+// Per-CPU TSS, the boot CPU uses the static one above
+static tss_entry_t* tss_cpu[SMP_MAX_CPUS] = { &tss };
+
 // Integrity check
 static bool idt_initialized = false;
 
@@ -22,31 +26,47 @@ void idt_set_entry(int index, uint32_t handler, uint16_t selector, uint8_t type_
     idt_entries[index].type_attr = type_attr;
 }
 
-void tss_setup(void)
+// Fills a TSS and installs its descriptor, in the boot GDT when gdt is null
+void tss_setup_in(tss_entry_t* t, gdt_entry_t* gdt)
 {
     // Clear TSS structure
     for (int i = 0; i < (int)sizeof(tss_entry_t); i++)
-        ((uint8_t*)&tss)[i] = 0;
+        ((uint8_t*)t)[i] = 0;
     
     // Set up basic TSS fields
-    tss.ss0 = GDT_KERNEL_DATA_SEL;  // Kernel stack segment
-    tss.esp0 = 0;  // Will be set when switching to user mode
-    tss.cs = GDT_KERNEL_CODE_SEL | 0;  // Kernel code segment
-    tss.ss = GDT_KERNEL_DATA_SEL | 0;  // Kernel stack segment  
-    tss.ds = GDT_KERNEL_DATA_SEL | 0;  // Kernel data segment
-    tss.es = GDT_KERNEL_DATA_SEL | 0;
-    tss.fs = GDT_KERNEL_DATA_SEL | 0;
-    tss.gs = GDT_KERNEL_DATA_SEL | 0;
+    t->ss0 = GDT_KERNEL_DATA_SEL;  // Kernel stack segment
+    t->esp0 = 0;  // Will be set when switching to user mode
+    t->cs = GDT_KERNEL_CODE_SEL | 0;  // Kernel code segment
+    t->ss = GDT_KERNEL_DATA_SEL | 0;  // Kernel stack segment  
+    t->ds = GDT_KERNEL_DATA_SEL | 0;  // Kernel data segment
+    t->es = GDT_KERNEL_DATA_SEL | 0;
+    t->fs = GDT_KERNEL_DATA_SEL | 0;
+    t->gs = GDT_KERNEL_DATA_SEL | 0;
     
-    // Add TSS descriptor to GDT (you'll need to modify your GDT)
-    // This goes in gdt.c - TSS descriptor at index 5
-    gdt_set_entry(GDT_TSS_ENTRY,
-                  (uint32_t)&tss,           // Base address of TSS
-                  sizeof(tss_entry_t) - 1,  // Limit
-                  0x89,                     // Present, Ring 0, TSS Available
-                  0x00);                    // Byte granularity
+    // TSS descriptor at index 5
+    if (gdt)
+        gdt_set_entry_in(gdt, GDT_TSS_ENTRY, (uint32_t)t, sizeof(tss_entry_t) - 1, 0x89, 0x00);
+    else
+        gdt_set_entry(GDT_TSS_ENTRY,
+                      (uint32_t)t,              // Base address of TSS
+                      sizeof(tss_entry_t) - 1,  // Limit
+                      0x89,                     // Present, Ring 0, TSS Available
+                      0x00);                    // Byte granularity
+}
+
+void tss_setup(void)
+{
+    tss_setup_in(&tss, 0);
+}
+
+// Each CPU loads its own TSS, esp0 updates go to the one of the calling CPU
+void tss_register_cpu(uint32_t cpu, tss_entry_t* t)
+{
+    if (cpu < SMP_MAX_CPUS)
+        tss_cpu[cpu] = t;
 }
 
+
 bool idt_setup(void)
 {
     // Clear IDT entries
@@ -59,29 +79,20 @@ bool idt_setup(void)
     idt_ptr.limit = (sizeof(idt_entry_t) * IDT_ENTRIES_COUNT) - 1;
     idt_ptr.base = (uint32_t)&idt_entries;
     
-    // Set up basic exception handlers (you'll need to implement these)
-    idt_set_entry(0, (uint32_t)isr0, GDT_KERNEL_CODE_SEL, IDT_TYPE_INTERRUPT_GATE);   // Division by zero
-    idt_set_entry(1, (uint32_t)isr1, GDT_KERNEL_CODE_SEL, IDT_TYPE_INTERRUPT_GATE);   // Debug
-    idt_set_entry(2, (uint32_t)isr2, GDT_KERNEL_CODE_SEL, IDT_TYPE_INTERRUPT_GATE);   // NMI
-    idt_set_entry(3, (uint32_t)isr3, GDT_KERNEL_CODE_SEL, IDT_TYPE_INTERRUPT_GATE);   // Breakpoint
-    idt_set_entry(4, (uint32_t)isr4, GDT_KERNEL_CODE_SEL, IDT_TYPE_INTERRUPT_GATE);   // Overflow
-    idt_set_entry(5, (uint32_t)isr5, GDT_KERNEL_CODE_SEL, IDT_TYPE_INTERRUPT_GATE);   // Bound range exceeded
-    idt_set_entry(6, (uint32_t)isr6, GDT_KERNEL_CODE_SEL, IDT_TYPE_INTERRUPT_GATE);   // Invalid opcode
-    idt_set_entry(7, (uint32_t)isr7, GDT_KERNEL_CODE_SEL, IDT_TYPE_INTERRUPT_GATE);   // Device not available
-    idt_set_entry(8, (uint32_t)isr8, GDT_KERNEL_CODE_SEL, IDT_TYPE_INTERRUPT_GATE);   // Double fault
-    idt_set_entry(10, (uint32_t)isr10, GDT_KERNEL_CODE_SEL, IDT_TYPE_INTERRUPT_GATE); // Invalid TSS
-    idt_set_entry(11, (uint32_t)isr11, GDT_KERNEL_CODE_SEL, IDT_TYPE_INTERRUPT_GATE); // Segment not present
-    idt_set_entry(12, (uint32_t)isr12, GDT_KERNEL_CODE_SEL, IDT_TYPE_INTERRUPT_GATE); // Stack fault
-    idt_set_entry(13, (uint32_t)isr13, GDT_KERNEL_CODE_SEL, IDT_TYPE_INTERRUPT_GATE); // General protection fault
-    idt_set_entry(14, (uint32_t)isr14, GDT_KERNEL_CODE_SEL, IDT_TYPE_INTERRUPT_GATE); // Page fault
-    idt_set_entry(16, (uint32_t)isr16, GDT_KERNEL_CODE_SEL, IDT_TYPE_INTERRUPT_GATE); // x87 FPU error
+    // Every vector gets its generated stub, handlers are registered at runtime
+    for (int i = 0; i < IDT_ENTRIES_COUNT; i++)
+    {
+        idt_set_entry(i, isr_stub_table[i], GDT_KERNEL_CODE_SEL, IDT_TYPE_INTERRUPT_GATE);
+    }
+    
+    // APIC spurious vector bypasses the dispatcher (no EOI allowed)
+    idt_set_entry(0xFF, (uint32_t)irq_spurious, GDT_KERNEL_CODE_SEL, IDT_TYPE_INTERRUPT_GATE);
     
-    // Set up hardware interrupt handlers (IRQs)
-    idt_set_entry(32, (uint32_t)irq0, GDT_KERNEL_CODE_SEL, IDT_TYPE_INTERRUPT_GATE);  // Timer
-    idt_set_entry(33, (uint32_t)irq1, GDT_KERNEL_CODE_SEL, IDT_TYPE_INTERRUPT_GATE);  // Keyboard
+    // System call handler, reachable from ring 3
+    idt_set_entry(0x80, isr_stub_table[0x80], GDT_KERNEL_CODE_SEL, IDT_TYPE_TRAP_GATE | IDT_FLAG_RING3);
     
-    // Set up system call handler
-    idt_set_entry(0x80, (uint32_t)isr128, GDT_KERNEL_CODE_SEL, IDT_TYPE_TRAP_GATE | IDT_FLAG_RING3);
+    // IPC fast path (INT_IPC_VECTOR), same entry stub, own dispatch
+    idt_set_entry(0x81, isr_stub_table[0x81], GDT_KERNEL_CODE_SEL, IDT_TYPE_TRAP_GATE | IDT_FLAG_RING3);
     
     // Set up TSS
     tss_setup();
@@ -115,5 +126,11 @@ bool idt_verify_integrity(void)
 
 void tss_set_kernel_stack(uint32_t stack)
 {
-    tss.esp0 = stack;
+    tss_cpu[smp_cpu_id()]->esp0 = stack;
+}
+
+// Application processors share the IDT
+void idt_install(void)
+{
+    idt_load((uint32_t)&idt_ptr);
 }
\ No newline at end of file
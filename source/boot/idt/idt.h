@@ -64,32 +64,18 @@ typedef struct __attribute__((packed))
 bool idt_setup(void);
 bool idt_verify_integrity(void);
 void idt_set_entry(int index, uint32_t handler, uint16_t selector, uint8_t type_attr);
+void idt_install(void);
 void tss_setup(void);
+void tss_setup_in(tss_entry_t* t, gdt_entry_t* gdt);
+void tss_register_cpu(uint32_t cpu, tss_entry_t* t);
 void tss_set_kernel_stack(uint32_t stack);
 
 // Assembly functions (you'll need to implement these)
 extern void idt_load(uint32_t idt_ptr);
 
-// Exception handlers (ISR = Interrupt Service Routine)
-extern void isr0(void);   // Division by zero
-extern void isr1(void);   // Debug
-extern void isr2(void);   // NMI
-extern void isr3(void);   // Breakpoint
-extern void isr4(void);   // Overflow
-extern void isr5(void);   // Bound range exceeded
-extern void isr6(void);   // Invalid opcode
-extern void isr7(void);   // Device not available
-extern void isr8(void);   // Double fault
-extern void isr10(void);  // Invalid TSS
-extern void isr11(void);  // Segment not present
-extern void isr12(void);  // Stack fault
-extern void isr13(void);  // General protection fault
-extern void isr14(void);  // Page fault
-extern void isr16(void);  // x87 FPU error
-extern void isr128(void); // System call
-
-// Hardware interrupt handlers (IRQ)
-extern void irq0(void);   // Timer
-extern void irq1(void);   // Keyboard
+// Generated entry stubs, one per vector (see idt_asm.asm)
+extern const uint32_t isr_stub_table[IDT_ENTRIES_COUNT];
+extern void irq_spurious(void); // APIC spurious vector
+extern void interrupt_return(void); // Pops an interrupt_frame_t and irets
 
 #endif
\ No newline at end of file
@@ -1,6 +1,6 @@
 #include "multiboot.h"
 
-uint64_t mb2_get_memory(uint32_t magic, uint32_t addr)
+static multiboot_tag_t* mb2_find_tag(uint32_t magic, uint32_t addr, uint32_t type)
 {
     if (magic != 0x36d76289) 
     {
@@ -8,28 +8,12 @@ uint64_t mb2_get_memory(uint32_t magic, uint32_t addr)
     }
 
     multiboot_tag_t *tag = (multiboot_tag_t*)(addr + 8);
-    uint64_t available_memory = 0;
 
     while (tag->type != MULTIBOOT_TAG_TYPE_END) 
     {
-        if (tag->type == MULTIBOOT_TAG_TYPE_MMAP) 
+        if (tag->type == type) 
         {
-            multiboot_tag_mmap_t *mmap_tag = 
-                (multiboot_tag_mmap_t*)tag;
-            uint8_t *entry_ptr = (uint8_t*)mmap_tag + sizeof(*mmap_tag);
-            uint8_t *end = (uint8_t*)mmap_tag + mmap_tag->size;
-
-            while (entry_ptr < end) 
-            {
-                multiboot_mmap_entry_t *entry = (multiboot_mmap_entry_t*)entry_ptr;
-
-                if (entry->type == MULTIBOOT_MEMORY_AVAILABLE) 
-                {
-                    available_memory += entry->len;
-                }
-                entry_ptr += mmap_tag->entry_size;
-            }
-            break;
+            return tag;
         }
         // Move to next tag (8-byte aligned)
         tag = (multiboot_tag_t*)
@@ -38,5 +22,51 @@ uint64_t mb2_get_memory(uint32_t magic, uint32_t addr)
         );
     }
 
+    return 0;
+}
+
+uint64_t mb2_get_memory(uint32_t magic, uint32_t addr)
+{
+    multiboot_tag_mmap_t *mmap_tag = 
+        (multiboot_tag_mmap_t*)mb2_find_tag(magic, addr, MULTIBOOT_TAG_TYPE_MMAP);
+    uint64_t available_memory = 0;
+
+    if (!mmap_tag) 
+    {
+        return 0;
+    }
+
+    uint8_t *entry_ptr = (uint8_t*)mmap_tag + sizeof(*mmap_tag);
+    uint8_t *end = (uint8_t*)mmap_tag + mmap_tag->size;
+
+    while (entry_ptr < end) 
+    {
+        multiboot_mmap_entry_t *entry = (multiboot_mmap_entry_t*)entry_ptr;
+
+        if (entry->type == MULTIBOOT_MEMORY_AVAILABLE) 
+        {
+            available_memory += entry->len;
+        }
+        entry_ptr += mmap_tag->entry_size;
+    }
+
     return available_memory;
-}
\ No newline at end of file
+}
+
+bool mb2_get_framebuffer(uint32_t magic, uint32_t addr, multiboot_tag_framebuffer_t* out)
+{
+    multiboot_tag_t *tag = mb2_find_tag(magic, addr, MULTIBOOT_TAG_TYPE_FRAMEBUFFER);
+    if (!tag) 
+    {
+        return false;
+    }
+
+    // Older loaders end the tag before the colour info
+    uint8_t *src = (uint8_t*)tag;
+    uint8_t *dst = (uint8_t*)out;
+    for (uint32_t i = 0; i < sizeof(*out); i++) 
+    {
+        dst[i] = i < tag->size ? src[i] : 0;
+    }
+    return true;
+}
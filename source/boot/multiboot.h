@@ -2,6 +2,7 @@
 #define K_MULTIBOOT_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 typedef struct  
 {
@@ -28,10 +29,36 @@ typedef struct __attribute__((packed))
 } 
 multiboot_mmap_entry_t;
 
+typedef struct __attribute__((packed))
+{
+    uint32_t type;
+    uint32_t size;
+    uint64_t addr;
+    uint32_t pitch;             // Bytes per line
+    uint32_t width;
+    uint32_t height;
+    uint8_t bpp;
+    uint8_t fb_type;
+    uint16_t reserved;
+    // Direct colour (MULTIBOOT_FRAMEBUFFER_TYPE_RGB) only
+    uint8_t red_pos;
+    uint8_t red_size;
+    uint8_t green_pos;
+    uint8_t green_size;
+    uint8_t blue_pos;
+    uint8_t blue_size;
+}
+multiboot_tag_framebuffer_t;
+
 #define MULTIBOOT_TAG_TYPE_END    0
 #define MULTIBOOT_TAG_TYPE_MMAP   6
+#define MULTIBOOT_TAG_TYPE_FRAMEBUFFER 8
 #define MULTIBOOT_MEMORY_AVAILABLE 1
+#define MULTIBOOT_FRAMEBUFFER_TYPE_RGB 1
 
 uint64_t mb2_get_memory(uint32_t magic, uint32_t addr);
 
-#endif
\ No newline at end of file
+// Copies the framebuffer tag out, the info block itself is not kept
+bool mb2_get_framebuffer(uint32_t magic, uint32_t addr, multiboot_tag_framebuffer_t* out);
+
+#endif
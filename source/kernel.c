@@ -9,7 +9,24 @@
 #include "system/usermode/usermode.h"
 #include "system/shell/shell.h"
 #include "system/interrupts/interrupts.h"
+#include "system/interrupts/apic.h"
+#include "system/drivers/keyboard.h"
+#include "system/drivers/serial.h"
+#include "system/drivers/fbcon.h"
+#include "system/acpi/acpi.h"
 #include "system/memory/physical.h" 
+#include "system/memory/virtual.h"
+#include "system/time/timer.h"
+#include "system/time/clock.h"
+#include "system/usermode/processes.h"
+#include "system/usermode/scheduler.h"
+#include "system/usermode/vdata.h"
+#include "system/usermode/workqueue.h"
+#include "system/usermode/fpu.h"
+#include "system/smp/smp.h"
+#include "system/sync/rcu.h"
+#include "system/sync/futex.h"
+#include "system/log/klog.h"
 #include "system/filesystem/ext2/ext2.h"
 
 #define KERNEL_HALT while (1) __asm__ volatile("hlt")
@@ -24,43 +41,12 @@ ext2_fs_t g_ext2_fs;
 
 extern const uint8_t _binary_disk_img_start[];
 extern const uint8_t _binary_disk_img_end[];
-
-// Callback context for directory reading
-typedef struct 
-{
-    const char* target_name;
-    uint32_t found_inode;
-    bool found;
-}
- find_file_ctx_t;
-
-int test_strcmp(const char* s1, const char* s2) 
-{
-    while (*s1 && (*s1 == *s2)) {
-        s1++;
-        s2++;
-    }
-    return (unsigned char)(*s1) - (unsigned char)(*s2);
-}
-
-// Callback function for ext2_read_dir to find a specific file by name
-bool find_file_callback(const char* name, uint32_t inode, void* ctx) 
-{
-    find_file_ctx_t* ffc = (find_file_ctx_t*)ctx;
-    // Compare the current directory entry name with the target name
-    if (test_strcmp(name, ffc->target_name) == 0) {
-        ffc->found_inode = inode; // Store the inode number if found
-        ffc->found = true;        // Set found flag
-        return false;             // Stop iterating through the directory
-    }
-    return true; // Continue iterating
-}
+extern uint8_t _kernel_end[];
 
 bool print_dir_cb(const char* name, uint32_t inode, void* ctx) 
 {
-    sh_printf(g_kernel_shell,
-              " - %s\r\n",
-              name, inode);
+    (void)ctx;
+    klog(KLOG_DEBUG, " - %s (inode %u)", name, inode);
     return true;  // keep iterating
 }
 
@@ -70,31 +56,28 @@ uint32_t ext2_find_file_inode_by_name(ext2_fs_t* fs, const char* filename)
     ext2_inode_t root_inode;
     if (!ext2_read_inode(fs, EXT2_ROOT_INO, &root_inode)) 
     {
-        sh_puts(g_kernel_shell, "EXT2: Can't read root inode\r\n");
+        klog(KLOG_ERR, "EXT2: Can't read root inode");
         return 0;
     }
 
     // 1) Debug dump:
-    sh_puts(g_kernel_shell, "Disk Contents:\r\n");
+    klog(KLOG_DEBUG, "Disk Contents:");
     ext2_read_dir(fs, &root_inode, print_dir_cb, NULL);
 
-    // 2) Actual search:
-    find_file_ctx_t ctx = { .target_name = filename, .found_inode = 0, .found = false };
-    ext2_read_dir(fs, &root_inode, find_file_callback, &ctx);
+    // 2) Actual search, through the name cache:
+    uint32_t found_inode = ext2_lookup(fs, EXT2_ROOT_INO, filename);
 
-    if (!ctx.found) {
-        sh_printf(g_kernel_shell,
-                  "DEBUG: '%s' not found in root (tried exact match)\r\n",
-                  filename);
+    if (!found_inode) {
+        klog(KLOG_DEBUG, "'%s' not found in root (tried exact match)", filename);
     }
-    return ctx.found_inode;
+    return found_inode;
 }
 
 
 void kernel_entry(uint32_t mb2_magic, uint32_t mb2_address)
 {
-    /* Text-Mode Shell Output */
-    shell_instance_t ksh;
+    /* Text-Mode Shell Output, too large for the boot stack */
+    static shell_instance_t ksh;
     sh_init(&ksh, 0xB8000, VGA_WIDTH, VGA_WIDTH * VGA_HEIGHT);
     g_kernel_shell = &ksh;
 
@@ -105,6 +88,9 @@ void kernel_entry(uint32_t mb2_magic, uint32_t mb2_address)
         KERNEL_HALT;
     }
 
+    // Per-CPU data through GS, needed by everything that asks for the current CPU
+    smp_init_bsp();
+
     // Initialize IDT
     if(!idt_setup() || !idt_verify_integrity())
     {
@@ -112,6 +98,15 @@ void kernel_entry(uint32_t mb2_magic, uint32_t mb2_address)
         KERNEL_HALT;
     }
 
+    // Core exception and system call handlers, drivers register their own
+    int_init();
+
+    // Kernel log, printed from a tasklet from here on
+    klog_init();
+
+    // FPU/SSE for user mode, loaded lazily on first use
+    fpu_init();
+
     // Initialize PIC (Programmable Interrupt Controller)
     pic_init();
 
@@ -126,37 +121,88 @@ void kernel_entry(uint32_t mb2_magic, uint32_t mb2_address)
 
     // Get total memory from Multiboot2 info
     uint64_t total_memory_bytes = mb2_get_memory(mb2_magic, mb2_address);
-    sh_printf(&ksh, "Booted with %d MB of Memory.\r\n", (int)(total_memory_bytes / (1024 * 1024)));
+    sh_printf(&ksh, "Booted with %llu MB of Memory.\r\n", total_memory_bytes >> 20);
+
+    // Copied out now, the physical allocator may hand out the info block
+    multiboot_tag_framebuffer_t framebuffer;
+    bool have_framebuffer = mb2_get_framebuffer(mb2_magic, mb2_address, &framebuffer);
 
     // Initialize physical memory manager
-    // We assume usable memory starts after 1MB (0x100000) to avoid kernel code/data.
+    // Usable memory starts after the kernel image (including the embedded disk).
     // In a real system, you'd parse the multiboot memory map for exact regions.
-    void* pmm_start_addr = (void*)0x100000;
+    void* pmm_start_addr = (void*)(((uintptr_t)_kernel_end + PMM_SECTOR_SIZE - 1) & ~(PMM_SECTOR_SIZE - 1));
     size_t pmm_total_size = total_memory_bytes - (size_t)pmm_start_addr;
     mem_phys_init(pmm_start_addr, pmm_total_size);
 
+    // Enable paging and set up the shared kernel data page
+    if (!mem_virt_setup() || !vdata_init())
+    {
+        sh_puts(&ksh, "FATAL: Failed to initialize paging!\r\n");
+        KERNEL_HALT;
+    }
+    proc_mgr_init();
+
+    // Graphical console when the loader set a mode, VGA text otherwise
+    if (have_framebuffer && fbcon_init(&framebuffer) && sh_set_display(&ksh, fbcon_display()))
+    {
+        sh_printf(&ksh, "Framebuffer console: %ux%u, %ux%u cells.\r\n",
+                  framebuffer.width, framebuffer.height,
+                  (uint32_t)fbcon_display()->width, (uint32_t)fbcon_display()->height);
+    }
+
+    // Move interrupt delivery to the APIC, the PIC stays in charge without one
+    if (acpi_init() && apic_init())
+    {
+        sh_printf(&ksh, "APIC enabled, %d CPU(s).\r\n", (int)acpi_madt()->cpu_count);
+    }
+
+    // TSC clocksource (calibrated on the PIT) and the RTC wall time
+    clock_init();
+    if (clock_has_tsc())
+    {
+        sh_printf(&ksh, "TSC clocksource: %d MHz.\r\n", (int)(clock_tsc_khz() / 1000));
+    }
+
+    // One-shot timer and timer wheel, no periodic tick while idle
+    timer_init();
+    keyboard_init();
+
+    // COM1 mirrors the console, for headless runs and -serial stdio
+    if (serial_init())
+    {
+        sh_set_sink(&ksh, serial_write, true);
+        sh_puts(&ksh, "Serial console on COM1.\r\n");
+    }
+    sched_init();
+    rcu_init();
+    futex_init();
+
+    // Wake the application processors, each idles on its own run queue
+    smp_init();
+    if (smp_cpu_count() > 1)
+    {
+        sh_printf(&ksh, "SMP: %d CPUs online.\r\n", (int)smp_cpu_count());
+    }
+
+    // Background work pool, one kernel thread per CPU
+    workqueue_init();
+
     // Use the embedded disk image directly
     if (ext2_mount(&g_ext2_fs, (uint8_t*)_binary_disk_img_start)) 
     {
         sh_printf(&ksh, "EXT2 filesystem mounted successfully! Block size: %d bytes\r\n",
                  (int)g_ext2_fs.block_size);
 
-        // Set up user mode environment with specific program
+        // Set up user mode environment with specific program, the scheduler starts it
         um_setup_env("example.bin");
-        
-        // Switch to user mode
-        um_switch();
     } 
     else 
     {
         sh_puts(&ksh, "Failed to mount EXT2 filesystem from embedded image.\r\n");
     }
 
-    // Main kernel loop - make sure we're actively rendering
-    while(1) 
-    {
-        __asm__ volatile("hlt");
-    }
+    // Main kernel loop - the boot thread becomes the idle task
+    sched_idle_loop();
 
     // Should never reach here if user mode runs correctly
     sh_puts(&ksh, "Returned from user mode unexpectedly!\r\n");
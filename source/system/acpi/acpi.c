@@ -0,0 +1,165 @@
+#include "acpi.h"
+
+static acpi_madt_info_t acpi_madt_info;
+
+static bool acpi_checksum_ok(const void* data, uint32_t length)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < length; i++)
+        sum += bytes[i];
+    return sum == 0;
+}
+
+static bool acpi_signature_is(const char* sig, const char* expected, int len)
+{
+    for (int i = 0; i < len; i++)
+    {
+        if (sig[i] != expected[i])
+            return false;
+    }
+    return true;
+}
+
+static acpi_rsdp_t* acpi_scan_rsdp(uintptr_t start, uintptr_t end)
+{
+    // The RSDP is always 16-byte aligned
+    for (uintptr_t addr = start; addr < end; addr += 16)
+    {
+        acpi_rsdp_t* rsdp = (acpi_rsdp_t*)addr;
+        if (acpi_signature_is(rsdp->signature, "RSD PTR ", 8) && acpi_checksum_ok(rsdp, 20))
+            return rsdp;
+    }
+    return 0;
+}
+
+static acpi_rsdp_t* acpi_find_rsdp(void)
+{
+    // First KB of the EBDA, then the BIOS read-only area
+    uintptr_t ebda = (uintptr_t)(*(volatile uint16_t*)0x40E) << 4;
+    acpi_rsdp_t* rsdp = 0;
+
+    if (ebda)
+        rsdp = acpi_scan_rsdp(ebda, ebda + 1024);
+    if (!rsdp)
+        rsdp = acpi_scan_rsdp(0xE0000, 0x100000);
+    return rsdp;
+}
+
+static acpi_sdt_header_t* acpi_find_table(acpi_rsdp_t* rsdp, const char* signature)
+{
+    bool xsdt = rsdp->revision >= 2 && rsdp->xsdt_address && (rsdp->xsdt_address >> 32) == 0;
+    acpi_sdt_header_t* root = xsdt
+        ? (acpi_sdt_header_t*)(uintptr_t)rsdp->xsdt_address
+        : (acpi_sdt_header_t*)(uintptr_t)rsdp->rsdt_address;
+
+    if (!acpi_checksum_ok(root, root->length))
+        return 0;
+
+    uint32_t entry_size = xsdt ? 8 : 4;
+    uint32_t entries = (root->length - sizeof(acpi_sdt_header_t)) / entry_size;
+    uint8_t* table = (uint8_t*)root + sizeof(acpi_sdt_header_t);
+
+    for (uint32_t i = 0; i < entries; i++)
+    {
+        // XSDT entries are 64-bit, we can only reach the low 4GB anyway
+        uint32_t addr = *(uint32_t*)(table + i * entry_size);
+        if (xsdt && *(uint32_t*)(table + i * entry_size + 4))
+            continue;
+
+        acpi_sdt_header_t* header = (acpi_sdt_header_t*)addr;
+        if (acpi_signature_is(header->signature, signature, 4) && acpi_checksum_ok(header, header->length))
+            return header;
+    }
+    return 0;
+}
+
+static void acpi_parse_madt(acpi_madt_t* madt)
+{
+    acpi_madt_info_t* info = &acpi_madt_info;
+
+    info->lapic_address = madt->lapic_address;
+
+    uint8_t* entry = (uint8_t*)madt + sizeof(acpi_madt_t);
+    uint8_t* end = (uint8_t*)madt + madt->header.length;
+
+    while (entry + sizeof(acpi_madt_entry_t) <= end)
+    {
+        acpi_madt_entry_t* e = (acpi_madt_entry_t*)entry;
+        if (e->length < sizeof(acpi_madt_entry_t))
+            break;
+
+        switch (e->type)
+        {
+            case ACPI_MADT_LAPIC:
+                {
+                    // processor id, apic id, flags (bit 0 enabled, bit 1 online capable)
+                    uint8_t apic_id = entry[3];
+                    uint32_t flags = *(uint32_t*)(entry + 4);
+                    if ((flags & 0x3) && info->cpu_count < ACPI_MAX_CPUS)
+                        info->cpu_apic_ids[info->cpu_count++] = apic_id;
+                }
+                break;
+
+            case ACPI_MADT_IOAPIC:
+                if (info->ioapic_count < ACPI_MAX_IOAPICS)
+                {
+                    acpi_ioapic_t* io = &info->ioapics[info->ioapic_count++];
+                    io->id = entry[2];
+                    io->address = *(uint32_t*)(entry + 4);
+                    io->gsi_base = *(uint32_t*)(entry + 8);
+                }
+                break;
+
+            case ACPI_MADT_ISO:
+                {
+                    // bus, source irq, gsi, flags
+                    uint8_t irq = entry[3];
+                    if (irq < ACPI_ISA_IRQS)
+                    {
+                        info->isa_gsi[irq] = *(uint32_t*)(entry + 4);
+                        info->isa_flags[irq] = *(uint16_t*)(entry + 8);
+                    }
+                }
+                break;
+
+            case ACPI_MADT_LAPIC_OVERRIDE:
+                {
+                    uint64_t addr = *(uint64_t*)(entry + 4);
+                    if ((addr >> 32) == 0)
+                        info->lapic_address = (uint32_t)addr;
+                }
+                break;
+        }
+
+        entry += e->length;
+    }
+
+    info->present = info->lapic_address && info->cpu_count && info->ioapic_count;
+}
+
+bool acpi_init(void)
+{
+    // ISA IRQs are identity mapped onto GSIs unless an override says otherwise
+    for (int i = 0; i < ACPI_ISA_IRQS; i++)
+    {
+        acpi_madt_info.isa_gsi[i] = i;
+        acpi_madt_info.isa_flags[i] = 0;
+    }
+
+    acpi_rsdp_t* rsdp = acpi_find_rsdp();
+    if (!rsdp)
+        return false;
+
+    acpi_madt_t* madt = (acpi_madt_t*)acpi_find_table(rsdp, "APIC");
+    if (!madt)
+        return false;
+
+    acpi_parse_madt(madt);
+    return acpi_madt_info.present;
+}
+
+const acpi_madt_info_t* acpi_madt(void)
+{
+    return &acpi_madt_info;
+}
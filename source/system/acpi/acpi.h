@@ -0,0 +1,90 @@
+#ifndef K_ACPI_H
+#define K_ACPI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ACPI_MAX_CPUS       16
+#define ACPI_MAX_IOAPICS    4
+#define ACPI_ISA_IRQS       16
+
+// MADT interrupt flags (polarity / trigger mode)
+#define ACPI_MADT_POLARITY_MASK     0x3
+#define ACPI_MADT_POLARITY_LOW      0x3
+#define ACPI_MADT_TRIGGER_MASK      0xC
+#define ACPI_MADT_TRIGGER_LEVEL     0xC
+
+typedef struct __attribute__((packed))
+{
+    char signature[8];      // "RSD PTR "
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;       // 0 = ACPI 1.0 (RSDT only), 2+ = XSDT available
+    uint32_t rsdt_address;
+    uint32_t length;
+    uint64_t xsdt_address;
+    uint8_t extended_checksum;
+    uint8_t reserved[3];
+}
+acpi_rsdp_t;
+
+typedef struct __attribute__((packed))
+{
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+}
+acpi_sdt_header_t;
+
+typedef struct __attribute__((packed))
+{
+    acpi_sdt_header_t header;   // "APIC"
+    uint32_t lapic_address;
+    uint32_t flags;             // Bit 0: legacy 8259 pair present
+}
+acpi_madt_t;
+
+typedef struct __attribute__((packed))
+{
+    uint8_t type;
+    uint8_t length;
+}
+acpi_madt_entry_t;
+
+#define ACPI_MADT_LAPIC             0
+#define ACPI_MADT_IOAPIC            1
+#define ACPI_MADT_ISO               2
+#define ACPI_MADT_LAPIC_OVERRIDE    5
+
+typedef struct
+{
+    uint8_t id;
+    uint32_t address;
+    uint32_t gsi_base;
+}
+acpi_ioapic_t;
+
+// Everything the interrupt code needs from the MADT, copied out at boot
+typedef struct
+{
+    bool present;
+    uint32_t lapic_address;
+    uint32_t cpu_count;
+    uint8_t cpu_apic_ids[ACPI_MAX_CPUS];
+    uint32_t ioapic_count;
+    acpi_ioapic_t ioapics[ACPI_MAX_IOAPICS];
+    uint32_t isa_gsi[ACPI_ISA_IRQS];        // ISA IRQ -> global system interrupt
+    uint16_t isa_flags[ACPI_ISA_IRQS];      // MPS INTI flags from overrides
+}
+acpi_madt_info_t;
+
+bool acpi_init(void);
+const acpi_madt_info_t* acpi_madt(void);
+
+#endif
@@ -0,0 +1,322 @@
+#include "fbcon.h"
+#include "../memory/physical.h"
+#include "../usermode/fpu.h"
+
+extern shell_instance_t* g_kernel_shell;
+
+#define FBCON_NO_CELL   0xFFFFFFFF      // Cell key never drawn, forces a redraw
+#define FBCON_SECTORS(bytes) (((bytes) + PMM_SECTOR_SIZE - 1) / PMM_SECTOR_SIZE)
+
+typedef struct
+{
+    uint32_t pixels[FBCON_GLYPH_W * FBCON_GLYPH_H];
+}
+fbcon_glyph_t;
+
+// VGA text attribute colours as 0xRRGGBB
+static const uint32_t fbcon_vga_rgb[16] =
+{
+    0x000000, 0x0000AA, 0x00AA00, 0x00AAAA, 0xAA0000, 0xAA00AA, 0xAA5500, 0xAAAAAA,
+    0x555555, 0x5555FF, 0x55FF55, 0x55FFFF, 0xFF5555, 0xFF55FF, 0xFFFF55, 0xFFFFFF,
+};
+
+static volatile uint8_t* fbcon_fb;
+static uint32_t fbcon_pitch;                    // Framebuffer bytes per line
+static bool fbcon_stream;                       // Lines 16-byte aligned, non-temporal stores
+
+static uint32_t* fbcon_shadow;                  // What the screen shows
+static uint32_t fbcon_stride;                   // Shadow pixels per line, a multiple of 16
+static uint32_t fbcon_cols, fbcon_rows;
+static uint32_t* fbcon_cells;                   // Key of the glyph drawn in each cell
+
+// Shadow pixels newer than the framebuffer, empty while left == right
+static uint32_t fbcon_dirty_left, fbcon_dirty_right;
+static uint32_t fbcon_dirty_top, fbcon_dirty_bottom;
+
+static fbcon_glyph_t* fbcon_cache;
+static uint32_t fbcon_cache_keys[FBCON_CACHE_SIZE];
+static uint32_t fbcon_palette[16];
+
+static uint32_t fbcon_hits, fbcon_misses;
+static uint32_t fbcon_presents, fbcon_scrolls;
+static uint64_t fbcon_bytes;                    // Copied out to the framebuffer
+
+static void fbcon_scroll(size_t lines);
+static void fbcon_draw(size_t line, const shell_char_t* cells, size_t count);
+static void fbcon_present(void);
+
+static sh_display_t fbcon_shell_display =
+{
+    .scroll = fbcon_scroll,
+    .draw = fbcon_draw,
+    .present = fbcon_present,
+};
+
+static uint32_t fbcon_channel(uint32_t value, uint8_t pos, uint8_t size)
+{
+    if (size > 8)
+        size = 8;
+    return (value >> (8 - size)) << pos;
+}
+
+// bytes: a multiple of 32; src: 16-byte aligned. Caller holds the FPU.
+static void fbcon_copy_sse(void* dst, const void* src, size_t bytes, bool stream)
+{
+    if (stream)
+    {
+        __asm__ volatile (
+            "1:\n\t"
+            "movdqa (%1), %%xmm0\n\t"
+            "movdqa 16(%1), %%xmm1\n\t"
+            "movntdq %%xmm0, (%0)\n\t"
+            "movntdq %%xmm1, 16(%0)\n\t"
+            "add $32, %0\n\t"
+            "add $32, %1\n\t"
+            "sub $32, %2\n\t"
+            "jnz 1b"
+            : "+r"(dst), "+r"(src), "+r"(bytes) : : "memory", "cc");
+    }
+    else
+    {
+        __asm__ volatile (
+            "1:\n\t"
+            "movdqa (%1), %%xmm0\n\t"
+            "movdqa 16(%1), %%xmm1\n\t"
+            "movdqu %%xmm0, (%0)\n\t"
+            "movdqu %%xmm1, 16(%0)\n\t"
+            "add $32, %0\n\t"
+            "add $32, %1\n\t"
+            "sub $32, %2\n\t"
+            "jnz 1b"
+            : "+r"(dst), "+r"(src), "+r"(bytes) : : "memory", "cc");
+    }
+}
+
+// Forward, so it also moves the shadow buffer up over itself
+static void fbcon_copy(volatile void* dst, const void* src, size_t bytes, bool sse, bool stream)
+{
+    if (!bytes)
+        return;
+    if (sse)
+    {
+        fbcon_copy_sse((void*)dst, src, bytes, stream);
+        return;
+    }
+
+    volatile uint32_t* d = (volatile uint32_t*)dst;
+    const uint32_t* s = (const uint32_t*)src;
+    for (size_t i = 0; i < bytes / sizeof(uint32_t); i++)
+        d[i] = s[i];
+}
+
+static void fbcon_mark(uint32_t left, uint32_t top, uint32_t right, uint32_t bottom)
+{
+    if (fbcon_dirty_left == fbcon_dirty_right)
+    {
+        fbcon_dirty_left = left;
+        fbcon_dirty_right = right;
+        fbcon_dirty_top = top;
+        fbcon_dirty_bottom = bottom;
+        return;
+    }
+
+    if (left < fbcon_dirty_left)
+        fbcon_dirty_left = left;
+    if (right > fbcon_dirty_right)
+        fbcon_dirty_right = right;
+    if (top < fbcon_dirty_top)
+        fbcon_dirty_top = top;
+    if (bottom > fbcon_dirty_bottom)
+        fbcon_dirty_bottom = bottom;
+}
+
+static const fbcon_glyph_t* fbcon_glyph(uint32_t key)
+{
+    uint32_t slot = ((key & 0xFF) ^ ((key >> 8) * 37)) & (FBCON_CACHE_SIZE - 1);
+    fbcon_glyph_t* glyph = &fbcon_cache[slot];
+    if (fbcon_cache_keys[slot] == key)
+    {
+        fbcon_hits++;
+        return glyph;
+    }
+    fbcon_misses++;
+
+    uint8_t c = key & 0xFF;
+    if (c < FBCON_FONT_FIRST || c >= FBCON_FONT_FIRST + FBCON_FONT_GLYPHS)
+        c = '?';
+    const uint8_t* rows = fbcon_font[c - FBCON_FONT_FIRST];
+    uint32_t fg = fbcon_palette[(key >> 8) & 0x0F];
+    uint32_t bg = fbcon_palette[(key >> 12) & 0x0F];
+
+    uint32_t* px = glyph->pixels;
+    for (int y = 0; y < FBCON_GLYPH_H; y++)
+    {
+        uint8_t bits = rows[y * FBCON_FONT_ROWS / FBCON_GLYPH_H];
+        for (int x = 0; x < FBCON_GLYPH_W; x++)
+            *px++ = (bits & (0x80 >> x)) ? fg : bg;
+    }
+    fbcon_cache_keys[slot] = key;
+    return glyph;
+}
+
+static void fbcon_draw(size_t line, const shell_char_t* cells, size_t count)
+{
+    if (line >= fbcon_rows)
+        return;
+    if (count > fbcon_cols)
+        count = fbcon_cols;
+
+    // Only cells whose character or colour changed, one rectangle for the line
+    uint32_t* drawn = &fbcon_cells[line * fbcon_cols];
+    uint32_t first = fbcon_cols, last = 0;
+    for (uint32_t col = 0; col < count; col++)
+    {
+        uint32_t key = (uint8_t)cells[col].character | (uint32_t)(uint8_t)cells[col].vga_color << 8;
+        if (drawn[col] == key)
+            continue;
+        drawn[col] = key;
+
+        const uint32_t* src = fbcon_glyph(key)->pixels;
+        uint32_t* dst = &fbcon_shadow[line * FBCON_GLYPH_H * fbcon_stride + col * FBCON_GLYPH_W];
+        for (int y = 0; y < FBCON_GLYPH_H; y++)
+        {
+            for (int x = 0; x < FBCON_GLYPH_W; x++)
+                dst[x] = src[x];
+            src += FBCON_GLYPH_W;
+            dst += fbcon_stride;
+        }
+
+        if (col < first)
+            first = col;
+        last = col;
+    }
+
+    if (first <= last)
+        fbcon_mark(first * FBCON_GLYPH_W, line * FBCON_GLYPH_H,
+                   (last + 1) * FBCON_GLYPH_W, (line + 1) * FBCON_GLYPH_H);
+}
+
+static void fbcon_scroll(size_t lines)
+{
+    if (!lines || lines >= fbcon_rows)
+        return;
+    fbcon_scrolls++;
+
+    uint32_t kept = fbcon_rows - lines;
+    bool sse = fpu_kernel_begin();
+    fbcon_copy(fbcon_shadow, &fbcon_shadow[lines * FBCON_GLYPH_H * fbcon_stride],
+               kept * FBCON_GLYPH_H * fbcon_stride * sizeof(uint32_t), sse, false);
+    if (sse)
+        fpu_kernel_end();
+
+    // The shell redraws the lines that came in at the bottom
+    for (uint32_t i = 0; i < kept * fbcon_cols; i++)
+        fbcon_cells[i] = fbcon_cells[i + lines * fbcon_cols];
+    for (uint32_t i = kept * fbcon_cols; i < fbcon_rows * fbcon_cols; i++)
+        fbcon_cells[i] = FBCON_NO_CELL;
+
+    fbcon_mark(0, 0, fbcon_cols * FBCON_GLYPH_W, fbcon_rows * FBCON_GLYPH_H);
+}
+
+static void fbcon_present(void)
+{
+    if (fbcon_dirty_left == fbcon_dirty_right)
+        return;
+    fbcon_presents++;
+
+    // Columns are whole cells: 32-byte aligned spans in the shadow buffer
+    size_t bytes = (fbcon_dirty_right - fbcon_dirty_left) * sizeof(uint32_t);
+    bool sse = fpu_kernel_begin();
+    for (uint32_t y = fbcon_dirty_top; y < fbcon_dirty_bottom; y++)
+    {
+        fbcon_copy(fbcon_fb + y * fbcon_pitch + fbcon_dirty_left * sizeof(uint32_t),
+                   &fbcon_shadow[y * fbcon_stride + fbcon_dirty_left], bytes, sse, fbcon_stream);
+    }
+    if (sse)
+    {
+        __asm__ volatile ("sfence" ::: "memory");
+        fpu_kernel_end();
+    }
+
+    fbcon_bytes += (uint64_t)bytes * (fbcon_dirty_bottom - fbcon_dirty_top);
+    fbcon_dirty_left = fbcon_dirty_right = 0;
+}
+
+bool fbcon_init(const multiboot_tag_framebuffer_t* fb)
+{
+    if (fb->fb_type != MULTIBOOT_FRAMEBUFFER_TYPE_RGB || fb->bpp != 32)
+        return false;
+    if (fb->addr >> 32 || fb->pitch < fb->width * sizeof(uint32_t))
+        return false;
+
+    fbcon_cols = fb->width / FBCON_GLYPH_W;
+    fbcon_rows = fb->height / FBCON_GLYPH_H;
+    if (fbcon_cols > SH_MAX_WIDTH)
+        fbcon_cols = SH_MAX_WIDTH;
+    if (fbcon_rows > SH_MAX_HEIGHT)
+        fbcon_rows = SH_MAX_HEIGHT;
+    if (!fbcon_cols || !fbcon_rows)
+        return false;
+
+    fbcon_stride = (fbcon_cols * FBCON_GLYPH_W + 15) & ~15;
+    size_t shadow_bytes = fbcon_stride * fbcon_rows * FBCON_GLYPH_H * sizeof(uint32_t);
+    size_t shadow_sectors = FBCON_SECTORS(shadow_bytes);
+    size_t cells_sectors = FBCON_SECTORS(fbcon_cols * fbcon_rows * sizeof(uint32_t));
+    size_t cache_sectors = FBCON_SECTORS(FBCON_CACHE_SIZE * sizeof(fbcon_glyph_t));
+    fbcon_shadow = (uint32_t*)mem_phys_alloc_sectors(shadow_sectors);
+    fbcon_cells = (uint32_t*)mem_phys_alloc_sectors(cells_sectors);
+    fbcon_cache = (fbcon_glyph_t*)mem_phys_alloc_sectors(cache_sectors);
+    if (!fbcon_shadow || !fbcon_cells || !fbcon_cache)
+    {
+        if (fbcon_shadow) mem_phys_free_sectors(fbcon_shadow, shadow_sectors);
+        if (fbcon_cells) mem_phys_free_sectors(fbcon_cells, cells_sectors);
+        if (fbcon_cache) mem_phys_free_sectors(fbcon_cache, cache_sectors);
+        return false;
+    }
+
+    for (int i = 0; i < 16; i++)
+    {
+        uint32_t rgb = fbcon_vga_rgb[i];
+        fbcon_palette[i] = fbcon_channel((rgb >> 16) & 0xFF, fb->red_pos, fb->red_size) |
+                           fbcon_channel((rgb >> 8) & 0xFF, fb->green_pos, fb->green_size) |
+                           fbcon_channel(rgb & 0xFF, fb->blue_pos, fb->blue_size);
+    }
+    for (int i = 0; i < FBCON_CACHE_SIZE; i++)
+        fbcon_cache_keys[i] = FBCON_NO_CELL;
+    for (uint32_t i = 0; i < fbcon_cols * fbcon_rows; i++)
+        fbcon_cells[i] = FBCON_NO_CELL;
+    for (size_t i = 0; i < shadow_bytes / sizeof(uint32_t); i++)
+        fbcon_shadow[i] = 0;
+
+    fbcon_fb = (volatile uint8_t*)(uintptr_t)fb->addr;
+    fbcon_pitch = fb->pitch;
+    fbcon_stream = !((uintptr_t)fbcon_fb & 15) && !(fbcon_pitch & 15);
+    fbcon_dirty_left = fbcon_dirty_right = 0;
+
+    // Whatever the loader left outside the text area stays black
+    for (uint32_t y = 0; y < fb->height; y++)
+    {
+        volatile uint32_t* line = (volatile uint32_t*)(fbcon_fb + y * fbcon_pitch);
+        for (uint32_t x = 0; x < fb->width; x++)
+            line[x] = 0;
+    }
+
+    fbcon_shell_display.width = fbcon_cols;
+    fbcon_shell_display.height = fbcon_rows;
+    return true;
+}
+
+const sh_display_t* fbcon_display(void)
+{
+    return &fbcon_shell_display;
+}
+
+void fbcon_stats_dump(void)
+{
+    if (!g_kernel_shell || !fbcon_fb)
+        return;
+
+    sh_printf(g_kernel_shell, "FBCON %ux%u cells, GLYPHS %u hit %u miss, %u presents (%llu KB), %u scrolls\r\n",
+              fbcon_cols, fbcon_rows, fbcon_hits, fbcon_misses, fbcon_presents,
+              fbcon_bytes >> 10, fbcon_scrolls);
+}
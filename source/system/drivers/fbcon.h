@@ -0,0 +1,35 @@
+#ifndef K_DRIVERS_FBCON_H
+#define K_DRIVERS_FBCON_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "../../boot/multiboot.h"
+#include "../shell/shell.h"
+
+// Text console on the linear framebuffer the boot loader set up, 32 bpp
+// direct colour only. Cells are drawn into a shadow buffer in RAM, never
+// read back from the framebuffer, and each flush copies out the rectangle
+// that changed with SSE streaming stores. Scrolling moves the shadow buffer
+// and the next present copies the whole screen once.
+#define FBCON_FONT_FIRST    0x20
+#define FBCON_FONT_GLYPHS   95          // ' ' to '~'
+#define FBCON_FONT_ROWS     8
+#define FBCON_GLYPH_W       8
+#define FBCON_GLYPH_H       16          // Font rows doubled
+
+// Rendered glyphs by character and attribute, direct mapped
+#define FBCON_CACHE_SIZE    256         // Power of two
+
+extern const uint8_t fbcon_font[FBCON_FONT_GLYPHS][FBCON_FONT_ROWS];
+
+// False if the mode is not usable or the buffers cannot be allocated.
+// Needs the physical allocator and the identity map.
+bool fbcon_init(const multiboot_tag_framebuffer_t* fb);
+
+// For sh_set_display, once fbcon_init succeeded
+const sh_display_t* fbcon_display(void);
+
+void fbcon_stats_dump(void);
+
+#endif
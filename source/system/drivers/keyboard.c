@@ -0,0 +1,128 @@
+#include "keyboard.h"
+#include "../interrupts/interrupts.h"
+#include "../interrupts/softirq.h"
+#include "../shell/shell.h"
+#include "../../arch/x86/ports.h"
+
+extern shell_instance_t* g_kernel_shell;
+
+static int_action_t keyboard_action;
+static tasklet_t keyboard_tasklet;
+
+// Scancodes queued by the IRQ, consumed by the tasklet (single producer / consumer)
+static volatile uint8_t keyboard_queue[KEYBOARD_QUEUE_SIZE];
+static volatile uint32_t keyboard_queue_head = 0;
+static volatile uint32_t keyboard_queue_tail = 0;
+static uint32_t keyboard_dropped = 0;
+
+// Simple scancode to ASCII conversion for debugging
+static char scancode_to_ascii(uint8_t scancode)
+{
+    static char keymap[128] = {
+        0,  27, '1', '2', '3', '4', '5', '6', '7', '8',    // 0-9
+        '9', '0', '-', '=', '\b',                          // 10-14
+        '\t', 'q', 'w', 'e', 'r', 't', 'y', 'u', 'i', 'o', 'p', '[', ']', '\n', // 15-28
+        0,    // 29 - Control
+        'a', 's', 'd', 'f', 'g', 'h', 'j', 'k', 'l', ';', '\'', '`', 0, // 30-42
+        '\\', 'z', 'x', 'c', 'v', 'b', 'n', 'm', ',', '.', '/',   0, // 43-53
+        '*',
+        0,  // Alt
+        ' ', // Space bar
+        0,  // Caps lock
+        0,  // 59 - F1 key ... >
+        0,   0,   0,   0,   0,   0,   0,   0,
+        0,  // < ... F10
+        0,  // 69 - Num lock
+        0,  // Scroll Lock
+        0,  // Home key
+        0,  // Up Arrow
+        0,  // Page Up
+        '-',
+        0,  // Left Arrow
+        0,
+        0,  // Right Arrow
+        '+',
+        0,  // 79 - End key
+        0,  // Down Arrow
+        0,  // Page Down
+        0,  // Insert Key
+        0,  // Delete Key
+        0,   0,   0,
+        0,  // F11 Key
+        0,  // F12 Key
+        0,  // All other keys are undefined
+    };
+    
+    if (scancode >= 128) return 0; // Key release
+    return keymap[scancode];
+}
+
+
+// Bottom half: translate and feed stdin, which renders the console
+static void keyboard_work(void* ctx)
+{
+    (void)ctx;
+
+    while (keyboard_queue_tail != keyboard_queue_head)
+    {
+        uint8_t scancode = keyboard_queue[keyboard_queue_tail & (KEYBOARD_QUEUE_SIZE - 1)];
+        keyboard_queue_tail++;
+
+        char ascii = scancode_to_ascii(scancode);
+        if (scancode < 128 && ascii && g_kernel_shell) // Key press with valid ASCII
+        { 
+            // Write to stdin stream
+            sh_input(g_kernel_shell, &ascii, 1);
+        }
+    }
+}
+
+// Top half: take the byte off the controller and get out
+static bool keyboard_interrupt(interrupt_frame_t* frame, void* ctx)
+{
+    (void)frame;
+    (void)ctx;
+
+    uint8_t scancode = inb(KEYBOARD_DATA_PORT);
+    if (keyboard_queue_head - keyboard_queue_tail < KEYBOARD_QUEUE_SIZE)
+    {
+        keyboard_queue[keyboard_queue_head & (KEYBOARD_QUEUE_SIZE - 1)] = scancode;
+        keyboard_queue_head++;
+    }
+    else
+    {
+        keyboard_dropped++;
+    }
+
+    tasklet_schedule(&keyboard_tasklet);
+    return true;
+}
+
+void keyboard_init(void)
+{
+    tasklet_init(&keyboard_tasklet, keyboard_work, 0);
+    int_setup_action(&keyboard_action, keyboard_interrupt, 0, "keyboard");
+    irq_register(KEYBOARD_IRQ, &keyboard_action);
+    irq_enable(KEYBOARD_IRQ);
+}
+
+// Function to test if keyboard is working
+void keyboard_test(void)
+{
+    if (g_kernel_shell) {
+        sh_puts(g_kernel_shell, "Testing keyboard controller...\r\n");
+        
+        // Check keyboard controller status
+        uint8_t status = inb(KEYBOARD_STATUS_PORT);
+        sh_printf(g_kernel_shell, "Keyboard controller status: 0x%x\r\n", status);
+        
+        // Check if output buffer is full
+        if (status & 0x01) {
+            uint8_t data = inb(KEYBOARD_DATA_PORT);
+            sh_printf(g_kernel_shell, "Data in keyboard buffer: 0x%x\r\n", data);
+        }
+        
+        sh_puts(g_kernel_shell, "Press any key to test interrupts...\r\n");
+    }
+}
+
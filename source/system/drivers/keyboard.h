@@ -0,0 +1,12 @@
+#ifndef K_DRIVERS_KEYBOARD_H
+#define K_DRIVERS_KEYBOARD_H
+
+#define KEYBOARD_IRQ            1
+#define KEYBOARD_DATA_PORT      0x60
+#define KEYBOARD_STATUS_PORT    0x64
+#define KEYBOARD_QUEUE_SIZE     64          // Power of two
+
+void keyboard_init(void);
+void keyboard_test(void);
+
+#endif
@@ -0,0 +1,191 @@
+#include "serial.h"
+#include "../interrupts/interrupts.h"
+#include "../interrupts/softirq.h"
+#include "../shell/shell.h"
+#include "../sync/spinlock.h"
+#include "../../arch/x86/ports.h"
+
+extern shell_instance_t* g_kernel_shell;
+
+static bool serial_found = false;
+static int_action_t serial_action;
+static tasklet_t serial_rx_tasklet;
+
+// Output ring, filled by writers and drained by the transmit interrupt.
+// Positions only grow, the index is pos & (SERIAL_TX_SIZE - 1).
+static lock_stats_t serial_lock_stats = LOCK_STATS_INIT("serial");
+static spinlock_t serial_lock = SPINLOCK_INIT_STATS(&serial_lock_stats);
+static char serial_tx[SERIAL_TX_SIZE];
+static uint32_t serial_tx_head = 0;
+static uint32_t serial_tx_tail = 0;
+static bool serial_tx_busy = false;         // THRE interrupt pending, it refills the FIFO
+
+// Input bytes queued by the IRQ, consumed by the tasklet (single producer / consumer)
+static volatile char serial_rx[SERIAL_RX_SIZE];
+static volatile uint32_t serial_rx_head = 0;
+static volatile uint32_t serial_rx_tail = 0;
+
+static uint32_t serial_tx_bytes = 0;
+static uint32_t serial_rx_bytes = 0;
+static uint32_t serial_tx_dropped = 0;
+static uint32_t serial_rx_dropped = 0;
+
+// Lock held. Fills the (empty) FIFO from the ring, false if nothing was left
+static bool serial_tx_fill(void)
+{
+    uint32_t n = 0;
+    while (n < SERIAL_FIFO_SIZE && serial_tx_tail != serial_tx_head)
+    {
+        outb(SERIAL_COM1_PORT + SERIAL_DATA, serial_tx[serial_tx_tail & (SERIAL_TX_SIZE - 1)]);
+        serial_tx_tail++;
+        n++;
+    }
+    serial_tx_bytes += n;
+    return n != 0;
+}
+
+int serial_write(const char* buf, int len)
+{
+    if (!serial_found || len <= 0)
+        return 0;
+
+    uint32_t flags = spin_lock_irqsave(&serial_lock);
+    uint32_t room = SERIAL_TX_SIZE - (serial_tx_head - serial_tx_tail);
+    uint32_t n = (uint32_t)len < room ? (uint32_t)len : room;
+    for (uint32_t i = 0; i < n; i++)
+        serial_tx[(serial_tx_head + i) & (SERIAL_TX_SIZE - 1)] = buf[i];
+    serial_tx_head += n;
+    serial_tx_dropped += len - n;
+
+    // Idle transmitter: the FIFO is empty, start it, the interrupt does the rest
+    if (!serial_tx_busy)
+        serial_tx_busy = serial_tx_fill();
+    spin_unlock_irqrestore(&serial_lock, flags);
+    return n;
+}
+
+// Bottom half: feed stdin. Terminals send CR for Enter, the shell wants LF.
+static void serial_rx_work(void* ctx)
+{
+    (void)ctx;
+
+    char buf[64];
+    while (serial_rx_tail != serial_rx_head)
+    {
+        int n = 0;
+        while (n < (int)sizeof(buf) && serial_rx_tail != serial_rx_head)
+        {
+            char c = serial_rx[serial_rx_tail & (SERIAL_RX_SIZE - 1)];
+            serial_rx_tail++;
+            buf[n++] = c == '\r' ? '\n' : c;
+        }
+        if (g_kernel_shell)
+            sh_input(g_kernel_shell, buf, n);
+    }
+}
+
+static bool serial_interrupt(interrupt_frame_t* frame, void* ctx)
+{
+    (void)frame;
+    (void)ctx;
+
+    bool handled = false;
+    uint8_t iir;
+    while (!((iir = inb(SERIAL_COM1_PORT + SERIAL_IIR)) & SERIAL_IIR_NONE))
+    {
+        handled = true;
+        switch (iir & SERIAL_IIR_ID_MASK)
+        {
+            case SERIAL_IIR_RX:
+            case SERIAL_IIR_TIMEOUT:
+                while (inb(SERIAL_COM1_PORT + SERIAL_LSR) & SERIAL_LSR_DATA)
+                {
+                    char c = inb(SERIAL_COM1_PORT + SERIAL_DATA);
+                    if (serial_rx_head - serial_rx_tail < SERIAL_RX_SIZE)
+                    {
+                        serial_rx[serial_rx_head & (SERIAL_RX_SIZE - 1)] = c;
+                        serial_rx_head++;
+                        serial_rx_bytes++;
+                    }
+                    else
+                    {
+                        serial_rx_dropped++;
+                    }
+                }
+                tasklet_schedule(&serial_rx_tasklet);
+                break;
+
+            case SERIAL_IIR_THRE:
+                spin_lock(&serial_lock);
+                serial_tx_busy = serial_tx_fill();
+                spin_unlock(&serial_lock);
+                break;
+
+            case SERIAL_IIR_LINE:
+                inb(SERIAL_COM1_PORT + SERIAL_LSR);
+                break;
+
+            default:
+                inb(SERIAL_COM1_PORT + SERIAL_MSR);
+                break;
+        }
+    }
+    return handled;
+}
+
+bool serial_init(void)
+{
+    uint16_t port = SERIAL_COM1_PORT;
+
+    // Nothing behind the port reads back 0xFF everywhere
+    outb(port + SERIAL_SCRATCH, 0x5A);
+    if (inb(port + SERIAL_SCRATCH) != 0x5A)
+        return false;
+
+    outb(port + SERIAL_IER, 0);
+    outb(port + SERIAL_LCR, SERIAL_LCR_DLAB);
+    outb(port + SERIAL_DATA, (SERIAL_CLOCK / SERIAL_BAUD) & 0xFF);
+    outb(port + SERIAL_IER, (SERIAL_CLOCK / SERIAL_BAUD) >> 8);
+    outb(port + SERIAL_LCR, SERIAL_LCR_8N1);
+    outb(port + SERIAL_FCR, SERIAL_FCR_ENABLE | SERIAL_FCR_CLEAR_RX | SERIAL_FCR_CLEAR_TX | SERIAL_FCR_TRIGGER_14);
+
+    // Loopback check: a UART that does not echo is not one we can use
+    outb(port + SERIAL_MCR, SERIAL_MCR_LOOPBACK | SERIAL_MCR_RTS | SERIAL_MCR_DTR);
+    outb(port + SERIAL_DATA, 0xAE);
+    if (inb(port + SERIAL_DATA) != 0xAE)
+        return false;
+
+    outb(port + SERIAL_MCR, SERIAL_MCR_OUT2 | SERIAL_MCR_RTS | SERIAL_MCR_DTR);
+    while (inb(port + SERIAL_LSR) & SERIAL_LSR_DATA)
+        inb(port + SERIAL_DATA);
+
+    tasklet_init(&serial_rx_tasklet, serial_rx_work, 0);
+    int_setup_action(&serial_action, serial_interrupt, 0, "serial");
+    irq_register(SERIAL_COM1_IRQ, &serial_action);
+    lock_stats_register(&serial_lock_stats);
+
+    serial_found = true;
+    outb(port + SERIAL_IER, SERIAL_IER_RX | SERIAL_IER_THRE | SERIAL_IER_LINE);
+    irq_enable(SERIAL_COM1_IRQ);
+    return true;
+}
+
+bool serial_present(void)
+{
+    return serial_found;
+}
+
+void serial_stats_dump(void)
+{
+    if (!g_kernel_shell)
+        return;
+
+    uint32_t flags = spin_lock_irqsave(&serial_lock);
+    uint32_t tx = serial_tx_bytes;
+    uint32_t tx_dropped = serial_tx_dropped;
+    uint32_t queued = serial_tx_head - serial_tx_tail;
+    spin_unlock_irqrestore(&serial_lock, flags);
+
+    sh_printf(g_kernel_shell, "SERIAL TX %u (%u queued, %u dropped), RX %u (%u dropped)\r\n",
+              tx, queued, tx_dropped, serial_rx_bytes, serial_rx_dropped);
+}
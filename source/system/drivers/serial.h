@@ -0,0 +1,67 @@
+#ifndef K_DRIVERS_SERIAL_H
+#define K_DRIVERS_SERIAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// 16550 UART on COM1, 115200 8N1, both directions interrupt driven.
+// Output goes into a ring and the transmit interrupt refills the 16 byte
+// FIFO from it, nobody polls LSR. Input feeds STREAM_STDIN like the keyboard.
+#define SERIAL_COM1_PORT        0x3F8
+#define SERIAL_COM1_IRQ         4
+#define SERIAL_BAUD             115200
+#define SERIAL_CLOCK            115200      // Divisor base
+#define SERIAL_FIFO_SIZE        16
+
+#define SERIAL_TX_SIZE          4096        // Power of two
+#define SERIAL_RX_SIZE          256         // Power of two
+
+// Register offsets
+#define SERIAL_DATA             0           // RBR / THR, divisor low with DLAB
+#define SERIAL_IER              1           // Divisor high with DLAB
+#define SERIAL_IIR              2           // Read: interrupt id
+#define SERIAL_FCR              2           // Write: FIFO control
+#define SERIAL_LCR              3
+#define SERIAL_MCR              4
+#define SERIAL_LSR              5
+#define SERIAL_MSR              6
+#define SERIAL_SCRATCH          7
+
+#define SERIAL_IER_RX           0x01
+#define SERIAL_IER_THRE         0x02
+#define SERIAL_IER_LINE         0x04
+
+#define SERIAL_IIR_NONE         0x01        // No interrupt pending
+#define SERIAL_IIR_ID_MASK      0x0E
+#define SERIAL_IIR_MODEM        0x00
+#define SERIAL_IIR_THRE         0x02
+#define SERIAL_IIR_RX           0x04
+#define SERIAL_IIR_LINE         0x06
+#define SERIAL_IIR_TIMEOUT      0x0C        // Bytes sat in the RX FIFO below the trigger level
+
+#define SERIAL_FCR_ENABLE       0x01
+#define SERIAL_FCR_CLEAR_RX     0x02
+#define SERIAL_FCR_CLEAR_TX     0x04
+#define SERIAL_FCR_TRIGGER_14   0xC0
+
+#define SERIAL_LCR_8N1          0x03
+#define SERIAL_LCR_DLAB         0x80
+
+#define SERIAL_MCR_DTR          0x01
+#define SERIAL_MCR_RTS          0x02
+#define SERIAL_MCR_OUT2         0x08        // Gates the IRQ line on PCs
+#define SERIAL_MCR_LOOPBACK     0x10
+
+#define SERIAL_LSR_DATA         0x01
+
+// False if there is no UART at COM1
+bool serial_init(void);
+bool serial_present(void);
+
+// Queues output, never waits. What does not fit is dropped and counted.
+// Usable as a console sink (sh_set_sink) and from any context.
+int serial_write(const char* buf, int len);
+
+void serial_stats_dump(void);
+
+#endif
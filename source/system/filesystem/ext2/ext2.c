@@ -3,6 +3,43 @@
 #include <string.h>
 
 #include "../../memory/physical.h"
+#include "../../sync/spinlock.h"
+#include "../../sync/rcu.h"
+
+// Name lookup cache: (directory, name) -> inode. Lookups walk the hash
+// chains under RCU without any lock; inserts and evictions take the cache
+// lock, and an evicted entry only returns to the free list after a grace
+// period.
+#define EXT2_DCACHE_BUCKETS     64
+#define EXT2_DCACHE_ENTRIES     128
+#define EXT2_DCACHE_NAME_LEN    60      // Longer names are looked up uncached
+
+typedef struct ext2_dentry
+{
+    struct ext2_dentry *next;           // Hash chain or free list
+    struct ext2_dcache *owner;
+    rcu_head_t          rcu;
+    uint32_t            dir;
+    uint32_t            inode;
+    uint32_t            hash;
+    bool                hashed;
+    uint8_t             name_len;
+    char                name[EXT2_DCACHE_NAME_LEN];
+}
+ext2_dentry_t;
+
+typedef struct ext2_dcache
+{
+    spinlock_t     lock;
+    ext2_dentry_t *buckets[EXT2_DCACHE_BUCKETS];
+    ext2_dentry_t *free;
+    uint32_t       hand;                // Next eviction candidate, round robin
+    ext2_dentry_t  entries[EXT2_DCACHE_ENTRIES];
+}
+ext2_dcache_t;
+
+static lock_stats_t ext2_lock_stats = LOCK_STATS_INIT("ext2");
+static lock_stats_t ext2_dcache_lock_stats = LOCK_STATS_INIT("ext2_dcache");
 
 void* kpmalloc(size_t size)
 {
@@ -31,7 +68,7 @@ void kpmemcpy(void* dst, void* src, size_t size)
     }
 }
 
-bool ext2_mount(ext2_fs_t *fs, uint8_t *image_data) 
+static bool ext2_mount_locked(ext2_fs_t *fs, uint8_t *image_data) 
 {
     fs->image = image_data;
 
@@ -62,6 +99,40 @@ bool ext2_mount(ext2_fs_t *fs, uint8_t *image_data)
     return true;
 }
 
+static ext2_dcache_t* ext2_dcache_create(void)
+{
+    ext2_dcache_t *cache = (ext2_dcache_t*)kpmalloc(sizeof(ext2_dcache_t));
+    if (!cache) return 0;
+
+    kpmemset(cache, 0, sizeof(ext2_dcache_t));
+    spin_init(&cache->lock);
+    cache->lock.stats = &ext2_dcache_lock_stats;
+    lock_stats_register(&ext2_dcache_lock_stats);
+
+    for (uint32_t i = 0; i < EXT2_DCACHE_ENTRIES; i++)
+    {
+        cache->entries[i].owner = cache;
+        cache->entries[i].next = cache->free;
+        cache->free = &cache->entries[i];
+    }
+    return cache;
+}
+
+bool ext2_mount(ext2_fs_t *fs, uint8_t *image_data) 
+{
+    rwlock_init(&fs->lock);
+    fs->lock.stats = &ext2_lock_stats;
+    lock_stats_register(&ext2_lock_stats);
+
+    // Optional, lookups go to the directory every time without it
+    fs->dcache = ext2_dcache_create();
+
+    write_lock(&fs->lock);
+    bool mounted = ext2_mount_locked(fs, image_data);
+    write_unlock(&fs->lock);
+    return mounted;
+}
+
 #include "../../shell/shell.h"
 
 bool ext2_read_inode(ext2_fs_t *fs, uint32_t inode_no, ext2_inode_t *out_inode)
@@ -70,6 +141,8 @@ bool ext2_read_inode(ext2_fs_t *fs, uint32_t inode_no, ext2_inode_t *out_inode)
     if (inode_no == 0) return false;
     inode_no--;  
 
+    read_lock(&fs->lock);
+
     uint32_t group = inode_no / fs->sb.s_inodes_per_group;
     uint32_t index = inode_no % fs->sb.s_inodes_per_group;
     uint32_t inode_table_block = fs->bgdt[group].bg_inode_table;
@@ -86,12 +159,14 @@ bool ext2_read_inode(ext2_fs_t *fs, uint32_t inode_no, ext2_inode_t *out_inode)
     kpmemcpy(out_inode,
              fs->image + abs_offset,
              sizeof(ext2_inode_t));
+    read_unlock(&fs->lock);
     return true;
 }
 
 
 void ext2_read_dir(ext2_fs_t *fs, ext2_inode_t *dir, ext2_dirent_cb_t cb, void *ctx) 
 {
+    read_lock(&fs->lock);
     uint32_t blk_count = dir->i_blocks / (fs->block_size / 512);
 
     for (uint32_t b = 0; b < 12 && b < blk_count; ++b) 
@@ -109,7 +184,11 @@ void ext2_read_dir(ext2_fs_t *fs, ext2_inode_t *dir, ext2_dirent_cb_t cb, void *
             {
                 char name[256] = {0};
                 kpmemcpy(name, de->name, de->name_len);
-                if (!cb(name, de->inode, ctx)) return;
+                if (!cb(name, de->inode, ctx)) 
+                {
+                    read_unlock(&fs->lock);
+                    return;
+                }
             }
 
             if (de->rec_len == 0) break;
@@ -117,6 +196,7 @@ void ext2_read_dir(ext2_fs_t *fs, ext2_inode_t *dir, ext2_dirent_cb_t cb, void *
             offset += de->rec_len;
         }
     }
+    read_unlock(&fs->lock);
 }
 
 size_t ext2_read_file(ext2_fs_t *fs, ext2_inode_t *inode,
@@ -135,6 +215,8 @@ size_t ext2_read_file(ext2_fs_t *fs, ext2_inode_t *inode,
     
     size_t bytes_read = 0;
     uint8_t *output = (uint8_t*)out_buf;
+
+    read_lock(&fs->lock);
     
     // For simplicity, only handle direct blocks (first 12 blocks)
     uint32_t blocks_to_read = (offset + buf_len + fs->block_size - 1) / fs->block_size;
@@ -174,5 +256,155 @@ size_t ext2_read_file(ext2_fs_t *fs, ext2_inode_t *inode,
         bytes_read += bytes_in_block;
     }
     
+    read_unlock(&fs->lock);
     return bytes_read;
-}
\ No newline at end of file
+}
+
+// FNV-1a over the name, seeded with the directory
+static uint32_t ext2_name_hash(uint32_t dir, const char *name, uint32_t *len)
+{
+    uint32_t hash = 2166136261u ^ dir;
+    uint32_t n = 0;
+    while (name[n])
+    {
+        hash = (hash ^ (uint8_t)name[n]) * 16777619u;
+        n++;
+    }
+    *len = n;
+    return hash;
+}
+
+static bool ext2_dentry_match(const ext2_dentry_t *d, uint32_t dir, uint32_t hash,
+                              const char *name, uint32_t len)
+{
+    if (d->hash != hash || d->dir != dir || d->name_len != len)
+        return false;
+    for (uint32_t i = 0; i < len; i++)
+        if (d->name[i] != name[i]) return false;
+    return true;
+}
+
+static void ext2_dentry_free_rcu(rcu_head_t *head)
+{
+    ext2_dentry_t *d = (ext2_dentry_t*)((uint8_t*)head - __builtin_offsetof(ext2_dentry_t, rcu));
+    ext2_dcache_t *cache = d->owner;
+
+    uint32_t flags = spin_lock_irqsave(&cache->lock);
+    d->next = cache->free;
+    cache->free = d;
+    spin_unlock_irqrestore(&cache->lock, flags);
+}
+
+// Cache lock held: unhashes the next entry under the hand, it is handed
+// back to the free list once no reader can still be walking over it
+static void ext2_dcache_evict(ext2_dcache_t *cache)
+{
+    for (uint32_t tries = 0; tries < EXT2_DCACHE_ENTRIES; tries++)
+    {
+        ext2_dentry_t *d = &cache->entries[cache->hand];
+        cache->hand = (cache->hand + 1) % EXT2_DCACHE_ENTRIES;
+        if (!d->hashed) continue;
+
+        ext2_dentry_t **link = &cache->buckets[d->hash % EXT2_DCACHE_BUCKETS];
+        while (*link != d)
+            link = &(*link)->next;
+
+        // Readers already on d keep following d->next, which stays valid
+        rcu_assign_pointer(*link, d->next);
+        d->hashed = false;
+        call_rcu(&d->rcu, ext2_dentry_free_rcu);
+        return;
+    }
+}
+
+static void ext2_dcache_insert(ext2_dcache_t *cache, uint32_t dir, uint32_t hash,
+                               const char *name, uint32_t len, uint32_t inode)
+{
+    uint32_t flags = spin_lock_irqsave(&cache->lock);
+    ext2_dentry_t **bucket = &cache->buckets[hash % EXT2_DCACHE_BUCKETS];
+
+    // Another CPU may have missed on the same name and won the race
+    for (ext2_dentry_t *d = *bucket; d; d = d->next)
+    {
+        if (ext2_dentry_match(d, dir, hash, name, len))
+        {
+            spin_unlock_irqrestore(&cache->lock, flags);
+            return;
+        }
+    }
+
+    ext2_dentry_t *d = cache->free;
+    if (!d)
+    {
+        // Make room for a later insert, this one goes uncached
+        ext2_dcache_evict(cache);
+        spin_unlock_irqrestore(&cache->lock, flags);
+        return;
+    }
+    cache->free = d->next;
+
+    d->dir = dir;
+    d->inode = inode;
+    d->hash = hash;
+    d->name_len = (uint8_t)len;
+    kpmemcpy(d->name, (void*)name, len);
+    d->hashed = true;
+    d->next = *bucket;
+    rcu_assign_pointer(*bucket, d);
+
+    spin_unlock_irqrestore(&cache->lock, flags);
+}
+
+typedef struct
+{
+    const char *name;
+    uint32_t    inode;
+}
+ext2_lookup_ctx_t;
+
+static bool ext2_lookup_cb(const char *name, uint32_t inode, void *ctx)
+{
+    ext2_lookup_ctx_t *lookup = (ext2_lookup_ctx_t*)ctx;
+    const char *a = name, *b = lookup->name;
+    while (*a && *a == *b) { a++; b++; }
+    if (*a != *b) return true;
+
+    lookup->inode = inode;
+    return false;
+}
+
+uint32_t ext2_lookup(ext2_fs_t *fs, uint32_t dir_inode_no, const char *name)
+{
+    uint32_t len;
+    uint32_t hash = ext2_name_hash(dir_inode_no, name, &len);
+    ext2_dcache_t *cache = fs->dcache;
+
+    if (cache && len < EXT2_DCACHE_NAME_LEN)
+    {
+        uint32_t inode = 0;
+        rcu_read_lock();
+        for (ext2_dentry_t *d = rcu_dereference(cache->buckets[hash % EXT2_DCACHE_BUCKETS]);
+             d; d = rcu_dereference(d->next))
+        {
+            if (ext2_dentry_match(d, dir_inode_no, hash, name, len))
+            {
+                inode = d->inode;
+                break;
+            }
+        }
+        rcu_read_unlock();
+
+        if (inode) return inode;
+    }
+
+    // Miss: scan the directory itself
+    ext2_inode_t dir;
+    if (!ext2_read_inode(fs, dir_inode_no, &dir)) return 0;
+
+    ext2_lookup_ctx_t ctx = { .name = name, .inode = 0 };
+    ext2_read_dir(fs, &dir, ext2_lookup_cb, &ctx);
+
+    if (ctx.inode && cache && len < EXT2_DCACHE_NAME_LEN)
+        ext2_dcache_insert(cache, dir_inode_no, hash, name, len, ctx.inode);
+    return ctx.inode;
+}
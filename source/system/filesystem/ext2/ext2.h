@@ -5,6 +5,8 @@
 #include <stddef.h>
 #include <stdbool.h>
 
+#include "../../sync/rwlock.h"
+
 #define EXT2_SUPER_MAGIC     0xEF53
 #define EXT2_SUPER_OFFSET    1024
 #define EXT2_ROOT_INO        2 // Root directory inode is always 2
@@ -80,12 +82,16 @@ typedef struct __attribute__((packed))
 }
 ext2_group_desc_t;
 
+struct ext2_dcache;
+
 typedef struct
 {
     ext2_superblock_t sb;
     uint32_t          block_size;
     ext2_group_desc_t *bgdt;         // in-memory copy of group descriptors (allocated with malloc)
     uint8_t          *image;        // pointer to the raw disk image
+    rwlock_t          lock;         // readers: every lookup; writer: mount
+    struct ext2_dcache *dcache;     // name -> inode cache, RCU protected
 }
 ext2_fs_t;
 
@@ -106,7 +112,8 @@ bool ext2_mount(ext2_fs_t *fs, uint8_t *image_data);
 bool ext2_read_inode(ext2_fs_t *fs, uint32_t inode_no,
                      ext2_inode_t *out_inode);
 
-// Read a directory: invoke callback for each entry
+// Read a directory: invoke callback for each entry.
+// Runs under the read lock, the callback must not call back into ext2.
 typedef bool (*ext2_dirent_cb_t)(const char *name, uint32_t inode, void *ctx);
 void ext2_read_dir(ext2_fs_t *fs, ext2_inode_t *dir_inode,
                    ext2_dirent_cb_t cb, void *ctx);
@@ -115,4 +122,7 @@ void ext2_read_dir(ext2_fs_t *fs, ext2_inode_t *dir_inode,
 size_t ext2_read_file(ext2_fs_t *fs, ext2_inode_t *inode,
                       void *out_buf, size_t buf_len, size_t offset);
 
+// Look up a name in a directory through the name cache; 0 if not found
+uint32_t ext2_lookup(ext2_fs_t *fs, uint32_t dir_inode_no, const char *name);
+
 #endif
@@ -0,0 +1,184 @@
+#include "apic.h"
+#include "../acpi/acpi.h"
+#include "../memory/virtual.h"
+#include "../../arch/x86/cpu.h"
+#include "../../arch/x86/ports.h"
+
+static volatile uint32_t* apic_lapic = 0;
+static bool apic_active = false;
+
+uint32_t apic_read(uint32_t reg)
+{
+    return apic_lapic[reg / 4];
+}
+
+void apic_write(uint32_t reg, uint32_t value)
+{
+    apic_lapic[reg / 4] = value;
+}
+
+// Local APIC of an application processor, the I/O APICs are already set up
+void apic_init_ap(void)
+{
+    wrmsr(MSR_APIC_BASE, rdmsr(MSR_APIC_BASE) | 0x800);
+    apic_write(LAPIC_REG_TPR, 0);
+    apic_write(LAPIC_REG_LVT_TIMER, LAPIC_LVT_MASKED);
+    apic_write(LAPIC_REG_LVT_LINT0, LAPIC_LVT_MASKED);
+    apic_write(LAPIC_REG_LVT_LINT1, LAPIC_LVT_MASKED);
+    apic_write(LAPIC_REG_LVT_ERROR, LAPIC_LVT_MASKED);
+    apic_write(LAPIC_REG_SVR, LAPIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+}
+
+void apic_send_ipi(uint8_t dest_apic_id, uint32_t command)
+{
+    uint32_t flags = irq_save();
+
+    apic_write(LAPIC_REG_ICR_HIGH, (uint32_t)dest_apic_id << 24);
+    apic_write(LAPIC_REG_ICR_LOW, command);
+    while (apic_read(LAPIC_REG_ICR_LOW) & LAPIC_ICR_PENDING)
+        __asm__ volatile("pause");
+
+    irq_restore(flags);
+}
+
+uint8_t apic_local_id(void)
+{
+    return apic_read(LAPIC_REG_ID) >> 24;
+}
+
+void apic_eoi(void)
+{
+    apic_write(LAPIC_REG_EOI, 0);
+}
+
+bool apic_enabled(void)
+{
+    return apic_active;
+}
+
+static uint32_t ioapic_read(const acpi_ioapic_t* io, uint8_t reg)
+{
+    volatile uint32_t* base = (volatile uint32_t*)io->address;
+    base[IOAPIC_REG_SELECT / 4] = reg;
+    return base[IOAPIC_REG_WINDOW / 4];
+}
+
+static void ioapic_write(const acpi_ioapic_t* io, uint8_t reg, uint32_t value)
+{
+    volatile uint32_t* base = (volatile uint32_t*)io->address;
+    base[IOAPIC_REG_SELECT / 4] = reg;
+    base[IOAPIC_REG_WINDOW / 4] = value;
+}
+
+static uint32_t ioapic_max_redir(const acpi_ioapic_t* io)
+{
+    return ((ioapic_read(io, IOAPIC_REG_VERSION) >> 16) & 0xFF) + 1;
+}
+
+// Find the I/O APIC handling a GSI, returns the pin through *pin
+static const acpi_ioapic_t* ioapic_for_gsi(uint32_t gsi, uint32_t* pin)
+{
+    const acpi_madt_info_t* info = acpi_madt();
+    for (uint32_t i = 0; i < info->ioapic_count; i++)
+    {
+        const acpi_ioapic_t* io = &info->ioapics[i];
+        if (gsi >= io->gsi_base && gsi < io->gsi_base + ioapic_max_redir(io))
+        {
+            *pin = gsi - io->gsi_base;
+            return io;
+        }
+    }
+    return 0;
+}
+
+bool apic_route_irq(uint8_t irq, uint8_t vector, uint8_t dest_apic_id)
+{
+    const acpi_madt_info_t* info = acpi_madt();
+    if (irq >= ACPI_ISA_IRQS)
+        return false;
+
+    uint32_t pin;
+    const acpi_ioapic_t* io = ioapic_for_gsi(info->isa_gsi[irq], &pin);
+    if (!io)
+        return false;
+
+    // ISA defaults are edge triggered, active high; overrides may say otherwise
+    uint32_t low = vector | IOAPIC_REDIR_MASKED;
+    if ((info->isa_flags[irq] & ACPI_MADT_POLARITY_MASK) == ACPI_MADT_POLARITY_LOW)
+        low |= IOAPIC_REDIR_POLARITY_LOW;
+    if ((info->isa_flags[irq] & ACPI_MADT_TRIGGER_MASK) == ACPI_MADT_TRIGGER_LEVEL)
+        low |= IOAPIC_REDIR_LEVEL;
+
+    ioapic_write(io, IOAPIC_REG_REDIR(pin) + 1, (uint32_t)dest_apic_id << 24);
+    ioapic_write(io, IOAPIC_REG_REDIR(pin), low);
+    return true;
+}
+
+void apic_mask_irq(uint8_t irq, bool masked)
+{
+    const acpi_madt_info_t* info = acpi_madt();
+    if (irq >= ACPI_ISA_IRQS)
+        return;
+
+    uint32_t pin;
+    const acpi_ioapic_t* io = ioapic_for_gsi(info->isa_gsi[irq], &pin);
+    if (!io)
+        return;
+
+    uint32_t low = ioapic_read(io, IOAPIC_REG_REDIR(pin));
+    if (masked)
+        low |= IOAPIC_REDIR_MASKED;
+    else
+        low &= ~IOAPIC_REDIR_MASKED;
+    ioapic_write(io, IOAPIC_REG_REDIR(pin), low);
+}
+
+bool apic_init(void)
+{
+    const acpi_madt_info_t* info = acpi_madt();
+    if (!info->present || !cpu_has_feature_edx(CPUID_FEAT_EDX_APIC | CPUID_FEAT_EDX_MSR))
+        return false;
+
+    uint32_t eflags = irq_save();
+
+    apic_lapic = (volatile uint32_t*)info->lapic_address;
+    mem_virt_mark_mmio(info->lapic_address);
+    for (uint32_t i = 0; i < info->ioapic_count; i++)
+        mem_virt_mark_mmio(info->ioapics[i].address);
+
+    // Global enable, then software enable with our spurious vector
+    wrmsr(MSR_APIC_BASE, rdmsr(MSR_APIC_BASE) | 0x800);
+    apic_write(LAPIC_REG_TPR, 0);
+    apic_write(LAPIC_REG_LVT_ERROR, LAPIC_LVT_MASKED);
+    apic_write(LAPIC_REG_SVR, LAPIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+
+    // Start with every I/O APIC input masked
+    for (uint32_t i = 0; i < info->ioapic_count; i++)
+    {
+        const acpi_ioapic_t* io = &info->ioapics[i];
+        uint32_t count = ioapic_max_redir(io);
+        for (uint32_t pin = 0; pin < count; pin++)
+            ioapic_write(io, IOAPIC_REG_REDIR(pin), IOAPIC_REDIR_MASKED);
+    }
+
+    // Take over whatever the PIC was delivering, then silence the PIC
+    uint16_t pic_mask = inb(0x21) | ((uint16_t)inb(0xA1) << 8);
+    outb(0x21, 0xFF);
+    outb(0xA1, 0xFF);
+
+    uint8_t bsp = apic_local_id();
+    for (uint8_t irq = 0; irq < ACPI_ISA_IRQS; irq++)
+    {
+        if (irq == 2)
+            continue; // Cascade line, meaningless without the PIC
+
+        apic_route_irq(irq, IRQ_BASE_VECTOR + irq, bsp);
+        if (!(pic_mask & (1 << irq)))
+            apic_mask_irq(irq, false);
+    }
+
+    apic_active = true;
+
+    irq_restore(eflags);
+    return true;
+}
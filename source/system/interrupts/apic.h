@@ -0,0 +1,59 @@
+#ifndef K_APIC_H
+#define K_APIC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Local APIC registers (byte offsets from the MMIO base)
+#define LAPIC_REG_ID            0x020
+#define LAPIC_REG_TPR           0x080
+#define LAPIC_REG_EOI           0x0B0
+#define LAPIC_REG_SVR           0x0F0
+#define LAPIC_REG_ICR_LOW       0x300
+#define LAPIC_REG_ICR_HIGH      0x310
+#define LAPIC_REG_LVT_TIMER     0x320
+#define LAPIC_REG_LVT_LINT0     0x350
+#define LAPIC_REG_LVT_LINT1     0x360
+#define LAPIC_REG_LVT_ERROR     0x370
+#define LAPIC_REG_TIMER_INIT    0x380
+#define LAPIC_REG_TIMER_CUR     0x390
+#define LAPIC_REG_TIMER_DIV     0x3E0
+
+#define LAPIC_SVR_ENABLE        0x100
+#define LAPIC_LVT_MASKED        0x10000
+
+// Interrupt command register (low dword)
+#define LAPIC_ICR_FIXED         0x00000
+#define LAPIC_ICR_INIT          0x00500
+#define LAPIC_ICR_STARTUP       0x00600
+#define LAPIC_ICR_PENDING       0x01000     // Delivery status
+#define LAPIC_ICR_ASSERT        0x04000
+
+// I/O APIC registers
+#define IOAPIC_REG_SELECT       0x00
+#define IOAPIC_REG_WINDOW       0x10
+#define IOAPIC_REG_VERSION      0x01
+#define IOAPIC_REG_REDIR(n)     (0x10 + (n) * 2)
+
+#define IOAPIC_REDIR_POLARITY_LOW   (1 << 13)
+#define IOAPIC_REDIR_LEVEL          (1 << 15)
+#define IOAPIC_REDIR_MASKED         (1 << 16)
+
+#define APIC_SPURIOUS_VECTOR    0xFF
+#define IRQ_BASE_VECTOR         32
+
+bool apic_init(void);
+void apic_init_ap(void);
+bool apic_enabled(void);
+
+uint32_t apic_read(uint32_t reg);
+void apic_write(uint32_t reg, uint32_t value);
+uint8_t apic_local_id(void);
+void apic_eoi(void);
+void apic_send_ipi(uint8_t dest_apic_id, uint32_t command);
+
+// Send ISA IRQ to any vector on the given CPU (starts masked)
+bool apic_route_irq(uint8_t irq, uint8_t vector, uint8_t dest_apic_id);
+void apic_mask_irq(uint8_t irq, bool masked);
+
+#endif
@@ -1,7 +1,19 @@
 #include "interrupts.h"
 #include "syscalls.h"
+#include "apic.h"
+#include "softirq.h"
 #include "../../boot/idt/idt.h"
+#include "../../arch/x86/ports.h"
+#include "../../arch/x86/cpu.h"
 #include "../shell/shell.h"
+#include "../memory/uaccess.h"
+#include "../memory/virtual.h"
+#include "../usermode/scheduler.h"
+#include "../smp/smp.h"
+#include "../sync/rcu.h"
+#include "../ipc/ipc.h"
+#include "../lib/math64.h"
+#include "../log/klog.h"
 
 extern shell_instance_t* g_kernel_shell;
 
@@ -26,126 +38,313 @@ static const char* exception_messages[] = {
     "Coprocessor Fault"
 };
 
-// Port I/O functions
-static inline void outb(uint16_t port, uint8_t value)
-{
-    __asm__ volatile ("outb %0, %1" : : "a"(value), "Nd"(port));
-}
-
-static inline uint8_t inb(uint16_t port)
-{
-    uint8_t ret;
-    __asm__ volatile ("inb %1, %0" : "=a"(ret) : "Nd"(port));
-    return ret;
-}
-
-// Simple scancode to ASCII conversion for debugging
-static char scancode_to_ascii(uint8_t scancode)
-{
-    static char keymap[128] = {
-        0,  27, '1', '2', '3', '4', '5', '6', '7', '8',    // 0-9
-        '9', '0', '-', '=', '\b',                          // 10-14
-        '\t', 'q', 'w', 'e', 'r', 't', 'y', 'u', 'i', 'o', 'p', '[', ']', '\n', // 15-28
-        0,    // 29 - Control
-        'a', 's', 'd', 'f', 'g', 'h', 'j', 'k', 'l', ';', '\'', '`', 0, // 30-42
-        '\\', 'z', 'x', 'c', 'v', 'b', 'n', 'm', ',', '.', '/',   0, // 43-53
-        '*',
-        0,  // Alt
-        ' ', // Space bar
-        0,  // Caps lock
-        0,  // 59 - F1 key ... >
-        0,   0,   0,   0,   0,   0,   0,   0,
-        0,  // < ... F10
-        0,  // 69 - Num lock
-        0,  // Scroll Lock
-        0,  // Home key
-        0,  // Up Arrow
-        0,  // Page Up
-        '-',
-        0,  // Left Arrow
-        0,
-        0,  // Right Arrow
-        '+',
-        0,  // 79 - End key
-        0,  // Down Arrow
-        0,  // Page Down
-        0,  // Insert Key
-        0,  // Delete Key
-        0,   0,   0,
-        0,  // F11 Key
-        0,  // F12 Key
-        0,  // All other keys are undefined
-    };
-    
-    if (scancode >= 128) return 0; // Key release
-    return keymap[scancode];
+static int_action_t* int_actions[INT_VECTOR_COUNT];
+static uint8_t int_flags[INT_VECTOR_COUNT];
+static int_stats_t int_vector_stats[INT_VECTOR_COUNT];
+static bool int_have_tsc = false;
+
+// Unclaimed vectors are reported from a tasklet, not with interrupts off
+static volatile uint32_t int_unhandled_mask[INT_VECTOR_COUNT / 32];
+static tasklet_t int_report_tasklet;
+
+static int_action_t int_page_fault_action;
+static int_action_t int_uaccess_gp_action;
+static int_action_t int_uaccess_pf_action;
+static int_action_t int_syscall_action;
+
+static inline uint64_t int_cycles(void)
+{
+    return int_have_tsc ? rdtsc() : 0;
 }
 
-void interrupt_handler(interrupt_frame_t* frame)
+static void int_account(uint8_t vector, uint64_t cycles)
+{
+    int_stats_t* stats = &int_vector_stats[vector];
+    stats->count++;
+    stats->total_cycles += cycles;
+    if (cycles > stats->max_cycles)
+        stats->max_cycles = cycles;
+
+    uint32_t bucket = INT_LATENCY_BUCKETS - 1;
+    if (cycles >> 32 == 0)
+        bucket = 31 - __builtin_clz((uint32_t)cycles | 1);
+    stats->buckets[bucket]++;
+}
+
+static bool int_page_fault(interrupt_frame_t* frame, void* ctx)
+{
+    (void)ctx;
+    // Not-present user window pages are allocated on first touch
+    return mem_virt_handle_fault(frame);
+}
+
+static bool int_uaccess_fault(interrupt_frame_t* frame, void* ctx)
+{
+    (void)ctx;
+    // Faults raised inside copy_from_user / copy_to_user are recoverable
+    return uaccess_fixup(frame);
+}
+
+static bool int_syscall(interrupt_frame_t* frame, void* ctx)
+{
+    (void)ctx;
+    handle_syscall(frame);
+    return true;
+}
+
+static void int_report_unhandled(void* ctx)
 {
-    if (g_kernel_shell) 
+    (void)ctx;
+
+    for (int vector = 0; vector < INT_VECTOR_COUNT; vector++)
     {
-        if (frame->int_no < 17) 
+        uint32_t bit = 1u << (vector % 32);
+        if (!(int_unhandled_mask[vector / 32] & bit))
+            continue;
+
+        uint32_t flags = irq_save();
+        int_unhandled_mask[vector / 32] &= ~bit;
+        irq_restore(flags);
+
+        if (vector >= IRQ_BASE_VECTOR && vector < IRQ_BASE_VECTOR + 16) 
         {
-            sh_printf(g_kernel_shell, "EXCEPTION: %s (0x%x)\r\n", 
-                     exception_messages[frame->int_no], frame->int_no);
-            sh_printf(g_kernel_shell, "Error Code: 0x%x\r\n", frame->err_code);
-            sh_printf(g_kernel_shell, "EIP: 0x%x, CS: 0x%x\r\n", frame->eip, frame->cs);
-            
-            // Check if this came from user mode
-            if ((frame->cs & 0x3) == 3) 
-            {
-                sh_puts(g_kernel_shell, "Exception occurred in user mode!\r\n");
-            }
+            klog(KLOG_WARNING, "Hardware interrupt: IRQ%d (INT 0x%x)", 
+                 vector - IRQ_BASE_VECTOR, vector);
         }
-        else if (frame->int_no == 0x80) 
+        else 
         {
-            // System call handler
-            handle_syscall(frame);
+            klog(KLOG_WARNING, "Unknown interrupt: 0x%x", vector);
         }
-        else 
+    }
+}
+
+// Nobody claimed the vector: report it, and stop on real exceptions
+static void int_unhandled(interrupt_frame_t* frame)
+{
+    if (frame->int_no >= INT_EXCEPTION_COUNT)
+    {
+        int_unhandled_mask[frame->int_no / 32] |= 1u << (frame->int_no % 32);
+        tasklet_schedule(&int_report_tasklet);
+
+        // An unclaimed legacy IRQ still has to be acknowledged
+        if (frame->int_no >= IRQ_BASE_VECTOR && frame->int_no < IRQ_BASE_VECTOR + 16)
+            irq_eoi(frame->int_no);
+        return;
+    }
+
+    // Exceptions are printed right away, the machine stops here anyway
+    if (frame->int_no < 17) 
+    {
+        klog(KLOG_EMERG, "EXCEPTION: %s (0x%x)", 
+             exception_messages[frame->int_no], frame->int_no);
+        klog(KLOG_EMERG, "Error Code: 0x%x", frame->err_code);
+        klog(KLOG_EMERG, "EIP: 0x%x, CS: 0x%x", frame->eip, frame->cs);
+        
+        // Check if this came from user mode
+        if ((frame->cs & 0x3) == 3) 
         {
-            sh_printf(g_kernel_shell, "Unknown interrupt: 0x%x\r\n", frame->int_no);
+            klog(KLOG_EMERG, "Exception occurred in user mode!");
         }
     }
+    else 
+    {
+        klog(KLOG_EMERG, "Unknown exception: 0x%x", frame->int_no);
+    }
+    klog_flush();
     
-    // For now, halt on exceptions (except system calls and breakpoints)
-    if (frame->int_no < 32 && frame->int_no != 3) {
+    // For now, halt on exceptions (except breakpoints)
+    if (frame->int_no < INT_EXCEPTION_COUNT && frame->int_no != 3) {
         while (1) __asm__ volatile("hlt");
     }
 }
 
-void irq_handler(interrupt_frame_t* frame)
+void int_init(void)
+{
+    int_have_tsc = cpu_has_feature_edx(CPUID_FEAT_EDX_TSC);
+
+    softirq_init();
+    tasklet_init(&int_report_tasklet, int_report_unhandled, 0);
+
+    int_setup_action(&int_page_fault_action, int_page_fault, 0, "demand paging");
+    int_setup_action(&int_uaccess_gp_action, int_uaccess_fault, 0, "uaccess");
+    int_setup_action(&int_uaccess_pf_action, int_uaccess_fault, 0, "uaccess");
+    int_setup_action(&int_syscall_action, int_syscall, 0, "syscall");
+
+    int_register(14, &int_page_fault_action, 0);
+    int_register(14, &int_uaccess_pf_action, 0);
+    int_register(13, &int_uaccess_gp_action, 0);
+    int_register(INT_SYSCALL_VECTOR, &int_syscall_action, 0);
+}
+
+void int_setup_action(int_action_t* action, int_handler_t handler, void* ctx, const char* name)
+{
+    action->next = 0;
+    action->handler = handler;
+    action->ctx = ctx;
+    action->name = name;
+}
+
+bool int_register(uint8_t vector, int_action_t* action, uint32_t flags)
+{
+    if (!action || !action->handler)
+        return false;
+
+    uint32_t irq_flags = irq_save();
+
+    // Appended, so earlier registrations get the first look
+    int_action_t** link = &int_actions[vector];
+    while (*link)
+    {
+        if (*link == action)
+        {
+            irq_restore(irq_flags);
+            return false;
+        }
+        link = &(*link)->next;
+    }
+
+    action->next = 0;
+    *link = action;
+    int_flags[vector] |= flags;
+
+    irq_restore(irq_flags);
+    return true;
+}
+
+void int_unregister(uint8_t vector, int_action_t* action)
 {
-    if (g_kernel_shell) 
+    uint32_t irq_flags = irq_save();
+
+    for (int_action_t** link = &int_actions[vector]; *link; link = &(*link)->next)
     {
-        switch (frame->int_no) 
+        if (*link == action)
         {
-            case 32: // Timer IRQ0
-                break;
-                
-            case 33: // Keyboard IRQ1
-                {
-                    uint8_t scancode = inb(0x60);
-                    char ascii = scancode_to_ascii(scancode);
-                    
-                    if (scancode < 128 && ascii) // Key press with valid ASCII
-                    { 
-                        // Write to stdin stream
-                        sh_write_stream(g_kernel_shell, STREAM_STDIN, &ascii, 1);
-                    }
-                }
-                break;
-                
-            default:
-                sh_printf(g_kernel_shell, "Hardware interrupt: IRQ%d (INT 0x%x)\r\n", 
-                         frame->int_no - 32, frame->int_no);
+            *link = action->next;
+            action->next = 0;
+            break;
+        }
+    }
+
+    if (!int_actions[vector])
+        int_flags[vector] = 0;
+
+    irq_restore(irq_flags);
+}
+
+// ISA IRQ line, wherever the PIC or the I/O APIC delivers it
+bool irq_register(uint8_t irq, int_action_t* action)
+{
+    if (irq >= 16)
+        return false;
+    return int_register(IRQ_BASE_VECTOR + irq, action, INT_FLAG_EOI);
+}
+
+const int_stats_t* int_stats(uint8_t vector)
+{
+    return &int_vector_stats[vector];
+}
+
+void int_stats_reset(void)
+{
+    uint32_t flags = irq_save();
+    for (int i = 0; i < (int)sizeof(int_vector_stats); i++)
+        ((uint8_t*)int_vector_stats)[i] = 0;
+    irq_restore(flags);
+}
+
+void int_stats_dump(void)
+{
+    if (!g_kernel_shell)
+        return;
+
+    sh_puts(g_kernel_shell, "VEC  COUNT      AVG CYC    MAX CYC    NAME\r\n");
+    for (int vector = 0; vector < INT_VECTOR_COUNT; vector++)
+    {
+        const int_stats_t* stats = &int_vector_stats[vector];
+        if (!stats->count)
+            continue;
+
+        // The divisor is saturated to 32 bits, the columns are not
+        uint32_t count = stats->count > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)stats->count;
+        uint64_t avg = udiv64_32(stats->total_cycles, count, 0);
+
+        sh_printf(g_kernel_shell, "0x%02x %-10llu %-10llu %-10llu %s\r\n", vector, stats->count,
+                  avg, stats->max_cycles, int_actions[vector] ? int_actions[vector]->name : "-");
+    }
+}
+
+// Runs the handlers registered for the vector
+static void int_dispatch(interrupt_frame_t* frame, uint8_t vector, bool shared)
+{
+    bool handled = false;
+    uint64_t start = int_cycles();
+
+    for (int_action_t* action = int_actions[vector]; action; action = action->next)
+    {
+        if (action->handler(frame, action->ctx))
+        {
+            handled = true;
+            if (!shared)
                 break;
         }
     }
-    
-    // Send EOI (End of Interrupt) to PIC
-    if (frame->int_no >= 40) 
+
+    if (!handled && !shared)
+        int_unhandled(frame);
+
+    int_account(vector, int_cycles() - start);
+
+    if (shared)
+        irq_eoi(vector);
+}
+
+void interrupt_handler(interrupt_frame_t* frame)
+{
+    uint8_t vector = (uint8_t)frame->int_no;
+    bool shared = int_flags[vector] & INT_FLAG_EOI;
+    bool hard = vector != INT_SYSCALL_VECTOR && vector != INT_IPC_VECTOR;
+
+    // Hard interrupt nesting per CPU, system calls excluded
+    if (hard)
+        this_cpu()->int_depth++;
+
+    // IPC skips the action chain and accounting, it keeps its own numbers
+    if (vector == INT_IPC_VECTOR)
+        ipc_handle(frame);
+    else
+        int_dispatch(frame, vector, shared);
+
+    // A system call may have slept and resumed on another CPU, look it up again
+    cpu_t* cpu = this_cpu();
+    if (hard)
+        cpu->int_depth--;
+
+    // Bottom halves run once the outermost hard interrupt is done
+    if (cpu->int_depth)
+        return;
+
+    // Nothing holds RCU references on the way back to user mode
+    bool user = (frame->cs & 0x3) == 3;
+    if (user)
+        rcu_qs();
+
+    softirq_run();
+
+    // Preemption, only on the way back to user mode
+    if (user)
+        sched_preempt();
+}
+
+// Send EOI (End of Interrupt) to whichever controller is in charge
+void irq_eoi(uint32_t vector)
+{
+    if (apic_enabled()) 
+    {
+        apic_eoi(); // Single MMIO write
+        return;
+    }
+
+    if (vector >= 40) 
     {
         outb(0xA0, 0x20); // Send EOI to slave PIC
     }
@@ -177,31 +376,16 @@ void pic_init(void)
     outb(0xA1, 0xFF); // Disable all IRQ8-15
 }
 
-// Function to test if keyboard is working
-void keyboard_test(void)
-{
-    if (g_kernel_shell) {
-        sh_puts(g_kernel_shell, "Testing keyboard controller...\r\n");
-        
-        // Check keyboard controller status
-        uint8_t status = inb(0x64);
-        sh_printf(g_kernel_shell, "Keyboard controller status: 0x%x\r\n", status);
-        
-        // Check if output buffer is full
-        if (status & 0x01) {
-            uint8_t data = inb(0x60);
-            sh_printf(g_kernel_shell, "Data in keyboard buffer: 0x%x\r\n", data);
-        }
-        
-        sh_puts(g_kernel_shell, "Press any key to test interrupts...\r\n");
-    }
-}
-
 // Function to enable specific IRQs
 void irq_enable(uint8_t irq)
 {
     uint16_t port;
     uint8_t value;
+
+    if (apic_enabled()) {
+        apic_mask_irq(irq, false);
+        return;
+    }
     
     if (irq < 8) {
         port = 0x21;
@@ -219,6 +403,11 @@ void irq_disable(uint8_t irq)
 {
     uint16_t port;
     uint8_t value;
+
+    if (apic_enabled()) {
+        apic_mask_irq(irq, true);
+        return;
+    }
     
     if (irq < 8) {
         port = 0x21;
@@ -2,6 +2,7 @@
 #define K_INTERRUPTS_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 typedef struct
 {
@@ -11,6 +12,53 @@ typedef struct
     uint32_t eip, cs, eflags, useresp, ss;      // Pushed by CPU
 } interrupt_frame_t;
 
+#define INT_VECTOR_COUNT        256
+#define INT_EXCEPTION_COUNT     32
+#define INT_SYSCALL_VECTOR      0x80
+#define INT_LATENCY_BUCKETS     32      // log2 of the handler run time in cycles
+
+// Vector flags
+#define INT_FLAG_EOI            0x01    // Device interrupt: every handler runs, then EOI
+
+// Returns true if the interrupt was handled. Exceptions stop at the first
+// handler that claims them, shared IRQ lines run the whole chain.
+typedef bool (*int_handler_t)(interrupt_frame_t* frame, void* ctx);
+
+typedef struct int_action
+{
+    struct int_action* next;
+    int_handler_t handler;
+    void* ctx;
+    const char* name;
+}
+int_action_t;
+
+typedef struct
+{
+    uint64_t count;
+    uint64_t total_cycles;
+    uint64_t max_cycles;
+    uint32_t buckets[INT_LATENCY_BUCKETS];  // buckets[i]: runs of 2^i to 2^(i+1)-1 cycles
+}
+int_stats_t;
+
+void int_init(void);
+
+// Actions are owned by the caller and chained in registration order
+void int_setup_action(int_action_t* action, int_handler_t handler, void* ctx, const char* name);
+bool int_register(uint8_t vector, int_action_t* action, uint32_t flags);
+void int_unregister(uint8_t vector, int_action_t* action);
+bool irq_register(uint8_t irq, int_action_t* action);
+
+const int_stats_t* int_stats(uint8_t vector);
+void int_stats_reset(void);
+void int_stats_dump(void);
+
+void interrupt_handler(interrupt_frame_t* frame);
+
 void pic_init(void);
+void irq_enable(uint8_t irq);
+void irq_disable(uint8_t irq);
+void irq_eoi(uint32_t vector);
 
 #endif
\ No newline at end of file
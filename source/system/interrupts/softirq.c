@@ -0,0 +1,141 @@
+#include "softirq.h"
+#include "../smp/smp.h"
+#include "../../arch/x86/cpu.h"
+
+// Pending work and tasklets are per CPU, raised work runs where it was raised
+typedef struct
+{
+    volatile uint32_t pending;
+    bool active;
+    tasklet_t* tasklet_head;        // Scheduled tasklets, FIFO
+    tasklet_t** tasklet_tail;
+}
+softirq_cpu_t;
+
+static softirq_handler_t softirq_handlers[SOFTIRQ_COUNT];
+static softirq_cpu_t softirq_cpus[SMP_MAX_CPUS];
+
+static softirq_cpu_t* softirq_local(void)
+{
+    softirq_cpu_t* cpu = &softirq_cpus[smp_cpu_id()];
+    if (!cpu->tasklet_tail)
+        cpu->tasklet_tail = &cpu->tasklet_head;
+    return cpu;
+}
+
+static void tasklet_queue(softirq_cpu_t* cpu, tasklet_t* tasklet)
+{
+    tasklet->next = 0;
+    *cpu->tasklet_tail = tasklet;
+    cpu->tasklet_tail = &tasklet->next;
+    cpu->pending |= 1u << SOFTIRQ_TASKLET;
+}
+
+static void tasklet_action(void)
+{
+    // Take the whole list, tasklets scheduled while it runs go on the next pass
+    uint32_t flags = irq_save();
+    softirq_cpu_t* cpu = softirq_local();
+    tasklet_t* list = cpu->tasklet_head;
+    cpu->tasklet_head = 0;
+    cpu->tasklet_tail = &cpu->tasklet_head;
+    irq_restore(flags);
+
+    while (list)
+    {
+        tasklet_t* tasklet = list;
+        list = list->next;
+
+        // Never runs on two CPUs at once, retry on the next pass instead
+        if (__sync_fetch_and_or(&tasklet->state, TASKLET_RUNNING) & TASKLET_RUNNING)
+        {
+            flags = irq_save();
+            tasklet_queue(cpu, tasklet);
+            irq_restore(flags);
+            continue;
+        }
+
+        // Cleared first so the tasklet may reschedule itself
+        tasklet->next = 0;
+        __sync_fetch_and_and(&tasklet->state, ~TASKLET_SCHEDULED);
+        tasklet->func(tasklet->ctx);
+        __sync_fetch_and_and(&tasklet->state, ~TASKLET_RUNNING);
+    }
+}
+
+void softirq_init(void)
+{
+    softirq_register(SOFTIRQ_TASKLET, tasklet_action);
+}
+
+void softirq_register(uint32_t nr, softirq_handler_t handler)
+{
+    if (nr < SOFTIRQ_COUNT)
+        softirq_handlers[nr] = handler;
+}
+
+void softirq_raise(uint32_t nr)
+{
+    if (nr >= SOFTIRQ_COUNT)
+        return;
+
+    uint32_t flags = irq_save();
+    softirq_local()->pending |= 1u << nr;
+    irq_restore(flags);
+}
+
+bool softirq_pending(void)
+{
+    return softirq_cpus[smp_cpu_id()].pending != 0;
+}
+
+void softirq_run(void)
+{
+    uint32_t flags = irq_save();
+    softirq_cpu_t* cpu = softirq_local();
+
+    // Never nested: an interrupt arriving during a bottom half only raises more work
+    if (cpu->active || !cpu->pending)
+    {
+        irq_restore(flags);
+        return;
+    }
+
+    cpu->active = true;
+    for (int restart = 0; restart < SOFTIRQ_MAX_RESTART && cpu->pending; restart++)
+    {
+        uint32_t pending = cpu->pending;
+        cpu->pending = 0;
+
+        __asm__ volatile("sti");
+        while (pending)
+        {
+            uint32_t nr = (uint32_t)__builtin_ctz(pending);
+            pending &= pending - 1;
+            if (softirq_handlers[nr])
+                softirq_handlers[nr]();
+        }
+        __asm__ volatile("cli");
+    }
+    cpu->active = false;
+
+    irq_restore(flags);
+}
+
+void tasklet_init(tasklet_t* tasklet, tasklet_func_t func, void* ctx)
+{
+    tasklet->next = 0;
+    tasklet->func = func;
+    tasklet->ctx = ctx;
+    tasklet->state = 0;
+}
+
+void tasklet_schedule(tasklet_t* tasklet)
+{
+    uint32_t flags = irq_save();
+
+    if (!(__sync_fetch_and_or(&tasklet->state, TASKLET_SCHEDULED) & TASKLET_SCHEDULED))
+        tasklet_queue(softirq_local(), tasklet);
+
+    irq_restore(flags);
+}
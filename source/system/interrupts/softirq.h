@@ -0,0 +1,40 @@
+#ifndef K_SOFTIRQ_H
+#define K_SOFTIRQ_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Bottom halves: hard IRQ handlers acknowledge the device and raise a
+// softirq, the work runs with interrupts enabled once the outermost
+// interrupt returns (or from the idle loop).
+#define SOFTIRQ_TASKLET         0
+#define SOFTIRQ_RCU             1       // Callbacks whose grace period ended
+#define SOFTIRQ_COUNT           8
+#define SOFTIRQ_MAX_RESTART     10      // Left over work waits for the idle loop
+
+typedef void (*softirq_handler_t)(void);
+
+typedef void (*tasklet_func_t)(void* ctx);
+
+#define TASKLET_SCHEDULED       0x01
+#define TASKLET_RUNNING         0x02
+
+typedef struct tasklet
+{
+    struct tasklet* next;
+    tasklet_func_t func;
+    void* ctx;
+    volatile uint32_t state;
+}
+tasklet_t;
+
+void softirq_init(void);
+void softirq_register(uint32_t nr, softirq_handler_t handler);
+void softirq_raise(uint32_t nr);
+bool softirq_pending(void);
+void softirq_run(void);
+
+void tasklet_init(tasklet_t* tasklet, tasklet_func_t func, void* ctx);
+void tasklet_schedule(tasklet_t* tasklet);
+
+#endif
@@ -1,29 +1,25 @@
 #include "syscalls.h"
 
 #include "../shell/shell.h"
+#include "../memory/uaccess.h"
+#include "../usermode/processes.h"
+#include "../usermode/scheduler.h"
+#include "../usermode/usermode.h"
+#include "../ipc/shm.h"
+#include "../sync/rcu.h"
+#include "../sync/futex.h"
+#include "../time/timer.h"
+#include "../time/clock.h"
+#include "../lib/math64.h"
+#include "../log/klog.h"
 
 #include <stdint.h>
 #include <stddef.h>
 
 extern shell_instance_t* g_kernel_shell;
 
-void exit_to_kernel(void) {
-    extern shell_instance_t* g_kernel_shell;
-    if (g_kernel_shell) 
-    {
-        sh_puts(g_kernel_shell, "Idling...\r\n");
-    }
-
-    // Kernel idle loop
-    while (1) 
-    {
-        __asm__ volatile("hlt");
-    }
-}
-
 void handle_syscall(interrupt_frame_t* frame)
 {
-    extern uint8_t* kernel_stack_top;
     uint32_t syscall_num = frame->eax;
     uint32_t arg0 = frame->ebx; // stream id
     uint32_t arg1 = frame->ecx; // buffer
@@ -31,7 +27,7 @@ void handle_syscall(interrupt_frame_t* frame)
     
     // Check if call came from user mode
     if ((frame->cs & 0x3) != 3) {
-        sh_puts(g_kernel_shell, "System call from kernel mode - ignoring\r\n");
+        klog(KLOG_WARNING, "System call from kernel mode - ignoring");
         return;
     }
 
@@ -40,23 +36,39 @@ void handle_syscall(interrupt_frame_t* frame)
         case SYS_WRITE:
             {
                 const char* str = (const char*)arg1;
-                if (g_kernel_shell && str) 
+                if (g_kernel_shell && str && uaccess_range_ok(str, arg2)) 
                 {
-                    // More permissive range check for user memory
-                    if (arg1 >= 0x400000 && arg1 < 0x900000) 
+                    // Bounce through a kernel buffer, one block copy per chunk
+                    char chunk[SYSCALL_CHUNK_SIZE];
+                    uint32_t done = 0;
+                    while (done < arg2) 
                     {
-                        sh_write_stream(g_kernel_shell, arg0, str, arg2);
+                        uint32_t n = arg2 - done;
+                        if (n > sizeof(chunk)) n = sizeof(chunk);
+
+                        if (copy_from_user(chunk, str + done, n) != 0) 
+                            break;
 
+                        sh_write_stream(g_kernel_shell, arg0, chunk, n);
+                        done += n;
+                    }
+
+                    if (done == arg2) 
+                    {
                         frame->eax = arg2; // Return number of bytes written
                     }
                     else 
                     {
-                        sh_printf(g_kernel_shell, "Invalid string pointer: 0x%x\r\n", arg1);
-                        frame->eax = -1; // Error
+                        klog(KLOG_WARNING, "Invalid string pointer: 0x%x", arg1 + done);
+                        frame->eax = done ? done : (uint32_t)-1;
                     }
                 } 
                 else 
                 {
+                    if (str) 
+                    {
+                        klog(KLOG_WARNING, "Invalid string pointer: 0x%x", arg1);
+                    }
                     frame->eax = -1; // Error
                 }
             }
@@ -64,29 +76,34 @@ void handle_syscall(interrupt_frame_t* frame)
             
         case SYS_EXIT:
             {
-                if (g_kernel_shell) 
-                {
-                    sh_printf(g_kernel_shell, "Exited with code %d\r\n", arg0);
-                }
-                
-                frame->eax = 0;
-                
-                frame->cs = 0x08;  // Kernel code segment
-                frame->ss = 0x10;  // Kernel data segment
-                frame->eip = (uint32_t)exit_to_kernel;  // Jump to kernel exit handler
-                frame->useresp = (uint32_t)kernel_stack_top;  // Use kernel stack
-                    
-                // Clear user mode segments
-                frame->ds = 0x10;
-                frame->es = 0x10;
-                frame->fs = 0x10;
-                frame->gs = 0x10;
+                klog(KLOG_INFO, "Exited with code %d", arg0);
+
+                // Does not return, the next process (or idle) takes over
+                proc_exit((int32_t)arg0);
             }
             break;
             
         case SYS_GETPID:
+        case SYS_GETTID:
             {
-                frame->eax = 1; // Process ID 1
+                // Threads share the pid of their group leader
+                process_t* proc = proc_current();
+                if (proc && syscall_num == SYS_GETPID)
+                    proc = proc->group;
+                frame->eax = proc ? proc->id : 0;
+            }
+            break;
+            
+        case SYS_NICE:
+            {
+                // Positive increments lower the priority, like nice(2)
+                process_t* proc = proc_current();
+                int prio = (int)proc->static_prio + (int32_t)arg0;
+                if (prio < 0) prio = 0;
+                if (prio > SCHED_PRIO_LEVELS - 1) prio = SCHED_PRIO_LEVELS - 1;
+
+                sched_set_priority(proc, (uint8_t)prio);
+                frame->eax = prio - SCHED_PRIO_DEFAULT;
             }
             break;
             
@@ -95,31 +112,199 @@ void handle_syscall(interrupt_frame_t* frame)
                 char* buf = (char*)arg1;
                 size_t count = arg2;
                 
-                if (g_kernel_shell && buf) 
+                if (g_kernel_shell && buf && uaccess_range_ok(buf, count)) 
                 {
-                    // Check buffer is in user memory
-                    if (arg1 >= 0x400000 && arg1 < 0x900000) 
+                    // Sleeps until the keyboard delivers something, then
+                    // reads from stdin into a kernel buffer first
+                    char chunk[SYSCALL_CHUNK_SIZE];
+                    if (count > sizeof(chunk)) count = sizeof(chunk);
+
+                    int n = count ? sh_read_stream_wait(g_kernel_shell, STREAM_STDIN, chunk, count, WAIT_FOREVER) : 0;
+                    if (n > 0 && copy_to_user(buf, chunk, n) != 0) 
                     {
-                        // Read from stdin stream
-                        frame->eax = stream_read(&g_kernel_shell->streams[STREAM_STDIN], buf, count);
+                        klog(KLOG_WARNING, "Invalid buffer pointer: 0x%x", arg1);
+                        frame->eax = -1;
                     }
                     else 
                     {
-                        sh_printf(g_kernel_shell, "Invalid buffer pointer: 0x%x\r\n", arg1);
-                        frame->eax = -1;
+                        frame->eax = n;
                     }
                 } 
                 else 
                 {
+                    if (buf) 
+                    {
+                        klog(KLOG_WARNING, "Invalid buffer pointer: 0x%x", arg1);
+                    }
                     frame->eax = -1;
                 }
             }
             break;
             
-        default:
-            if (g_kernel_shell) {
-                sh_printf(g_kernel_shell, "Unknown system call: %d\r\n", syscall_num);
+        case SYS_NANOSLEEP:
+            {
+                sys_timespec_t req;
+                if (copy_from_user(&req, (const void*)arg0, sizeof(req)) != 0 ||
+                    req.tv_nsec >= 1000000000) 
+                {
+                    frame->eax = -1;
+                    break;
+                }
+
+                sched_sleep_ns((uint64_t)req.tv_sec * 1000000000 + req.tv_nsec);
+
+                // Never interrupted early, so nothing remains
+                if (arg1) 
+                {
+                    sys_timespec_t rem = { 0, 0 };
+                    copy_to_user((void*)arg1, &rem, sizeof(rem));
+                }
+                frame->eax = 0;
+            }
+            break;
+
+        case SYS_CLOCK_GETTIME:
+            {
+                uint64_t ns;
+                if (!clock_get_ns(arg0, &ns))
+                {
+                    frame->eax = -1;
+                    break;
+                }
+
+                uint32_t nsec;
+                sys_timespec_t ts;
+                ts.tv_sec = (uint32_t)udiv64_32(ns, 1000000000, &nsec);
+                ts.tv_nsec = nsec;
+                frame->eax = copy_to_user((void*)arg1, &ts, sizeof(ts)) == 0 ? 0 : -1;
+            }
+            break;
+            
+        case SYS_WAITPID:
+            {
+                // Blocks until the child exits unless WNOHANG; the status is the bare exit code
+                int32_t code = 0;
+                int32_t pid = proc_wait((int32_t)arg0, &code, (arg2 & SYS_WNOHANG) != 0);
+                if (pid > 0 && arg1 && copy_to_user((void*)arg1, &code, sizeof(code)) != 0)
+                {
+                    frame->eax = -1;
+                    break;
+                }
+                frame->eax = pid;
             }
+            break;
+
+        case SYS_EXECVE:
+        case SYS_SPAWN:
+            {
+                // Just the path, programs take no arguments or environment
+                char path[SYSCALL_PATH_MAX];
+                if (strncpy_from_user(path, (const char*)arg0, sizeof(path)) <= 0)
+                {
+                    frame->eax = -1;
+                    break;
+                }
+
+                if (syscall_num == SYS_EXECVE)
+                {
+                    // Does not come back on success, the frame now enters the new program
+                    if (!um_exec(path, frame))
+                        frame->eax = -1;
+                    break;
+                }
+
+                process_t* child = um_spawn(path, proc_current());
+                frame->eax = child ? child->id : (uint32_t)-1;
+            }
+            break;
+            
+        case SYS_SHM_MAP:
+        case SYS_CHAN_CREATE:
+            {
+                // The slot outlives the read section, shm pins the space itself
+                rcu_read_lock();
+                process_t* peer = proc_find((uint16_t)arg0);
+                rcu_read_unlock();
+
+                if (syscall_num == SYS_SHM_MAP)
+                    frame->eax = shm_map(peer, arg2, arg1, frame->esi, frame->edi);
+                else
+                    frame->eax = shm_chan_create(peer, arg1, arg2, frame->esi);
+            }
+            break;
+            
+        case SYS_SYSLOG:
+            {
+                if (arg0 == SYS_SYSLOG_SIZE_BUFFER)
+                {
+                    frame->eax = KLOG_RECORDS * KLOG_LINE_MAX;
+                    break;
+                }
+                if (arg0 != SYS_SYSLOG_READ_ALL || !uaccess_range_ok((void*)arg1, arg2))
+                {
+                    frame->eax = -1;
+                    break;
+                }
+
+                // Oldest record first, whole lines only
+                char chunk[SYSCALL_CHUNK_SIZE];
+                uint32_t seq = klog_oldest();
+                uint32_t done = 0;
+                while (done < arg2)
+                {
+                    uint32_t room = arg2 - done;
+                    int n = klog_read(&seq, chunk, room < sizeof(chunk) ? room : sizeof(chunk));
+                    if (n <= 0)
+                        break;
+                    if (copy_to_user((char*)arg1 + done, chunk, n) != 0)
+                    {
+                        done = (uint32_t)-1;
+                        break;
+                    }
+                    done += n;
+                }
+                frame->eax = done;
+            }
+            break;
+
+        case SYS_THREAD:
+            {
+                process_t* thread = um_thread(arg0, arg1, arg2, frame->esi);
+                frame->eax = thread ? thread->id : (uint32_t)-1;
+            }
+            break;
+
+        case SYS_FUTEX:
+            {
+                if (arg1 == FUTEX_WAKE)
+                {
+                    frame->eax = futex_wake(arg0, arg2);
+                    break;
+                }
+                if (arg1 != FUTEX_WAIT)
+                {
+                    frame->eax = -1;
+                    break;
+                }
+
+                uint64_t timeout_ns = WAIT_FOREVER;
+                if (frame->esi)
+                {
+                    sys_timespec_t ts;
+                    if (copy_from_user(&ts, (const void*)frame->esi, sizeof(ts)) != 0 ||
+                        ts.tv_nsec >= 1000000000)
+                    {
+                        frame->eax = FUTEX_ERR_FAULT;
+                        break;
+                    }
+                    timeout_ns = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+                }
+                frame->eax = futex_wait(arg0, arg2, timeout_ns);
+            }
+            break;
+
+        default:
+            klog(KLOG_WARNING, "Unknown system call: %d", syscall_num);
             frame->eax = -1; // Error
             break;
     }
@@ -6,7 +6,40 @@
 #define SYS_EXIT    0x01
 #define SYS_WRITE   0x04
 #define SYS_GETPID  0x14
+#define SYS_NICE    0x22
 #define SYS_READ    0x03
+#define SYS_WAITPID 0x07
+#define SYS_EXECVE  0x0B
+#define SYS_SYSLOG  0x67        // ebx SYS_SYSLOG_*, ecx buffer, edx length
+#define SYS_NANOSLEEP   0xA2
+#define SYS_GETTID  0xE0
+#define SYS_FUTEX   0xF0        // ebx word, ecx FUTEX_WAIT/WAKE, edx value or count, esi timespec (0: forever)
+#define SYS_CLOCK_GETTIME 0x109
+#define SYS_SPAWN   0x200       // No Linux counterpart: create + load + run, returns the pid
+#define SYS_SHM_MAP 0x201       // ebx pid, ecx src, edx dst, esi pages, edi SHM_MAP_* (see shm.h)
+#define SYS_CHAN_CREATE 0x202   // ebx consumer pid, ecx local, edx remote, esi data pages
+#define SYS_THREAD  0x203       // ebx entry, ecx stack top, edx arg (eax at entry), esi tid word
+
+// SYS_WAITPID options
+#define SYS_WNOHANG 0x1
+
+// SYS_SYSLOG actions, as in syslog(2)
+#define SYS_SYSLOG_READ_ALL     3   // Kernel log lines, oldest first
+#define SYS_SYSLOG_SIZE_BUFFER  10  // Largest byte count READ_ALL can return
+
+// Largest block moved between user and kernel memory at once
+#define SYSCALL_CHUNK_SIZE  256
+
+// Longest program path taken by SYS_EXECVE / SYS_SPAWN, terminator included
+#define SYSCALL_PATH_MAX    128
+
+// struct timespec as seen by 32-bit user programs
+typedef struct
+{
+    uint32_t tv_sec;
+    uint32_t tv_nsec;
+}
+sys_timespec_t;
 
 void handle_syscall(interrupt_frame_t* frame);
 
@@ -0,0 +1,412 @@
+#include "ipc.h"
+#include "../usermode/processes.h"
+#include "../usermode/scheduler.h"
+#include "../shell/shell.h"
+#include "../smp/smp.h"
+#include "../sync/rcu.h"
+#include "../time/clock.h"
+#include "../lib/math64.h"
+#include "../../arch/x86/cpu.h"
+
+extern shell_instance_t* g_kernel_shell;
+
+// Each CPU only ever touches its own entry, from process context
+static ipc_stats_t ipc_cpu_stats[SMP_MAX_CPUS];
+
+void ipc_proc_init(process_t* proc)
+{
+    spin_init(&proc->ipc.lock);
+    ipc_proc_reset(proc);
+}
+
+void ipc_proc_reset(process_t* proc)
+{
+    uint32_t flags = spin_lock_irqsave(&proc->ipc.lock);
+    proc->ipc.state = IPC_IDLE;
+    proc->ipc.call = false;
+    proc->ipc.partner = 0;
+    proc->ipc.from = 0;
+    proc->ipc.notify = 0;
+    proc->ipc.result = IPC_OK;
+    proc->ipc.senders = 0;
+    proc->ipc.senders_tail = 0;
+    proc->ipc.next_sender = 0;
+    spin_unlock_irqrestore(&proc->ipc.lock, flags);
+}
+
+static inline void ipc_msg_from_frame(ipc_msg_t* msg, const interrupt_frame_t* frame)
+{
+    msg->w[0] = frame->ecx;
+    msg->w[1] = frame->edx;
+    msg->w[2] = frame->esi;
+    msg->w[3] = frame->edi;
+}
+
+static inline void ipc_msg_to_frame(interrupt_frame_t* frame, const ipc_msg_t* msg)
+{
+    frame->ecx = msg->w[0];
+    frame->edx = msg->w[1];
+    frame->esi = msg->w[2];
+    frame->edi = msg->w[3];
+}
+
+// Slots are never freed, the pointer stays usable after the read section.
+// If the pid is reused meanwhile we talk to the new process, like kill(2) would.
+static process_t* ipc_lookup(uint16_t pid)
+{
+    rcu_read_lock();
+    process_t* proc = proc_find(pid);
+    rcu_read_unlock();
+    return proc;
+}
+
+// Blocks until the state moves on from 'state'. If handoff is set, it was
+// just made runnable by us and gets the CPU directly when possible.
+static void ipc_wait_while(process_t* self, uint8_t state, process_t* handoff)
+{
+    sched_prepare_wait();
+
+    if (handoff)
+    {
+        if (sched_switch_to(handoff))
+            ipc_cpu_stats[smp_cpu_id()].handoffs++;
+        else
+            sched_wake(handoff, 0);
+    }
+
+    while (self->ipc.state == state)
+    {
+        sched_finish_wait();
+        sched_prepare_wait();
+    }
+    sched_cancel_wait();
+}
+
+// Lock held. Takes the oldest sender matching from (0 for any) off the list.
+static process_t* ipc_take_sender(process_t* self, uint16_t from)
+{
+    process_t* prev = 0;
+    for (process_t* sender = self->ipc.senders; sender; sender = sender->ipc.next_sender)
+    {
+        if (from == 0 || sender->id == from)
+        {
+            if (prev)
+                prev->ipc.next_sender = sender->ipc.next_sender;
+            else
+                self->ipc.senders = sender->ipc.next_sender;
+            if (self->ipc.senders_tail == sender)
+                self->ipc.senders_tail = prev;
+            sender->ipc.next_sender = 0;
+            return sender;
+        }
+        prev = sender;
+    }
+    return 0;
+}
+
+static int32_t ipc_send(process_t* self, uint16_t dest_pid, const ipc_msg_t* msg, bool call)
+{
+    process_t* dest = ipc_lookup(dest_pid);
+    if (!dest || dest == self)
+        return IPC_ERR_NOPROC;
+
+    uint32_t flags = spin_lock_irqsave(&dest->ipc.lock);
+    if (dest->ipc.state == IPC_DEAD)
+    {
+        spin_unlock_irqrestore(&dest->ipc.lock, flags);
+        return IPC_ERR_NOPROC;
+    }
+
+    self->ipc.partner = dest->id;
+    self->ipc.result = IPC_OK;
+
+    if (dest->ipc.state == IPC_RECEIVING && (dest->ipc.partner == 0 || dest->ipc.partner == self->id))
+    {
+        // Fast path: the receiver is waiting, copy straight into it
+        dest->ipc.msg = *msg;
+        dest->ipc.from = self->id;
+        dest->ipc.result = IPC_OK;
+        dest->ipc.state = IPC_IDLE;
+        self->ipc.state = call ? IPC_WAIT_REPLY : IPC_IDLE;
+        spin_unlock_irqrestore(&dest->ipc.lock, flags);
+
+        if (!call)
+        {
+            sched_wake(dest, 0);
+            return IPC_OK;
+        }
+
+        ipc_wait_while(self, IPC_WAIT_REPLY, dest);
+        return self->ipc.result;
+    }
+
+    // Receiver busy, queue up behind earlier senders
+    self->ipc.msg = *msg;
+    self->ipc.call = call;
+    self->ipc.state = IPC_SENDING;
+    self->ipc.next_sender = 0;
+    if (dest->ipc.senders_tail)
+        dest->ipc.senders_tail->ipc.next_sender = self;
+    else
+        dest->ipc.senders = self;
+    dest->ipc.senders_tail = self;
+    spin_unlock_irqrestore(&dest->ipc.lock, flags);
+
+    ipc_wait_while(self, IPC_SENDING, 0);
+    if (call && self->ipc.result == IPC_OK)
+        ipc_wait_while(self, IPC_WAIT_REPLY, 0);
+    return self->ipc.result;
+}
+
+// Lock held, open receive. Hands out the pending bits as a message from pid 0.
+static void ipc_take_notify(process_t* self)
+{
+    self->ipc.msg.w[0] = self->ipc.notify;
+    for (int i = 1; i < IPC_MSG_WORDS; i++)
+        self->ipc.msg.w[i] = 0;
+    self->ipc.from = 0;
+    self->ipc.result = IPC_OK;
+    self->ipc.notify = 0;
+}
+
+static int32_t ipc_notify(process_t* self, uint16_t dest_pid, uint32_t bits)
+{
+    process_t* dest = ipc_lookup(dest_pid);
+    if (!dest || dest == self)
+        return IPC_ERR_NOPROC;
+
+    uint32_t flags = spin_lock_irqsave(&dest->ipc.lock);
+    if (dest->ipc.state == IPC_DEAD)
+    {
+        spin_unlock_irqrestore(&dest->ipc.lock, flags);
+        return IPC_ERR_NOPROC;
+    }
+
+    dest->ipc.notify |= bits;
+    bool wake = dest->ipc.state == IPC_RECEIVING && dest->ipc.partner == 0;
+    if (wake)
+    {
+        ipc_take_notify(dest);
+        dest->ipc.state = IPC_IDLE;
+    }
+    spin_unlock_irqrestore(&dest->ipc.lock, flags);
+
+    if (wake)
+        sched_wake(dest, 0);
+    return IPC_OK;
+}
+
+static int32_t ipc_receive(process_t* self, uint16_t from, process_t* handoff)
+{
+    uint32_t flags = spin_lock_irqsave(&self->ipc.lock);
+
+    // Doorbells first, they never block anyone
+    if (from == 0 && self->ipc.notify)
+    {
+        ipc_take_notify(self);
+        spin_unlock_irqrestore(&self->ipc.lock, flags);
+        if (handoff)
+            sched_wake(handoff, 0);
+        return IPC_OK;
+    }
+
+    process_t* sender = ipc_take_sender(self, from);
+    if (sender)
+    {
+        // Read everything before the state change lets the sender move on
+        bool call = sender->ipc.call;
+        self->ipc.msg = sender->ipc.msg;
+        self->ipc.from = sender->id;
+        self->ipc.result = IPC_OK;
+        sender->ipc.state = call ? IPC_WAIT_REPLY : IPC_IDLE;
+        spin_unlock_irqrestore(&self->ipc.lock, flags);
+
+        if (!call)
+            sched_wake(sender, 0);
+        if (handoff)
+            sched_wake(handoff, 0);
+        return IPC_OK;
+    }
+
+    self->ipc.partner = from;
+    self->ipc.state = IPC_RECEIVING;
+    spin_unlock_irqrestore(&self->ipc.lock, flags);
+
+    ipc_wait_while(self, IPC_RECEIVING, handoff);
+    return self->ipc.result;
+}
+
+// Delivers the reply; returns the caller, to be woken by the one replying
+static process_t* ipc_reply(process_t* self, uint16_t to, const ipc_msg_t* msg, int32_t* result)
+{
+    process_t* caller = ipc_lookup(to);
+    if (!caller)
+    {
+        *result = IPC_ERR_NOPROC;
+        return 0;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&caller->ipc.lock);
+    if (caller->ipc.state != IPC_WAIT_REPLY || caller->ipc.partner != self->id)
+    {
+        spin_unlock_irqrestore(&caller->ipc.lock, flags);
+        *result = IPC_ERR_STATE;
+        return 0;
+    }
+
+    caller->ipc.msg = *msg;
+    caller->ipc.from = self->id;
+    caller->ipc.result = IPC_OK;
+    caller->ipc.state = IPC_IDLE;
+    spin_unlock_irqrestore(&caller->ipc.lock, flags);
+
+    *result = IPC_OK;
+    return caller;
+}
+
+static void ipc_account_call(uint64_t cycles)
+{
+    ipc_stats_t* stats = &ipc_cpu_stats[smp_cpu_id()];
+    stats->calls++;
+    stats->total_cycles += cycles;
+    if (cycles > stats->max_cycles)
+        stats->max_cycles = cycles;
+}
+
+void ipc_handle(interrupt_frame_t* frame)
+{
+    process_t* self = proc_current();
+    if (!self || (frame->cs & 0x3) != 3)
+    {
+        frame->eax = (uint32_t)IPC_ERR_INVALID;
+        return;
+    }
+
+    uint32_t op = frame->eax;
+    uint16_t partner = (uint16_t)frame->ebx;
+    int32_t result;
+    bool received = false;
+
+    ipc_msg_t msg;
+    ipc_msg_from_frame(&msg, frame);
+
+    switch (op)
+    {
+        case IPC_SEND:
+            result = ipc_send(self, partner, &msg, false);
+            break;
+
+        case IPC_CALL:
+            {
+                uint64_t start = clock_has_tsc() ? rdtsc() : 0;
+                result = ipc_send(self, partner, &msg, true);
+                received = result == IPC_OK;
+                if (received && start)
+                    ipc_account_call(rdtsc() - start);
+            }
+            break;
+
+        case IPC_RECEIVE:
+            result = ipc_receive(self, partner, 0);
+            received = result == IPC_OK;
+            break;
+
+        case IPC_REPLY:
+            {
+                process_t* caller = ipc_reply(self, partner, &msg, &result);
+                if (caller)
+                    sched_wake(caller, 0);
+            }
+            break;
+
+        case IPC_NOTIFY:
+            result = ipc_notify(self, partner, frame->ecx);
+            break;
+
+        case IPC_REPLY_WAIT:
+            {
+                // A failed reply still waits, the server loop goes on
+                process_t* caller = ipc_reply(self, partner, &msg, &result);
+                result = ipc_receive(self, 0, caller);
+                received = result == IPC_OK;
+            }
+            break;
+
+        default:
+            result = IPC_ERR_INVALID;
+            break;
+    }
+
+    if (received)
+    {
+        frame->ebx = self->ipc.from;
+        ipc_msg_to_frame(frame, &self->ipc.msg);
+    }
+    frame->eax = (uint32_t)result;
+}
+
+static void ipc_abort(process_t* proc)
+{
+    proc->ipc.result = IPC_ERR_ABORTED;
+    proc->ipc.state = IPC_IDLE;
+}
+
+void ipc_exit(process_t* proc)
+{
+    // No new senders from here on, queued ones fail
+    uint32_t flags = spin_lock_irqsave(&proc->ipc.lock);
+    proc->ipc.state = IPC_DEAD;
+    process_t* sender = proc->ipc.senders;
+    proc->ipc.senders = 0;
+    proc->ipc.senders_tail = 0;
+    spin_unlock_irqrestore(&proc->ipc.lock, flags);
+
+    while (sender)
+    {
+        process_t* next = sender->ipc.next_sender;
+        sender->ipc.next_sender = 0;
+        ipc_abort(sender);
+        sched_wake(sender, 0);
+        sender = next;
+    }
+
+    // Callers whose request we took but never answered
+    for (uint16_t pid = 1; pid <= PROC_MAX_COUNT; pid++)
+    {
+        process_t* caller = ipc_lookup(pid);
+        if (!caller || caller == proc)
+            continue;
+
+        flags = spin_lock_irqsave(&caller->ipc.lock);
+        bool waiting = caller->ipc.state == IPC_WAIT_REPLY && caller->ipc.partner == proc->id;
+        if (waiting)
+            ipc_abort(caller);
+        spin_unlock_irqrestore(&caller->ipc.lock, flags);
+
+        if (waiting)
+            sched_wake(caller, 0);
+    }
+}
+
+void ipc_stats_dump(void)
+{
+    if (!g_kernel_shell)
+        return;
+
+    ipc_stats_t sum = { 0, 0, 0, 0 };
+    for (int cpu = 0; cpu < SMP_MAX_CPUS; cpu++)
+    {
+        const ipc_stats_t* stats = &ipc_cpu_stats[cpu];
+        sum.calls += stats->calls;
+        sum.total_cycles += stats->total_cycles;
+        sum.handoffs += stats->handoffs;
+        if (stats->max_cycles > sum.max_cycles)
+            sum.max_cycles = stats->max_cycles;
+    }
+
+    // The divisor is saturated to 32 bits
+    uint32_t calls = sum.calls > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)sum.calls;
+    uint64_t avg = calls ? udiv64_32(sum.total_cycles, calls, 0) : 0;
+    sh_printf(g_kernel_shell, "IPC: %llu calls, AVG %llu cyc, MAX %llu cyc, %llu handoffs\r\n",
+              sum.calls, avg, sum.max_cycles, sum.handoffs);
+}
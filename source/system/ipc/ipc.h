@@ -0,0 +1,92 @@
+#ifndef K_IPC_H
+#define K_IPC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "../interrupts/interrupts.h"
+#include "../sync/spinlock.h"
+
+struct process;
+
+// Synchronous, unbuffered IPC between processes, L4 style. Short messages
+// travel in registers only through their own vector:
+//   in:  eax = operation, ebx = partner pid (0: any sender, receive only),
+//        ecx, edx, esi, edi = message words
+//   out: eax = IPC_OK or an IPC_ERR_*, ebx = sender pid (receiving operations),
+//        ecx, edx, esi, edi = received message words
+// A call hands the CPU directly to a waiting receiver on the same CPU, and
+// its reply hands it back, neither goes through the run queue.
+#define INT_IPC_VECTOR      0x81
+
+#define IPC_MSG_WORDS       4
+
+// Operations (eax)
+#define IPC_SEND            1   // Blocks until the receiver took the message
+#define IPC_RECEIVE         2   // Blocks until a message from ebx (or anyone) arrives
+#define IPC_CALL            3   // Send, then block for the reply from the same process
+#define IPC_REPLY           4   // Never blocks, fails if the caller is not waiting
+#define IPC_REPLY_WAIT      5   // Reply, then receive from anyone: a server's loop
+#define IPC_NOTIFY          6   // Never blocks: ORs ecx into the partner's pending bits.
+                                // An open receive returns them with sender pid 0, bits in ecx.
+
+// Results
+#define IPC_OK              0
+#define IPC_ERR_NOPROC      -1  // No such process, or it is exiting
+#define IPC_ERR_ABORTED     -2  // Partner exited while we were blocked on it
+#define IPC_ERR_STATE       -3  // Reply to a process not waiting for one from us
+#define IPC_ERR_INVALID     -4  // Unknown operation
+
+// Per-process IPC state (ipc_state_t.state)
+#define IPC_IDLE            0
+#define IPC_SENDING         1   // Queued on the partner's senders list
+#define IPC_RECEIVING       2   // Open (partner 0) or closed receive
+#define IPC_WAIT_REPLY      3   // Call delivered, reply pending
+#define IPC_DEAD            4   // Exiting, refuses new senders
+
+typedef struct
+{
+    uint32_t w[IPC_MSG_WORDS];
+}
+ipc_msg_t;
+
+// Lives in process_t. lock guards state, partner and the senders list; the
+// message buffer belongs to whoever moves the process out of its blocked state.
+typedef struct
+{
+    spinlock_t lock;
+    volatile uint8_t state;
+    bool call;                      // Queued sender wants a reply
+    uint16_t partner;               // Process we send to / wait for, 0 for any
+    uint16_t from;                  // Sender of the last message delivered to us, 0 for notifications
+    uint32_t notify;                // Pending notification bits (doorbells)
+    int32_t result;                 // Set with the state change that unblocks us
+    ipc_msg_t msg;                  // Outgoing while queued, incoming once unblocked
+    struct process* senders;        // Blocked sending to us, oldest first
+    struct process* senders_tail;
+    struct process* next_sender;    // Link on the partner's senders list
+}
+ipc_state_t;
+
+typedef struct
+{
+    uint64_t calls;
+    uint64_t total_cycles;          // Call entry to reply delivered, including the server
+    uint64_t max_cycles;
+    uint64_t handoffs;              // Direct switches, call or reply
+}
+ipc_stats_t;
+
+void ipc_proc_init(struct process* proc);   // Once per slot
+void ipc_proc_reset(struct process* proc);  // Whenever the slot is reused
+
+// Fast path entry, straight from interrupt_handler without the action chain
+void ipc_handle(interrupt_frame_t* frame);
+
+// Fails pending and future senders and callers waiting on the exiting process
+void ipc_exit(struct process* proc);
+
+// Round trip benchmark: calls, average and worst cycles per call
+void ipc_stats_dump(void);
+
+#endif
@@ -0,0 +1,120 @@
+#include "shm.h"
+#include "../usermode/processes.h"
+#include "../usermode/usermode.h"
+#include "../memory/physical.h"
+#include "../memory/virtual.h"
+
+static bool shm_range_ok(uintptr_t addr, uint32_t count)
+{
+    if (addr & (PAGE_SIZE - 1))
+        return false;
+    if (count == 0 || count > SHM_MAX_PAGES)
+        return false;
+    return addr >= USER_CODE_BASE && addr + count * PAGE_SIZE <= USER_STACK_TOP;
+}
+
+// Present source frame for addr, zero-filled now if it was never touched.
+// Pages the space does not own (PAGE_SHARED) cannot be passed on.
+static uint32_t shm_source_pte(uint32_t* page_dir, uintptr_t addr)
+{
+    uint32_t pte = mem_virt_query(page_dir, (void*)addr);
+    if (pte & PAGE_PRESENT)
+        return (pte & PAGE_SHARED) ? 0 : pte;
+
+    uint32_t* page = (uint32_t*)mem_phys_alloc();
+    if (!page)
+        return 0;
+    for (int i = 0; i < PAGE_SIZE / 4; i++)
+        page[i] = 0;
+
+    if (!mem_virt_map_new_in(page_dir, (void*)addr, page, PAGE_USER | PAGE_WRITABLE))
+    {
+        mem_phys_free(page);
+        return 0;
+    }
+    return (uint32_t)page | PAGE_USER | PAGE_WRITABLE | PAGE_PRESENT;
+}
+
+int32_t shm_map(process_t* to, uintptr_t dst, uintptr_t src, uint32_t count, uint32_t flags)
+{
+    process_t* self = proc_current();
+    if (!shm_range_ok(src, count) || !shm_range_ok(dst, count))
+        return SHM_ERR_RANGE;
+    if (to == self && src < dst + count * PAGE_SIZE && dst < src + count * PAGE_SIZE)
+        return SHM_ERR_RANGE;
+    if (!to || !proc_space_get(to))
+        return SHM_ERR_NOPROC;
+
+    // Every frame takes a reference for its new mapping first. A grant drops
+    // the source's afterwards, so a failure halfway is undone the same way.
+    int32_t result = SHM_OK;
+    uint32_t done;
+    for (done = 0; done < count; done++)
+    {
+        uintptr_t offset = done * PAGE_SIZE;
+        uint32_t pte = shm_source_pte(self->page_dir, src + offset);
+        if (!pte)
+        {
+            result = SHM_ERR_NOMEM;
+            break;
+        }
+
+        void* frame = (void*)(pte & PAGE_FRAME_MASK);
+        int map_flags = PAGE_USER;
+        if ((pte & PAGE_WRITABLE) && !(flags & SHM_MAP_READONLY))
+            map_flags |= PAGE_WRITABLE;
+
+        if (!mem_phys_ref(frame))
+        {
+            result = SHM_ERR_NOMEM;
+            break;
+        }
+        if (!mem_virt_map_new_in(to->page_dir, (void*)(dst + offset), frame, map_flags))
+        {
+            mem_phys_unref(frame);
+            result = SHM_ERR_RANGE;
+            break;
+        }
+    }
+
+    for (uint32_t i = 0; i < done; i++)
+    {
+        uintptr_t offset = i * PAGE_SIZE;
+        uint32_t pte;
+        if (result != SHM_OK)
+            pte = mem_virt_unmap_in(to->page_dir, (void*)(dst + offset));
+        else if (flags & SHM_MAP_GRANT)
+            pte = mem_virt_unmap_in(self->page_dir, (void*)(src + offset));
+        else
+            break;
+
+        if (pte & PAGE_PRESENT)
+            mem_phys_unref((void*)(pte & PAGE_FRAME_MASK));
+    }
+
+    proc_space_put(to);
+    return result;
+}
+
+int32_t shm_chan_create(process_t* peer, uintptr_t local, uintptr_t remote, uint32_t data_pages)
+{
+    process_t* self = proc_current();
+    if (data_pages == 0 || data_pages > SHM_CHAN_MAX_PAGES || (data_pages & (data_pages - 1)))
+        return SHM_ERR_RANGE;
+    if (!peer || peer == self)
+        return SHM_ERR_NOPROC;
+
+    int32_t result = shm_map(peer, remote, local, data_pages + 1, 0);
+    if (result != SHM_OK)
+        return result;
+
+    // Through the kernel's identity map, the user mapping may be read-only
+    uint32_t pte = mem_virt_query(self->page_dir, (void*)local);
+    shm_chan_t* chan = (shm_chan_t*)(pte & PAGE_FRAME_MASK);
+    chan->head = 0;
+    chan->tail = 0;
+    chan->size = data_pages * PAGE_SIZE;
+    chan->producer = self->id;
+    chan->consumer = peer->id;
+    return SHM_OK;
+}
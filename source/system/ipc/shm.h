@@ -0,0 +1,47 @@
+#ifndef K_IPC_SHM_H
+#define K_IPC_SHM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct process;
+
+// Page sharing between processes, L4 style: a map shares the frames (both
+// sides keep them, the last one to unmap frees them), a grant moves them.
+// Source pages not touched yet are allocated on the way.
+#define SHM_MAP_READONLY    0x1     // Receiver may not write, whatever the source may
+#define SHM_MAP_GRANT       0x2     // Gone from the source afterwards
+
+#define SHM_MAX_PAGES       256     // Per request
+
+#define SHM_OK              0
+#define SHM_ERR_NOPROC      -1      // No such process, or it is exiting
+#define SHM_ERR_RANGE       -2      // Unaligned, outside the user window, or destination in use
+#define SHM_ERR_NOMEM       -3
+
+// Channel: a single-producer single-consumer byte ring in shared pages,
+// one header page followed by the data pages. Nothing goes through the
+// kernel once it is set up; the doorbell is an IPC_NOTIFY to the other side.
+// Layout is mirrored by user/lib/chan.asm, keep both in sync.
+#define SHM_CHAN_MAX_PAGES  64
+
+typedef struct
+{
+    volatile uint32_t head;     // 0: bytes written so far, producer only
+    uint32_t pad0[15];
+    volatile uint32_t tail;     // 64: bytes read so far, consumer only
+    uint32_t pad1[15];
+    uint32_t size;              // 128: data bytes, a power of two
+    uint32_t producer;          // 132: pid, the consumer rings it after reading
+    uint32_t consumer;          // 136: pid, the producer rings it after writing
+}
+shm_chan_t;
+
+// From the current process to another one (or itself at another address)
+int32_t shm_map(struct process* to, uintptr_t dst, uintptr_t src, uint32_t count, uint32_t flags);
+
+// Sets up a channel with data_pages (a power of two) at local in the current
+// process, the producer, and at remote in peer, the consumer
+int32_t shm_chan_create(struct process* peer, uintptr_t local, uintptr_t remote, uint32_t data_pages);
+
+#endif
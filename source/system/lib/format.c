@@ -0,0 +1,307 @@
+#include "format.h"
+#include "math64.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FORMAT_LEFT     0x01    // -
+#define FORMAT_PLUS     0x02    // +
+#define FORMAT_SPACE    0x04    // space
+#define FORMAT_ALT      0x08    // #
+#define FORMAT_ZERO     0x10    // 0
+#define FORMAT_UPPER    0x20    // %X
+#define FORMAT_POINTER  0x40    // %p: 0x even for null
+
+typedef struct
+{
+    char* buf;
+    size_t size;
+    size_t len;                 // Full length, may run past size
+}
+format_out_t;
+
+static inline void format_putc(format_out_t* out, char c)
+{
+    if (out->len + 1 < out->size)
+        out->buf[out->len] = c;
+    out->len++;
+}
+
+static void format_pad(format_out_t* out, char c, int count)
+{
+    while (count-- > 0)
+        format_putc(out, c);
+}
+
+static void format_str(format_out_t* out, const char* s, int width, int precision, uint32_t flags)
+{
+    int len = 0;
+    while (s[len] && (precision < 0 || len < precision))
+        len++;
+
+    if (!(flags & FORMAT_LEFT))
+        format_pad(out, ' ', width - len);
+    for (int i = 0; i < len; i++)
+        format_putc(out, s[i]);
+    if (flags & FORMAT_LEFT)
+        format_pad(out, ' ', width - len);
+}
+
+// Digits in reverse into tmp, 64-bit division only when the value needs it
+static int format_digits(char* tmp, uint64_t value, uint32_t base, bool upper)
+{
+    const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    int n = 0;
+
+    while (value >> 32)
+    {
+        uint32_t rem;
+        value = udiv64_32(value, base, &rem);
+        tmp[n++] = digits[rem];
+    }
+
+    uint32_t low = (uint32_t)value;
+    while (low)
+    {
+        tmp[n++] = digits[low % base];
+        low /= base;
+    }
+    return n;
+}
+
+static void format_int(format_out_t* out, uint64_t value, bool negative, uint32_t base,
+                       int width, int precision, uint32_t flags)
+{
+    char tmp[24];
+    int digits = format_digits(tmp, value, base, flags & FORMAT_UPPER);
+
+    // Precision 0 with a zero value prints no digits, like printf
+    int zeros = 0;
+    if (precision >= 0)
+    {
+        if (precision > digits)
+            zeros = precision - digits;
+        flags &= ~FORMAT_ZERO;
+    }
+    else if (digits == 0)
+    {
+        zeros = 1;
+    }
+
+    char sign = 0;
+    if (negative)
+        sign = '-';
+    else if (flags & FORMAT_PLUS)
+        sign = '+';
+    else if (flags & FORMAT_SPACE)
+        sign = ' ';
+
+    const char* prefix = "";
+    if ((flags & FORMAT_ALT) && (value || (flags & FORMAT_POINTER)))
+    {
+        if (base == 16)
+            prefix = (flags & FORMAT_UPPER) ? "0X" : "0x";
+        else if (base == 8 && zeros == 0)
+            prefix = "0";
+    }
+
+    int prefix_len = 0;
+    while (prefix[prefix_len])
+        prefix_len++;
+
+    int len = (sign ? 1 : 0) + prefix_len + zeros + digits;
+    if (flags & FORMAT_ZERO && !(flags & FORMAT_LEFT) && width > len)
+    {
+        zeros += width - len;
+        len = width;
+    }
+
+    if (!(flags & FORMAT_LEFT))
+        format_pad(out, ' ', width - len);
+    if (sign)
+        format_putc(out, sign);
+    for (int i = 0; i < prefix_len; i++)
+        format_putc(out, prefix[i]);
+    format_pad(out, '0', zeros);
+    while (digits > 0)
+        format_putc(out, tmp[--digits]);
+    if (flags & FORMAT_LEFT)
+        format_pad(out, ' ', width - len);
+}
+
+static int format_number(const char** fmt)
+{
+    int value = 0;
+    while (**fmt >= '0' && **fmt <= '9')
+        value = value * 10 + (*(*fmt)++ - '0');
+    return value;
+}
+
+int kvsnprintf(char* buf, size_t size, const char* fmt, va_list args)
+{
+    format_out_t out = { buf, size, 0 };
+
+    while (*fmt)
+    {
+        if (*fmt != '%')
+        {
+            format_putc(&out, *fmt++);
+            continue;
+        }
+        const char* start = fmt++;
+
+        uint32_t flags = 0;
+        for (bool more = true; more; )
+        {
+            switch (*fmt)
+            {
+                case '-': flags |= FORMAT_LEFT; fmt++; break;
+                case '+': flags |= FORMAT_PLUS; fmt++; break;
+                case ' ': flags |= FORMAT_SPACE; fmt++; break;
+                case '#': flags |= FORMAT_ALT; fmt++; break;
+                case '0': flags |= FORMAT_ZERO; fmt++; break;
+                default: more = false; break;
+            }
+        }
+
+        int width = 0;
+        if (*fmt == '*')
+        {
+            width = va_arg(args, int);
+            if (width < 0)
+            {
+                flags |= FORMAT_LEFT;
+                width = -width;
+            }
+            fmt++;
+        }
+        else
+        {
+            width = format_number(&fmt);
+        }
+
+        int precision = -1;
+        if (*fmt == '.')
+        {
+            fmt++;
+            if (*fmt == '*')
+            {
+                precision = va_arg(args, int);
+                fmt++;
+            }
+            else
+            {
+                precision = format_number(&fmt);
+            }
+        }
+
+        // Everything is 32 bits wide here except ll (and j)
+        int size_bits = 32;
+        if (*fmt == 'h')
+        {
+            fmt++;
+            size_bits = 16;
+            if (*fmt == 'h')
+            {
+                fmt++;
+                size_bits = 8;
+            }
+        }
+        else if (*fmt == 'l')
+        {
+            fmt++;
+            if (*fmt == 'l')
+            {
+                fmt++;
+                size_bits = 64;
+            }
+        }
+        else if (*fmt == 'j')
+        {
+            fmt++;
+            size_bits = 64;
+        }
+        else if (*fmt == 'z' || *fmt == 't')
+        {
+            fmt++;
+        }
+
+        char conv = *fmt;
+        if (conv)
+            fmt++;
+
+        switch (conv)
+        {
+            case 'd':
+            case 'i':
+            {
+                int64_t value = size_bits == 64 ? va_arg(args, int64_t) : va_arg(args, int32_t);
+                if (size_bits == 16)
+                    value = (int16_t)value;
+                else if (size_bits == 8)
+                    value = (int8_t)value;
+                bool negative = value < 0;
+                format_int(&out, negative ? -(uint64_t)value : (uint64_t)value, negative, 10,
+                           width, precision, flags);
+                break;
+            }
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o':
+            {
+                uint64_t value = size_bits == 64 ? va_arg(args, uint64_t) : va_arg(args, uint32_t);
+                if (size_bits == 16)
+                    value = (uint16_t)value;
+                else if (size_bits == 8)
+                    value = (uint8_t)value;
+                if (conv == 'X')
+                    flags |= FORMAT_UPPER;
+                uint32_t base = conv == 'u' ? 10 : conv == 'o' ? 8 : 16;
+                format_int(&out, value, false, base, width, precision, flags);
+                break;
+            }
+            case 'p':
+                format_int(&out, (uintptr_t)va_arg(args, void*), false, 16, width,
+                           precision, flags | FORMAT_ALT | FORMAT_POINTER);
+                break;
+            case 'c':
+            {
+                char c = (char)va_arg(args, int);
+                if (!(flags & FORMAT_LEFT))
+                    format_pad(&out, ' ', width - 1);
+                format_putc(&out, c);
+                if (flags & FORMAT_LEFT)
+                    format_pad(&out, ' ', width - 1);
+                break;
+            }
+            case 's':
+            {
+                const char* s = va_arg(args, const char*);
+                format_str(&out, s ? s : "(null)", width, precision, flags);
+                break;
+            }
+            case '%':
+                format_putc(&out, '%');
+                break;
+            default:
+                // Unknown conversion: print it as written
+                while (start < fmt)
+                    format_putc(&out, *start++);
+                break;
+        }
+    }
+
+    if (size)
+        buf[out.len < size ? out.len : size - 1] = '\0';
+    return (int)out.len;
+}
+
+int ksnprintf(char* buf, size_t size, const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int len = kvsnprintf(buf, size, fmt, args);
+    va_end(args);
+    return len;
+}
@@ -0,0 +1,18 @@
+#ifndef K_LIB_FORMAT_H
+#define K_LIB_FORMAT_H
+
+#include <stdarg.h>
+#include <stddef.h>
+
+// printf-style formatting into a buffer, C99 semantics without floating point:
+//   flags      - + space # 0
+//   width      number or *
+//   precision  .number or .*, minimum digits for integers, maximum bytes for %s
+//   length     hh h l ll z t j
+//   conversion d i u x X o p c s %
+// Always terminates the output when size > 0 and returns the length the
+// whole output would have had, so a result >= size means it was cut off.
+int kvsnprintf(char* buf, size_t size, const char* fmt, va_list args);
+int ksnprintf(char* buf, size_t size, const char* fmt, ...) __attribute__((format(printf, 3, 4)));
+
+#endif
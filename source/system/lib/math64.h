@@ -0,0 +1,23 @@
+#ifndef K_LIB_MATH64_H
+#define K_LIB_MATH64_H
+
+#include <stdint.h>
+
+// 64 by 32 bit division without libgcc (__udivdi3 is not linked in)
+static inline uint64_t udiv64_32(uint64_t n, uint32_t d, uint32_t* rem)
+{
+    uint32_t hi = (uint32_t)(n >> 32);
+    uint32_t lo = (uint32_t)n;
+    uint32_t q_hi = hi / d;
+    uint32_t r = hi % d;
+    uint32_t q_lo;
+
+    // r < d, so the quotient of r:lo / d fits in 32 bits
+    __asm__ ("divl %4" : "=a"(q_lo), "=d"(r) : "a"(lo), "d"(r), "rm"(d));
+
+    if (rem)
+        *rem = r;
+    return ((uint64_t)q_hi << 32) | q_lo;
+}
+
+#endif
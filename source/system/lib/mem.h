@@ -0,0 +1,16 @@
+#ifndef K_LIB_MEM_H
+#define K_LIB_MEM_H
+
+#include <stddef.h>
+
+// Block copy without libc: dwords with rep movsd, then the odd bytes.
+// Regions must not overlap.
+static inline void kmemcpy(void* dst, const void* src, size_t len)
+{
+    size_t dwords = len >> 2;
+    size_t bytes = len & 3;
+    __asm__ volatile ("rep movsl" : "+D"(dst), "+S"(src), "+c"(dwords) : : "memory");
+    __asm__ volatile ("rep movsb" : "+D"(dst), "+S"(src), "+c"(bytes) : : "memory");
+}
+
+#endif
@@ -0,0 +1,179 @@
+#include "klog.h"
+#include "../lib/format.h"
+#include "../lib/math64.h"
+#include "../interrupts/softirq.h"
+#include "../shell/shell.h"
+#include "../smp/smp.h"
+#include "../sync/spinlock.h"
+#include "../time/clock.h"
+
+#include <stdarg.h>
+
+extern shell_instance_t* g_kernel_shell;
+
+static klog_record_t klog_ring[KLOG_RECORDS];
+static volatile uint32_t klog_head = 0;     // Next sequence number to hand out
+
+static volatile int klog_console_level = KLOG_INFO;
+static bool klog_ready = false;
+static tasklet_t klog_tasklet;
+
+// The console side: one drainer at a time, the tasklet or klog_flush
+static lock_stats_t klog_drain_lock_stats = LOCK_STATS_INIT("klog");
+static spinlock_t klog_drain_lock = SPINLOCK_INIT_STATS(&klog_drain_lock_stats);
+static uint32_t klog_console_seq = 0;
+
+void klog(int level, const char* fmt, ...)
+{
+    uint32_t seq = __sync_fetch_and_add(&klog_head, 1);
+    klog_record_t* rec = &klog_ring[seq & (KLOG_RECORDS - 1)];
+
+    // Readers that see 0, or a sequence number that moved, drop their copy
+    rec->seq = 0;
+    __asm__ volatile("" : : : "memory");
+
+    rec->level = (uint8_t)level;
+    rec->cpu = (uint8_t)smp_cpu_id();
+    rec->time_ns = clock_monotonic_ns();
+
+    va_list args;
+    va_start(args, fmt);
+    int len = kvsnprintf(rec->text, sizeof(rec->text), fmt, args);
+    va_end(args);
+    if (len >= (int)sizeof(rec->text))
+        len = sizeof(rec->text) - 1;
+
+    // Lines end where the console needs them to
+    while (len > 0 && (rec->text[len - 1] == '\n' || rec->text[len - 1] == '\r'))
+        len--;
+    rec->len = (uint16_t)len;
+
+    // Stores are not reordered on x86, the record is complete before this one
+    __asm__ volatile("" : : : "memory");
+    rec->seq = seq + 1;
+
+    if (klog_ready && level <= klog_console_level)
+        tasklet_schedule(&klog_tasklet);
+}
+
+uint32_t klog_oldest(void)
+{
+    uint32_t head = klog_head;
+    return head > KLOG_RECORDS ? head - KLOG_RECORDS : 0;
+}
+
+// Copies record seq out if it is complete. Moves *seq forward past records
+// that were overwritten meanwhile; false once it caught up with the writers.
+static bool klog_fetch(uint32_t* seq, klog_record_t* out)
+{
+    while (*seq != klog_head)
+    {
+        if (*seq < klog_oldest())
+            *seq = klog_oldest();
+
+        const klog_record_t* rec = &klog_ring[*seq & (KLOG_RECORDS - 1)];
+        uint32_t before = rec->seq;
+        if (before != *seq + 1)
+        {
+            // Still being written, unless it was lapped since
+            if (*seq >= klog_oldest())
+                return false;
+            continue;
+        }
+
+        __asm__ volatile("" : : : "memory");
+        *out = *rec;
+        __asm__ volatile("" : : : "memory");
+        if (rec->seq == before)
+        {
+            (*seq)++;
+            return true;
+        }
+    }
+    return false;
+}
+
+// "[    12.345678] text\r\n", returns the length
+static int klog_format_line(const klog_record_t* rec, char* buf, int size)
+{
+    uint32_t ns;
+    uint32_t sec = (uint32_t)udiv64_32(rec->time_ns, 1000000000, &ns);
+    int len = ksnprintf(buf, size, "[%5u.%06u] %s\r\n", sec, ns / 1000, rec->text);
+    return len < size ? len : size - 1;
+}
+
+int klog_read(uint32_t* seq, char* buf, int len)
+{
+    int done = 0;
+    klog_record_t rec;
+    char line[KLOG_LINE_MAX];
+
+    while (1)
+    {
+        uint32_t next = *seq;
+        if (!klog_fetch(&next, &rec))
+            break;
+
+        int n = klog_format_line(&rec, line, sizeof(line));
+        if (done + n > len)
+            break;
+        for (int i = 0; i < n; i++)
+            buf[done + i] = line[i];
+        done += n;
+        *seq = next;
+    }
+    return done;
+}
+
+static void klog_drain(bool wait)
+{
+    klog_record_t rec;
+    char line[KLOG_LINE_MAX];
+
+    uint32_t flags = irq_save();
+    if (wait)
+    {
+        spin_lock(&klog_drain_lock);
+    }
+    else if (!spin_trylock(&klog_drain_lock))
+    {
+        irq_restore(flags);
+        return;
+    }
+    while (klog_fetch(&klog_console_seq, &rec))
+    {
+        if (rec.level > klog_console_level || !g_kernel_shell)
+            continue;
+
+        int n = klog_format_line(&rec, line, sizeof(line));
+        sh_write_stream(g_kernel_shell, rec.level <= KLOG_ERR ? STREAM_STDERR : STREAM_STDOUT, line, n);
+    }
+    spin_unlock_irqrestore(&klog_drain_lock, flags);
+}
+
+static void klog_work(void* ctx)
+{
+    (void)ctx;
+    klog_drain(true);
+}
+
+void klog_init(void)
+{
+    lock_stats_register(&klog_drain_lock_stats);
+    tasklet_init(&klog_tasklet, klog_work, 0);
+    klog_ready = true;
+
+    // Whatever was logged before this point
+    tasklet_schedule(&klog_tasklet);
+}
+
+void klog_set_console_level(int level)
+{
+    klog_console_level = level;
+}
+
+void klog_flush(void)
+{
+    // May be called from a fault inside the drain itself
+    klog_drain(false);
+}
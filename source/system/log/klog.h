@@ -0,0 +1,55 @@
+#ifndef K_LOG_KLOG_H
+#define K_LOG_KLOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Kernel log: timestamped records in a lock-free ring that any context may
+// write to, interrupt handlers included. A writer claims a slot with one
+// atomic add and formats straight into it; the console (and its sinks) are
+// fed later by a tasklet, so callers never wait for the screen or the UART.
+// Old records are overwritten once the ring wraps.
+#define KLOG_EMERG      0
+#define KLOG_ALERT      1
+#define KLOG_CRIT       2
+#define KLOG_ERR        3
+#define KLOG_WARNING    4
+#define KLOG_NOTICE     5
+#define KLOG_INFO       6
+#define KLOG_DEBUG      7
+
+#define KLOG_RECORDS        256     // Power of two
+#define KLOG_TEXT_MAX       112     // Terminator included, longer messages are cut
+#define KLOG_LINE_MAX       (KLOG_TEXT_MAX + 24)    // "[sssss.uuuuuu] " + text + "\r\n"
+
+typedef struct
+{
+    volatile uint32_t seq;  // Sequence number + 1 once complete, 0 while being written
+    uint8_t level;
+    uint8_t cpu;
+    uint16_t len;
+    uint64_t time_ns;       // Monotonic
+    char text[KLOG_TEXT_MAX];
+}
+klog_record_t;
+
+void klog_init(void);
+
+void klog(int level, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Records at or above this severity (numerically lower or equal) reach the
+// console, the rest only the ring. KLOG_INFO by default.
+void klog_set_console_level(int level);
+
+// Prints what the tasklet has not yet, right here: for paths that stop the machine
+void klog_flush(void);
+
+// Formats records from *seq on as console lines into buf, as many whole
+// lines as fit, and moves *seq past them. Records already overwritten are
+// skipped. Returns the byte count.
+int klog_read(uint32_t* seq, char* buf, int len);
+
+// Sequence number of the oldest record still in the ring
+uint32_t klog_oldest(void);
+
+#endif
@@ -1,6 +1,12 @@
 #include "physical.h"
+#include "../sync/spinlock.h"
+
+// Guards the bitmap; page faults allocate too, so it is taken with interrupts off
+static lock_stats_t mem_phys_lock_stats = LOCK_STATS_INIT("pmm");
+static spinlock_t mem_phys_lock = SPINLOCK_INIT_STATS(&mem_phys_lock_stats);
 
 static uint8_t  mem_phys_map[PMM_SECTORS / 8];
+static uint8_t  mem_phys_refs[PMM_SECTORS];  // Mappings beyond the owning one, see mem_phys_ref
 static void*    mem_phys_start; /* Start of usable memory */
 static size_t   mem_phys_sectors;
 
@@ -9,14 +15,27 @@ void mem_phys_init(void* start, size_t total_size)
     mem_phys_start = start;
     mem_phys_sectors = total_size / PMM_SECTOR_SIZE;
 
+    if (mem_phys_sectors > PMM_SECTORS)
+        mem_phys_sectors = PMM_SECTORS;
+
     for (size_t i = 0; i < PMM_SECTORS / 8; i++) 
     {
-        mem_phys_map[i] = 0xFF; // All sectors initially free
+        mem_phys_map[i] = 0x00;
     }
+
+    // Only sectors backed by real memory start out free
+    for (size_t i = 0; i < mem_phys_sectors; i++) 
+    {
+        mem_phys_map[i / 8] |= (1 << (i % 8));
+    }
+
+    lock_stats_register(&mem_phys_lock_stats);
 }
 
 void* mem_phys_alloc() 
 {
+    uint32_t flags = spin_lock_irqsave(&mem_phys_lock);
+
     for (int i = 0; i < PMM_SECTORS / 8; ++i) 
     {
         uint8_t c = mem_phys_map[i];
@@ -27,10 +46,13 @@ void* mem_phys_alloc()
             if (c & (1 << b)) 
             {
                 mem_phys_map[i] &= ~(1 << b);
+                spin_unlock_irqrestore(&mem_phys_lock, flags);
                 return (void*)((uintptr_t)mem_phys_start + PMM_SECTOR_SIZE * (i * 8 + b));
             }
         }
     }
+
+    spin_unlock_irqrestore(&mem_phys_lock, flags);
     return 0;
 }
 
@@ -40,6 +62,7 @@ void* mem_phys_alloc_sectors(size_t num_sectors)
         return 0;
 
     size_t max = mem_phys_sectors - num_sectors + 1;
+    uint32_t flags = spin_lock_irqsave(&mem_phys_lock);
 
     for (size_t i = 0; i < max; ++i) 
     {
@@ -69,10 +92,12 @@ void* mem_phys_alloc_sectors(size_t num_sectors)
                 size_t m = index % 8;
                 mem_phys_map[b] &= ~(1 << m);
             }
+            spin_unlock_irqrestore(&mem_phys_lock, flags);
             return (void*)((uintptr_t)mem_phys_start + PMM_SECTOR_SIZE * i);
         }
     }
 
+    spin_unlock_irqrestore(&mem_phys_lock, flags);
     return 0; // No space found
 }
 
@@ -82,5 +107,44 @@ void mem_phys_free(void* addr)
     size_t i = offset / 8;
     size_t b = offset % 8;
 
+    uint32_t flags = spin_lock_irqsave(&mem_phys_lock);
     mem_phys_map[i] |= (1 << b);
+    spin_unlock_irqrestore(&mem_phys_lock, flags);
+}
+
+void mem_phys_free_sectors(void* addr, size_t num_sectors) 
+{
+    size_t offset = ((uintptr_t)addr - (uintptr_t)mem_phys_start) / PMM_SECTOR_SIZE;
+
+    uint32_t flags = spin_lock_irqsave(&mem_phys_lock);
+    for (size_t j = 0; j < num_sectors; ++j) 
+    {
+        size_t index = offset + j;
+        mem_phys_map[index / 8] |= (1 << (index % 8));
+    }
+    spin_unlock_irqrestore(&mem_phys_lock, flags);
+}
+
+bool mem_phys_ref(void* addr) 
+{
+    size_t offset = ((uintptr_t)addr - (uintptr_t)mem_phys_start) / PMM_SECTOR_SIZE;
+
+    uint32_t flags = spin_lock_irqsave(&mem_phys_lock);
+    bool ok = mem_phys_refs[offset] != 0xFF;
+    if (ok)
+        mem_phys_refs[offset]++;
+    spin_unlock_irqrestore(&mem_phys_lock, flags);
+    return ok;
+}
+
+void mem_phys_unref(void* addr) 
+{
+    size_t offset = ((uintptr_t)addr - (uintptr_t)mem_phys_start) / PMM_SECTOR_SIZE;
+
+    uint32_t flags = spin_lock_irqsave(&mem_phys_lock);
+    if (mem_phys_refs[offset])
+        mem_phys_refs[offset]--;
+    else
+        mem_phys_map[offset / 8] |= (1 << (offset % 8));
+    spin_unlock_irqrestore(&mem_phys_lock, flags);
 }
@@ -5,12 +5,18 @@
 #include <stddef.h>
 #include <stdbool.h>
 
-#define PMM_SECTORS 65536
-#define PMM_SECTOR_SIZE 8192
+#define PMM_SECTORS 131072
+#define PMM_SECTOR_SIZE 4096    // One page frame
 
 void mem_phys_init(void* start, size_t total_size);
 void* mem_phys_alloc();
 void* mem_phys_alloc_sectors(size_t num_sectors);
 void mem_phys_free(void* addr);
+void mem_phys_free_sectors(void* addr, size_t num_sectors);
+
+// Shared frames: every extra mapping takes a reference, unref frees the
+// frame once the last one is gone. Fails when the count would overflow.
+bool mem_phys_ref(void* addr);
+void mem_phys_unref(void* addr);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,66 @@
+#include "uaccess.h"
+
+extern const uaccess_extable_entry_t __ex_table_start[];
+extern const uaccess_extable_entry_t __ex_table_end[];
+
+extern size_t uaccess_copy(void* dst, const void* src, size_t len);
+extern int uaccess_strncpy(char* dst, const char* src, size_t max);
+
+bool uaccess_range_ok(const void* uptr, size_t len)
+{
+    uintptr_t addr = (uintptr_t)uptr;
+
+    // One bounds check for the whole range, written to not overflow
+    if (addr < UACCESS_USER_START || addr > UACCESS_USER_END)
+        return false;
+    return len <= UACCESS_USER_END - addr;
+}
+
+size_t copy_from_user(void* dst, const void* usrc, size_t len)
+{
+    if (!uaccess_range_ok(usrc, len))
+        return len;
+    return uaccess_copy(dst, usrc, len);
+}
+
+size_t copy_to_user(void* udst, const void* src, size_t len)
+{
+    if (!uaccess_range_ok(udst, len))
+        return len;
+    return uaccess_copy(udst, src, len);
+}
+
+int strncpy_from_user(char* dst, const char* usrc, size_t max)
+{
+    if (max == 0)
+        return -1;
+
+    // Clamp to the window, the copy stops at the terminator anyway
+    uintptr_t addr = (uintptr_t)usrc;
+    if (addr < UACCESS_USER_START || addr >= UACCESS_USER_END)
+        return -1;
+    if (max > UACCESS_USER_END - addr)
+        max = UACCESS_USER_END - addr;
+
+    int len = uaccess_strncpy(dst, usrc, max);
+    if (len < 0 || (size_t)len >= max)
+        return -1;
+    return len;
+}
+
+bool uaccess_fixup(interrupt_frame_t* frame)
+{
+    // Only kernel mode faults can be fixed up
+    if ((frame->cs & 0x3) != 0)
+        return false;
+
+    for (const uaccess_extable_entry_t* e = __ex_table_start; e < __ex_table_end; e++)
+    {
+        if (e->fault_ip == frame->eip)
+        {
+            frame->eip = e->fixup_ip;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,35 @@
+#ifndef K_MEM_UACCESS_H
+#define K_MEM_UACCESS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "../interrupts/interrupts.h"
+#include "../usermode/usermode.h"
+
+// User accessible window, [start, end)
+#define UACCESS_USER_START  USER_CODE_BASE
+#define UACCESS_USER_END    USER_STACK_TOP
+
+// Exception table entry (emitted by uaccess.asm into .ex_table)
+typedef struct
+{
+    uintptr_t fault_ip;     // Instruction that may fault on user memory
+    uintptr_t fixup_ip;     // Where to resume if it does
+}
+uaccess_extable_entry_t;
+
+bool uaccess_range_ok(const void* uptr, size_t len);
+
+// Both return the number of bytes NOT copied (0 on success)
+size_t copy_from_user(void* dst, const void* usrc, size_t len);
+size_t copy_to_user(void* udst, const void* src, size_t len);
+
+// Returns the string length, or -1 on a bad pointer / missing terminator
+int strncpy_from_user(char* dst, const char* usrc, size_t max);
+
+// Called from the fault path; redirects frame->eip to a fixup if one exists
+bool uaccess_fixup(interrupt_frame_t* frame);
+
+#endif
@@ -1,5 +1,7 @@
 #include "virtual.h"
 #include "physical.h" // for mem_phys_alloc
+#include "../usermode/usermode.h"
+#include "../sync/spinlock.h"
 #include <stdint.h>
 
 static uint8_t mem_virt_map[VMM_TOTAL_SECTORS / 8];
@@ -103,4 +105,234 @@ void mem_virt_free(void* addr)
     mem_virt_map[byte] |= (1 << bit);
     
     // NOTE: optional: unmap_page(addr); unmap_page(addr + 0x1000);
-}*/
\ No newline at end of file
+}*/
+// Guards page table edits in process spaces: the owner's demand faults
+// race with other processes mapping shared pages into it
+static lock_stats_t mem_virt_lock_stats = LOCK_STATS_INIT("vmm");
+static spinlock_t mem_virt_lock = SPINLOCK_INIT_STATS(&mem_virt_lock_stats);
+
+// Kernel page directory, identity maps the whole address space
+static uint32_t mem_virt_kernel_dir[PAGE_DIR_ENTRIES] __attribute__((aligned(PAGE_SIZE)));
+
+static inline void mem_virt_invlpg(void* virt_addr)
+{
+    __asm__ volatile("invlpg (%0)" : : "r"(virt_addr) : "memory");
+}
+
+static void mem_virt_zero_page(void* page)
+{
+    uint32_t* words = (uint32_t*)page;
+    for (int i = 0; i < PAGE_SIZE / 4; i++)
+        words[i] = 0;
+}
+
+bool mem_virt_setup(void)
+{
+    for (uint32_t i = 0; i < PAGE_DIR_ENTRIES; i++)
+    {
+        mem_virt_kernel_dir[i] = (i * PAGE_LARGE_SIZE) | PAGE_LARGE | PAGE_WRITABLE | PAGE_PRESENT;
+    }
+
+    __asm__ volatile(
+        "mov %%cr4, %%eax\n\t"
+        "or $0x10, %%eax\n\t"          // CR4.PSE: allow 4MB pages
+        "mov %%eax, %%cr4\n\t"
+        "mov %0, %%cr3\n\t"
+        "mov %%cr0, %%eax\n\t"
+        "or $0x80010000, %%eax\n\t"    // CR0.PG | CR0.WP (ring 0 honours read-only)
+        "mov %%eax, %%cr0\n\t"
+        :
+        : "r"(mem_virt_kernel_dir)
+        : "eax", "memory"
+    );
+
+    lock_stats_register(&mem_virt_lock_stats);
+    return true;
+}
+
+uint32_t* mem_virt_kernel_space(void)
+{
+    return mem_virt_kernel_dir;
+}
+
+uint32_t* mem_virt_current_space(void)
+{
+    uint32_t cr3;
+    __asm__ volatile("mov %%cr3, %0" : "=r"(cr3));
+    return (uint32_t*)(cr3 & PAGE_FRAME_MASK);
+}
+
+void mem_virt_switch(uint32_t* page_dir)
+{
+    if (mem_virt_current_space() != page_dir)
+        __asm__ volatile("mov %0, %%cr3" : : "r"(page_dir) : "memory");
+}
+
+uint32_t* mem_virt_create_space(void)
+{
+    uint32_t* dir = (uint32_t*)mem_phys_alloc();
+    uint32_t* table = (uint32_t*)mem_phys_alloc();
+    if (!dir || !table)
+    {
+        if (dir) mem_phys_free(dir);
+        if (table) mem_phys_free(table);
+        return 0;
+    }
+
+    for (int i = 0; i < PAGE_DIR_ENTRIES; i++)
+        dir[i] = mem_virt_kernel_dir[i];
+
+    // The user window gets its own (initially empty) page table
+    mem_virt_zero_page(table);
+    dir[PAGE_DIR_INDEX(USER_CODE_BASE)] = (uint32_t)table | PAGE_USER | PAGE_WRITABLE | PAGE_PRESENT;
+    return dir;
+}
+
+void mem_virt_destroy_space(uint32_t* page_dir)
+{
+    for (int i = 0; i < PAGE_DIR_ENTRIES; i++)
+    {
+        // Large pages are the kernel identity map, shared by all spaces
+        uint32_t pde = page_dir[i];
+        if (!(pde & PAGE_PRESENT) || (pde & PAGE_LARGE))
+            continue;
+
+        uint32_t* table = (uint32_t*)(pde & PAGE_FRAME_MASK);
+        for (int j = 0; j < PAGE_DIR_ENTRIES; j++)
+        {
+            uint32_t pte = table[j];
+            if ((pte & PAGE_PRESENT) && !(pte & PAGE_SHARED))
+                mem_phys_unref((void*)(pte & PAGE_FRAME_MASK));
+        }
+        mem_phys_free(table);
+    }
+    mem_phys_free(page_dir);
+}
+
+// Lock held. Returns the PTE slot for virt_addr, allocating the page table
+// if asked to; 0 inside the kernel identity map or without a table.
+static uint32_t* mem_virt_pte(uint32_t* page_dir, void* virt_addr, bool create)
+{
+    uint32_t pde = page_dir[PAGE_DIR_INDEX(virt_addr)];
+    uint32_t* table;
+
+    if (!(pde & PAGE_PRESENT))
+    {
+        if (!create)
+            return 0;
+        table = (uint32_t*)mem_phys_alloc();
+        if (!table)
+            return 0;
+        mem_virt_zero_page(table);
+        page_dir[PAGE_DIR_INDEX(virt_addr)] = (uint32_t)table | PAGE_USER | PAGE_WRITABLE | PAGE_PRESENT;
+    }
+    else if (pde & PAGE_LARGE)
+    {
+        return 0; // Part of the kernel identity map
+    }
+    else
+    {
+        table = (uint32_t*)(pde & PAGE_FRAME_MASK);
+    }
+
+    return &table[PAGE_TABLE_INDEX(virt_addr)];
+}
+
+static bool mem_virt_set(uint32_t* page_dir, void* virt_addr, void* phys_addr, int flags, bool replace)
+{
+    uint32_t irq_flags = spin_lock_irqsave(&mem_virt_lock);
+    uint32_t* pte = mem_virt_pte(page_dir, virt_addr, true);
+    bool ok = pte && (replace || !(*pte & PAGE_PRESENT));
+    if (ok)
+        *pte = ((uint32_t)phys_addr & PAGE_FRAME_MASK) | (flags & 0xFFF) | PAGE_PRESENT;
+    spin_unlock_irqrestore(&mem_virt_lock, irq_flags);
+
+    if (ok && page_dir == mem_virt_current_space())
+        mem_virt_invlpg(virt_addr);
+    return ok;
+}
+
+bool mem_virt_map_in(uint32_t* page_dir, void* virt_addr, void* phys_addr, int flags)
+{
+    return mem_virt_set(page_dir, virt_addr, phys_addr, flags, true);
+}
+
+bool mem_virt_map_new_in(uint32_t* page_dir, void* virt_addr, void* phys_addr, int flags)
+{
+    return mem_virt_set(page_dir, virt_addr, phys_addr, flags, false);
+}
+
+uint32_t mem_virt_unmap_in(uint32_t* page_dir, void* virt_addr)
+{
+    uint32_t irq_flags = spin_lock_irqsave(&mem_virt_lock);
+    uint32_t* pte = mem_virt_pte(page_dir, virt_addr, false);
+    uint32_t old = pte ? *pte : 0;
+    if (pte)
+        *pte = 0;
+    spin_unlock_irqrestore(&mem_virt_lock, irq_flags);
+
+    if ((old & PAGE_PRESENT) && page_dir == mem_virt_current_space())
+        mem_virt_invlpg(virt_addr);
+    return old;
+}
+
+uint32_t mem_virt_query(uint32_t* page_dir, void* virt_addr)
+{
+    uint32_t irq_flags = spin_lock_irqsave(&mem_virt_lock);
+    uint32_t* pte = mem_virt_pte(page_dir, virt_addr, false);
+    uint32_t value = pte ? *pte : 0;
+    spin_unlock_irqrestore(&mem_virt_lock, irq_flags);
+    return value;
+}
+
+bool mem_virt_map_to_phys(void* virt_addr, void* phys_addr, int flags)
+{
+    return mem_virt_map_in(mem_virt_current_space(), virt_addr, phys_addr, flags);
+}
+
+void* mem_virt_resolve(uint32_t* page_dir, void* virt_addr)
+{
+    uint32_t pde = page_dir[PAGE_DIR_INDEX(virt_addr)];
+    if (!(pde & PAGE_PRESENT))
+        return 0;
+    if (pde & PAGE_LARGE)
+        return (void*)((pde & ~(PAGE_LARGE_SIZE - 1)) | ((uint32_t)virt_addr & (PAGE_LARGE_SIZE - 1)));
+
+    uint32_t pte = ((uint32_t*)(pde & PAGE_FRAME_MASK))[PAGE_TABLE_INDEX(virt_addr)];
+    if (!(pte & PAGE_PRESENT))
+        return 0;
+    return (void*)((pte & PAGE_FRAME_MASK) | ((uint32_t)virt_addr & (PAGE_SIZE - 1)));
+}
+
+void mem_virt_mark_mmio(uintptr_t phys_addr)
+{
+    mem_virt_kernel_dir[PAGE_DIR_INDEX(phys_addr)] |= PAGE_NOCACHE | PAGE_WRITETHROUGH;
+    mem_virt_invlpg((void*)phys_addr);
+}
+
+bool mem_virt_handle_fault(interrupt_frame_t* frame)
+{
+    uint32_t addr;
+    __asm__ volatile("mov %%cr2, %0" : "=r"(addr));
+
+    // Protection violations are real faults, only missing pages are filled in
+    if (frame->err_code & PAGE_FAULT_PRESENT)
+        return false;
+    if (addr < USER_CODE_BASE || addr >= USER_STACK_TOP)
+        return false;
+
+    void* page = mem_phys_alloc();
+    if (!page)
+        return false;
+
+    mem_virt_zero_page(page);
+    uint32_t* space = mem_virt_current_space();
+    if (!mem_virt_map_new_in(space, (void*)(addr & PAGE_FRAME_MASK), page, PAGE_USER | PAGE_WRITABLE))
+    {
+        mem_phys_free(page);
+
+        // Someone mapped a shared page there meanwhile, just retry the access
+        return (mem_virt_query(space, (void*)addr) & PAGE_PRESENT) != 0;
+    }
+    return true;
+}
@@ -5,10 +5,27 @@
 #include <stddef.h>
 #include <stdbool.h>
 
+#include "../interrupts/interrupts.h"
+
 #define PAGE_SIZE 4096
 #define PAGE_PRESENT 0x1
 #define PAGE_WRITABLE 0x2
 #define PAGE_USER 0x4
+#define PAGE_WRITETHROUGH 0x8
+#define PAGE_NOCACHE 0x10
+#define PAGE_LARGE 0x80         // 4MB page (PSE), directory entries only
+#define PAGE_SHARED 0x200       // Available bit: frame not owned by the space, never freed with it
+#define PAGE_FRAME_MASK 0xFFFFF000
+
+#define PAGE_DIR_ENTRIES    1024
+#define PAGE_LARGE_SIZE     0x400000
+#define PAGE_DIR_INDEX(a)   ((uint32_t)(a) >> 22)
+#define PAGE_TABLE_INDEX(a) (((uint32_t)(a) >> 12) & 0x3FF)
+
+// Page fault error code bits
+#define PAGE_FAULT_PRESENT  0x1
+#define PAGE_FAULT_WRITE    0x2
+#define PAGE_FAULT_USER     0x4
 
 #define VMM_TOTAL_SECTORS 65536
 #define VMM_SECTOR_SIZE (2 * 4096)
@@ -19,4 +36,32 @@ void* mem_virt_alloc_sectors(size_t num_sectors);
 void mem_virt_free(void* addr);
 bool mem_virt_map_to_phys(void* virt_addr, void* phys_addr, int flags);
 
+// Paging: the kernel space identity maps all 4GB with 4MB pages,
+// every process space shares it except for the user window
+bool mem_virt_setup(void);
+uint32_t* mem_virt_kernel_space(void);
+uint32_t* mem_virt_current_space(void);
+uint32_t* mem_virt_create_space(void);
+// Frees every page table and owned frame of a space, then the directory.
+// It must not be loaded on any CPU.
+void mem_virt_destroy_space(uint32_t* page_dir);
+void mem_virt_switch(uint32_t* page_dir);
+bool mem_virt_map_in(uint32_t* page_dir, void* virt_addr, void* phys_addr, int flags);
+
+// Like mem_virt_map_in, but fails if the page is already mapped
+bool mem_virt_map_new_in(uint32_t* page_dir, void* virt_addr, void* phys_addr, int flags);
+
+// Both return the raw page table entry (0 if there is none); unmap clears it.
+// The frame is left to the caller.
+uint32_t mem_virt_unmap_in(uint32_t* page_dir, void* virt_addr);
+uint32_t mem_virt_query(uint32_t* page_dir, void* virt_addr);
+void* mem_virt_resolve(uint32_t* page_dir, void* virt_addr);
+
+// Makes the identity mapping around a device register block uncached.
+// Must run before process spaces are created, they copy the kernel directory.
+void mem_virt_mark_mmio(uintptr_t phys_addr);
+
+// Demand-allocates user window pages; false if the fault is not ours
+bool mem_virt_handle_fault(interrupt_frame_t* frame);
+
 #endif
@@ -3,40 +3,156 @@
 #include <stdarg.h>
 #include <stdint.h>
 
+#include "../usermode/scheduler.h"
+#include "../lib/format.h"
+#include "../../arch/x86/ports.h"
+
+static lock_stats_t sh_lock_stats = LOCK_STATS_INIT("console");
+
+static void sh_render_locked(shell_instance_t* shell);
+static void sh_flush_locked(shell_instance_t* shell);
+static void sh_clear_locked(shell_instance_t* shell);
+
+// Back buffer row shown on screen line
+static inline size_t sh_row(shell_instance_t* shell, size_t line)
+{
+    return (shell->top + line) % shell->height;
+}
+
 bool sh_init(shell_instance_t* shell, volatile shell_char_t* memory, size_t width, size_t size)
 {
+    // One dirty bit per row, lines are copied out two cells at a time
+    if (size > VGA_WIDTH * VGA_HEIGHT || size / width > SH_MAX_HEIGHT || (width & 1))
+        return false;
+
+    spin_init(&shell->lock);
+    shell->lock.stats = &sh_lock_stats;
+    lock_stats_register(&sh_lock_stats);
+    spin_init(&shell->input_lock);
     shell->memory = memory;
     shell->width = width;
     shell->height = size / width;
     shell->size = size;
     shell->color = 0x07;
     shell->cursor = 0;
+    shell->vga = true;
+    shell->sink = 0;
+    shell->display = 0;
+    shell->scrolled = 0;
+    shell->top = 0;
+    shell->vram_row = 0;
+    shell->vram_shown = 0;
+    shell->vram_rows = SH_VRAM_SIZE / sizeof(shell_char_t) / width;
     
     // Initialize all streams
     for(int i = 0; i < STREAM_COUNT; i++) {
-        shell->streams[i].head = 0;
-        shell->streams[i].tail = 0;
-        shell->streams[i].count = 0;
+        stream_init(&shell->streams[i], shell->stream_data[i], SH_STREAM_SIZE);
+        wait_queue_init(&shell->readers[i]);
     }
+    wait_queue_init(&shell->writers);
     
-    sh_clear(shell);
+    sh_clear_locked(shell);
+    sh_flush_locked(shell);
     return true;
 }
 
+static bool sh_stream_ready(void* ctx)
+{
+    return stream_count((basic_stream_t*)ctx) > 0;
+}
+
+static bool sh_stream_room(void* ctx)
+{
+    return stream_space((basic_stream_t*)ctx) > 0;
+}
+
+// stdin's writer side. Its reader is never behind input_lock, so the
+// lock-free ring is all the two sides share.
+static int sh_write_input(shell_instance_t* shell, const char* buf, int len, bool wait)
+{
+    basic_stream_t* s = &shell->streams[STREAM_STDIN];
+    int written = 0;
+
+    while (written < len)
+    {
+        uint32_t flags = spin_lock_irqsave(&shell->input_lock);
+        int n = stream_write(s, buf + written, len - written);
+        spin_unlock_irqrestore(&shell->input_lock, flags);
+
+        // Keyboard input gives its reader the full interactivity boost
+        if (n > 0)
+        {
+            written += n;
+            wake_up(&shell->readers[STREAM_STDIN], SCHED_WAKE_STDIN);
+            continue;
+        }
+
+        // Full: wait for the reader to make room. The idle thread cannot.
+        if (!wait || !wait_event_timeout(&shell->writers, sh_stream_room, s, WAIT_FOREVER))
+            break;
+    }
+    return written;
+}
+
+int sh_input(shell_instance_t* shell, const char* buf, int len)
+{
+    return sh_write_input(shell, buf, len, false);
+}
+
 int sh_write_stream(shell_instance_t* shell, int stream_idx, const char* buf, int len)
 {
     if (stream_idx < 0 || stream_idx >= STREAM_COUNT) {
         return -1; // Invalid stream index
     }
+    if (stream_idx == STREAM_STDIN)
+        return sh_write_input(shell, buf, len, true);
 
-    // Debug: Print stream buffer contents
+    // Interrupt handlers print too. Rendering empties the ring, so a write
+    // larger than it goes through in ring-sized pieces.
+    uint32_t flags = spin_lock_irqsave(&shell->lock);
     shell->color = 0x07; // Reset to default color
-    int written = stream_write(&shell->streams[stream_idx], buf, len);
-    sh_render(shell);
+    int written = 0;
+    while (written < len)
+    {
+        written += stream_write(&shell->streams[stream_idx], buf + written, len - written);
+        sh_render_locked(shell);
+    }
+    sh_flush_locked(shell);
+    spin_unlock_irqrestore(&shell->lock, flags);
+
+    if (written > 0)
+        wake_up(&shell->readers[stream_idx], 0);
 
     return written;
 }
 
+int sh_read_stream(shell_instance_t* shell, int stream_idx, char* buf, int len)
+{
+    if (stream_idx < 0 || stream_idx >= STREAM_COUNT) {
+        return -1; // Invalid stream index
+    }
+
+    uint32_t flags = spin_lock_irqsave(&shell->lock);
+    int read = stream_read(&shell->streams[stream_idx], buf, len);
+    spin_unlock_irqrestore(&shell->lock, flags);
+
+    if (read > 0 && stream_idx == STREAM_STDIN)
+        wake_up(&shell->writers, 0);
+
+    return read;
+}
+
+int sh_read_stream_wait(shell_instance_t* shell, int stream_idx, char* buf, int len, uint64_t timeout_ns)
+{
+    if (stream_idx < 0 || stream_idx >= STREAM_COUNT) {
+        return -1; // Invalid stream index
+    }
+
+    wait_event_timeout(&shell->readers[stream_idx], sh_stream_ready,
+                       &shell->streams[stream_idx], timeout_ns);
+    return sh_read_stream(shell, stream_idx, buf, len);
+}
+
 int sh_write_stdout(shell_instance_t* shell, const char* buf, int len)
 {
     return sh_write_stream(shell, STREAM_STDOUT, buf, len);
@@ -54,203 +170,260 @@ void sh_putc(shell_instance_t* shell, char c)
 
 void sh_render(shell_instance_t* shell)
 {
-    char buf[64];
-    int bytes;
-    
-    // Process stdout
-    while ((bytes = stream_read(&shell->streams[STREAM_STDOUT], buf, sizeof(buf))) > 0) {
-        for (int i = 0; i < bytes; i++) {
-            char c = buf[i];
-            if (c == '\r') {
-                shell->cursor -= shell->cursor % shell->width;
-            }
-            else if (c == '\n') {
-                shell->cursor += shell->width - (shell->cursor % shell->width);
-                if (shell->cursor >= shell->size) {
-                    sh_scroll(shell);
-                    shell->cursor -= shell->width;
-                }
-            }
-            else if (shell->cursor < shell->size) {
-                shell->memory[shell->cursor] = (shell_char_t){ c, shell->color };
-                shell->cursor++;
-                if (shell->cursor >= shell->size) {
-                    sh_scroll(shell);
-                    shell->cursor -= shell->width;
-                }
-            }
-        }
+    uint32_t flags = spin_lock_irqsave(&shell->lock);
+    sh_render_locked(shell);
+    sh_flush_locked(shell);
+    spin_unlock_irqrestore(&shell->lock, flags);
+}
+
+void sh_set_sink(shell_instance_t* shell, sh_sink_t sink, bool vga)
+{
+    uint32_t flags = spin_lock_irqsave(&shell->lock);
+    shell->sink = sink;
+    shell->vga = vga || !sink;
+    spin_unlock_irqrestore(&shell->lock, flags);
+}
+
+bool sh_set_display(shell_instance_t* shell, const sh_display_t* display)
+{
+    // Screen contents, oldest line first, while the grid changes shape
+    static shell_char_t lines[SH_MAX_WIDTH * SH_MAX_HEIGHT];
+
+    if (!display->width || display->width > SH_MAX_WIDTH ||
+        !display->height || display->height > SH_MAX_HEIGHT)
+        return false;
+
+    uint32_t flags = spin_lock_irqsave(&shell->lock);
+    for (size_t line = 0; line < shell->height; line++)
+    {
+        const shell_char_t* cells = &shell->back[sh_row(shell, line) * shell->width];
+        for (size_t col = 0; col < shell->width; col++)
+            lines[line * shell->width + col] = cells[col];
     }
 
-    // Process stderr (in red)
-    char saved_color = shell->color;
-    shell->color = 0x04; // Red
-    while ((bytes = stream_read(&shell->streams[STREAM_STDERR], buf, sizeof(buf))) > 0) {
-        for (int i = 0; i < bytes; i++) {
-            char c = buf[i];
-            if (c == '\r') {
-                shell->cursor -= shell->cursor % shell->width;
-            }
-            else if (c == '\n') {
-                shell->cursor += shell->width - (shell->cursor % shell->width);
-                if (shell->cursor >= shell->size) {
-                    sh_scroll(shell);
-                    shell->cursor -= shell->width;
-                }
-            }
-            else if (shell->cursor < shell->size) {
-                shell->memory[shell->cursor] = (shell_char_t){ c, shell->color };
-                shell->cursor++;
-                if (shell->cursor >= shell->size) {
-                    sh_scroll(shell);
-                    shell->cursor -= shell->width;
-                }
-            }
-        }
+    // Keep the bottom of the old screen, up to the cursor's line
+    size_t cursor_line = shell->cursor / shell->width;
+    size_t cursor_col = shell->cursor % shell->width;
+    size_t skip = cursor_line >= display->height ? cursor_line - display->height + 1 : 0;
+    size_t old_width = shell->width;
+    size_t old_height = shell->height;
+
+    shell->display = display;
+    shell->width = display->width;
+    shell->height = display->height;
+    shell->size = shell->width * shell->height;
+    shell->top = 0;
+    shell->scrolled = 0;
+    sh_clear_locked(shell);
+
+    for (size_t line = skip; line < old_height && line - skip < shell->height; line++)
+    {
+        for (size_t col = 0; col < old_width && col < shell->width; col++)
+            shell->back[(line - skip) * shell->width + col] = lines[line * old_width + col];
     }
-    shell->color = saved_color;
+    if (cursor_col >= shell->width)
+        cursor_col = shell->width - 1;
+    shell->cursor = (cursor_line - skip) * shell->width + cursor_col;
+
+    sh_flush_locked(shell);
+    spin_unlock_irqrestore(&shell->lock, flags);
+    return true;
+}
+
+void sh_flush(shell_instance_t* shell)
+{
+    uint32_t flags = spin_lock_irqsave(&shell->lock);
+    sh_flush_locked(shell);
+    spin_unlock_irqrestore(&shell->lock, flags);
 }
 
-void sh_scroll(shell_instance_t* shell) 
+// Moves the text up a line: the top row becomes the new, blank bottom one
+static void sh_scroll(shell_instance_t* shell)
 {
-    for (size_t row = 1; row < shell->height; row++) 
+    size_t row = shell->top;
+    shell->top = (shell->top + 1) % shell->height;
+
+    shell_char_t* cells = &shell->back[row * shell->width];
+    for (size_t col = 0; col < shell->width; col++)
+        cells[col] = (shell_char_t){ ' ', shell->color };
+    shell->dirty |= 1ull << row;
+
+    if (shell->display)
     {
-        for (size_t col = 0; col < shell->width; col++) 
-        {
-            size_t dst = (row - 1) * shell->width + col;
-            size_t src = row * shell->width + col;
-            shell->memory[dst] = shell->memory[src];
-        }
+        shell->scrolled++;
+        return;
     }
 
-    size_t last_line = (shell->height - 1) * shell->width;
-    for (size_t col = 0; col < shell->width; col++) 
+    // Out of VRAM below the screen: start over at the top with a full copy
+    shell->vram_row++;
+    if (shell->vram_row + shell->height > shell->vram_rows)
     {
-        shell->memory[last_line + col] = (shell_char_t){ ' ', shell->color };
+        shell->vram_row = 0;
+        shell->dirty = SH_DIRTY_ALL;
     }
 }
 
-void sh_puts(shell_instance_t* shell, const char* str) 
+static void sh_emit(shell_instance_t* shell, char c)
 {
-    while (*str) {
-        sh_putc(shell, *str++);
+    if (c == '\r') {
+        shell->cursor -= shell->cursor % shell->width;
+    }
+    else if (c == '\n') {
+        shell->cursor += shell->width - (shell->cursor % shell->width);
+    }
+    else {
+        size_t row = sh_row(shell, shell->cursor / shell->width);
+        shell->back[row * shell->width + shell->cursor % shell->width] = (shell_char_t){ c, shell->color };
+        shell->dirty |= 1ull << row;
+        shell->cursor++;
+    }
+
+    if (shell->cursor >= shell->size) {
+        sh_scroll(shell);
+        shell->cursor -= shell->width;
     }
 }
 
-void sh_putint(shell_instance_t* shell, int value, int base) 
+static void sh_render_stream(shell_instance_t* shell, int stream_idx)
+{
+    char buf[64];
+    int bytes;
+
+    while ((bytes = stream_read(&shell->streams[stream_idx], buf, sizeof(buf))) > 0) {
+        if (shell->sink)
+            shell->sink(buf, bytes);
+        if (!shell->vga)
+            continue;
+        for (int i = 0; i < bytes; i++)
+            sh_emit(shell, buf[i]);
+    }
+}
+
+static void sh_render_locked(shell_instance_t* shell)
+{
+    sh_render_stream(shell, STREAM_STDOUT);
+
+    // Process stderr (in red)
+    char saved_color = shell->color;
+    shell->color = 0x04; // Red
+    sh_render_stream(shell, STREAM_STDERR);
+    shell->color = saved_color;
+}
+
+static void sh_present_locked(shell_instance_t* shell)
 {
-    char buffer[32];  // Increased buffer size for safety
-    const char* digits = "0123456789abcdef";
-    int i = 0;
-    unsigned int uvalue;
+    const sh_display_t* display = shell->display;
 
-    if (base == 10 && value < 0) 
+    // The pixels move up with the text, only lines that changed are drawn
+    if (shell->scrolled)
     {
-        sh_putc(shell, '-');
-        uvalue = (unsigned int)(-value);
+        if (shell->scrolled < shell->height)
+            display->scroll(shell->scrolled);
+        else
+            shell->dirty = SH_DIRTY_ALL;
+        shell->scrolled = 0;
     }
-    else 
+
+    for (size_t line = 0; line < shell->height && shell->dirty; line++)
     {
-        uvalue = (unsigned int)value;
+        size_t row = sh_row(shell, line);
+        if (!(shell->dirty & (1ull << row)))
+            continue;
+        shell->dirty &= ~(1ull << row);
+        display->draw(line, &shell->back[row * shell->width], shell->width);
     }
+    shell->dirty = 0;
+    display->present();
+}
 
-    if (uvalue == 0) {
-        sh_putc(shell, '0');
+static void sh_flush_locked(shell_instance_t* shell)
+{
+    if (shell->display)
+    {
+        sh_present_locked(shell);
         return;
     }
 
-    while (uvalue && i < (int)sizeof(buffer) - 1)
+    // Whole lines, two cells per store
+    size_t words = shell->width * sizeof(shell_char_t) / sizeof(uint32_t);
+    for (size_t line = 0; line < shell->height && shell->dirty; line++)
     {
-        buffer[i++] = digits[uvalue % base];
-        uvalue /= base;
+        size_t row = sh_row(shell, line);
+        if (!(shell->dirty & (1ull << row)))
+            continue;
+        shell->dirty &= ~(1ull << row);
+
+        const uint32_t* src = (const uint32_t*)&shell->back[row * shell->width];
+        volatile uint32_t* dst = (volatile uint32_t*)&shell->memory[(shell->vram_row + line) * shell->width];
+        for (size_t i = 0; i < words; i++)
+            dst[i] = src[i];
     }
+    shell->dirty = 0;
 
-    while (i > 0) 
+    // Scrolled: show the new window now that its lines are in place
+    if (shell->memory == SH_VRAM && shell->vram_shown != shell->vram_row)
     {
-        sh_putc(shell, buffer[--i]);
+        uint16_t start = (uint16_t)(shell->vram_row * shell->width);
+        outb(VGA_CRTC_INDEX, VGA_CRTC_START_HIGH);
+        outb(VGA_CRTC_DATA, start >> 8);
+        outb(VGA_CRTC_INDEX, VGA_CRTC_START_LOW);
+        outb(VGA_CRTC_DATA, start & 0xFF);
+        shell->vram_shown = shell->vram_row;
     }
 }
 
+void sh_puts(shell_instance_t* shell, const char* str) 
+{
+    int len = 0;
+    while (str[len])
+        len++;
+    sh_write_stdout(shell, str, len);
+}
+
+void sh_putint(shell_instance_t* shell, int value, int base) 
+{
+    // Signed in decimal only, the other bases print the bit pattern
+    char buf[16];
+    int len;
+    if (base == 16)
+        len = ksnprintf(buf, sizeof(buf), "%x", value);
+    else if (base == 8)
+        len = ksnprintf(buf, sizeof(buf), "%o", value);
+    else
+        len = ksnprintf(buf, sizeof(buf), "%d", value);
+    sh_write_stdout(shell, buf, len);
+}
+
 void sh_printf(shell_instance_t* shell, const char* fmt, ...)
 {
+    // Formatted on the stack, then one stream write and one flush
+    char buf[SH_PRINTF_MAX];
     va_list args;
     va_start(args, fmt);
-
-    while (*fmt) 
-    {
-        if (*fmt == '%') 
-        {
-            fmt++;
-            switch (*fmt) 
-            {
-                case 's': 
-                {
-                    const char* s = va_arg(args, const char*);
-                    sh_puts(shell, s ? s : "(null)");
-                    break;
-                }
-                case 'd': 
-                {
-                    int d = va_arg(args, int);
-                    sh_putint(shell, d, 10);
-                    break;
-                }
-                case 'u': 
-                {
-                    unsigned int u = va_arg(args, unsigned int);
-                    sh_putint(shell, u, 10);
-                    break;
-                }
-                case 'x': 
-                {
-                    unsigned int x = va_arg(args, unsigned int);
-                    sh_putint(shell, x, 16);
-                    break;
-                }
-                case 'p': 
-                {
-                    uintptr_t p = (uintptr_t)va_arg(args, void*);
-                    sh_puts(shell, "0x");
-                    sh_putint(shell, p, 16);
-                    break;
-                }
-                case 'c': 
-                {
-                    int c = va_arg(args, int);
-                    sh_putc(shell, (char)c);
-                    break;
-                }
-                case '%': 
-                {
-                    sh_putc(shell, '%');
-                    break;
-                }
-                default: 
-                {
-                    sh_putc(shell, '%');
-                    sh_putc(shell, *fmt);
-                    break;
-                }
-            }
-        }
-        else 
-        {
-            sh_putc(shell, *fmt);
-        }
-        fmt++;
-    }
-
+    int len = kvsnprintf(buf, sizeof(buf), fmt, args);
     va_end(args);
+
+    if (len >= (int)sizeof(buf))
+        len = sizeof(buf) - 1;
+    sh_write_stdout(shell, buf, len);
 }
 
 void sh_clear(shell_instance_t* shell)
+{
+    uint32_t flags = spin_lock_irqsave(&shell->lock);
+    sh_clear_locked(shell);
+    sh_flush_locked(shell);
+    spin_unlock_irqrestore(&shell->lock, flags);
+}
+
+static void sh_clear_locked(shell_instance_t* shell)
 {
     shell->cursor = 0;
 
     for (unsigned int i = 0; i < shell->size; i++)
     {
-        shell->memory[i] = (shell_char_t){ ' ', shell->color };
+        shell->back[i] = (shell_char_t){ ' ', shell->color };
     }
 
-    shell->cursor = 0;
+    shell->dirty = SH_DIRTY_ALL;
 }
\ No newline at end of file
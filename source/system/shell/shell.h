@@ -2,10 +2,18 @@
 #define K_SHELL_H
 
 #include "stream.h"
+#include "../sync/spinlock.h"
+#include "../sync/waitqueue.h"
 
 #define VGA_WIDTH 80
 #define VGA_HEIGHT 25
 
+#define SH_STREAM_SIZE  1024                // Per stream, a power of two
+
+// Largest text grid, a pixel display may have more cells than VGA
+#define SH_MAX_WIDTH    160
+#define SH_MAX_HEIGHT   64                  // One dirty bit per row
+
 #include <stddef.h>
 #include <stdbool.h>
 
@@ -21,29 +29,89 @@ shell_char_t;
 #define STREAM_STDERR   2
 #define STREAM_COUNT    3
 
-typedef struct __attribute__((packed))
+// Receives stdout and stderr as they are rendered, console lock held
+typedef int (*sh_sink_t)(const char* buf, int len);
+
+// Draws the text grid in place of VGA memory, e.g. fbcon. Called with the
+// console lock held and interrupts off, present once per flush.
+typedef struct
+{
+    size_t width, height;                                   // Cells
+    void (*scroll)(size_t lines);                           // Fewer than height
+    void (*draw)(size_t line, const shell_char_t* cells, size_t count);
+    void (*present)(void);
+}
+sh_display_t;
+
+// Text is drawn into a back buffer, whose rows form a ring starting at top,
+// and copied out to VRAM by line when flushed. VRAM holds more rows than the
+// screen: scrolling moves the CRTC start address down one row, and the
+// screen is only copied back to the start once it reaches the end. With a
+// display attached, lines go to it instead and scrolls are batched.
+//
+// The lock covers the output streams, stdin's reader side, the cursor and
+// both buffers. stdin's writers only take input_lock, so input from an
+// interrupt handler never waits behind a flush. Locks, wait queues and
+// streams come first so they stay aligned inside the packed layout.
+typedef struct __attribute__((packed, aligned(4)))
 {
+    spinlock_t lock;
+    spinlock_t input_lock;
+    wait_queue_t readers[STREAM_COUNT];     // Blocked in sh_read_stream_wait
+    wait_queue_t writers;                   // Blocked on a full stdin
+    basic_stream_t streams[STREAM_COUNT];
     volatile shell_char_t* memory;
     size_t size;
-    size_t cursor;
+    size_t cursor;                          // Screen position, not back buffer
     size_t width, height;
     char color;
-    basic_stream_t streams[STREAM_COUNT];
+    bool vga;                               // Render to the screen, off for a headless sink only
+    sh_sink_t sink;                         // Second output, e.g. serial_write
+    const sh_display_t* display;            // Replaces VRAM when set
+    size_t scrolled;                        // Lines scrolled since the display's last flush
+    size_t top;                             // Back buffer row on the first screen line
+    uint64_t dirty;                         // Back buffer rows to copy out, bit per row
+    size_t vram_row;                        // VRAM row on the first screen line
+    size_t vram_shown;                      // CRTC start row last programmed
+    size_t vram_rows;
+    char stream_data[STREAM_COUNT][SH_STREAM_SIZE];
+    shell_char_t back[SH_MAX_WIDTH * SH_MAX_HEIGHT];
 }
 shell_instance_t;
 
 #define SH_VRAM ((volatile shell_char_t*) 0xB8000)
+#define SH_PRINTF_MAX   256                 // Longest sh_printf output, the rest is cut
+#define SH_VRAM_SIZE    0x8000              // Colour text memory, 0xB8000 to 0xBFFFF
+#define SH_DIRTY_ALL    (~0ull)
+
+// CRTC registers, the start address is in cells
+#define VGA_CRTC_INDEX  0x3D4
+#define VGA_CRTC_DATA   0x3D5
+#define VGA_CRTC_START_HIGH 0x0C
+#define VGA_CRTC_START_LOW  0x0D
 
 bool sh_init(shell_instance_t* shell, volatile shell_char_t* memory, size_t width, size_t size);
 
 void sh_putc(shell_instance_t* shell, char c);
 void sh_puts(shell_instance_t* shell, const char* str);
 void sh_putint(shell_instance_t* shell, int value, int base);
-void sh_printf(shell_instance_t* shell, const char* fmt, ...);
+void sh_printf(shell_instance_t* shell, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
 void sh_clear(shell_instance_t* shell);
-void sh_render(shell_instance_t* shell);
+void sh_render(shell_instance_t* shell);    // Drains the output streams and flushes
+void sh_flush(shell_instance_t* shell);     // Copies changed lines out to VRAM or the display
+// Output also goes to sink (0 for none); vga false leaves the screen as it is
+void sh_set_sink(shell_instance_t* shell, sh_sink_t sink, bool vga);
+// Moves the screen to display, text on it so far comes along
+bool sh_set_display(shell_instance_t* shell, const sh_display_t* display);
 int sh_write_stdout(shell_instance_t* shell, const char* buf, int len);
 int sh_write_stderr(shell_instance_t* shell, const char* buf, int len);
+// Loses nothing: output is drained as it goes in, and a writer to a full
+// stdin waits for its reader. Process context for stdin.
 int sh_write_stream(shell_instance_t* shell, int stream_idx, const char* buf, int len);
+// Keyboard and serial input from interrupt context, drops what does not fit
+int sh_input(shell_instance_t* shell, const char* buf, int len);
+int sh_read_stream(shell_instance_t* shell, int stream_idx, char* buf, int len);
+// Blocks until the stream has data (or the timeout passes, WAIT_FOREVER for none)
+int sh_read_stream_wait(shell_instance_t* shell, int stream_idx, char* buf, int len, uint64_t timeout_ns);
 
 #endif
\ No newline at end of file
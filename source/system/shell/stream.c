@@ -1,34 +1,56 @@
 #include "stream.h"
+#include "../lib/mem.h"
+
+bool stream_init(basic_stream_t* s, char* data, uint32_t size)
+{
+    if (!size || (size & (size - 1)))
+        return false;
+
+    s->data = data;
+    s->mask = size - 1;
+    s->head = 0;
+    s->tail = 0;
+    return true;
+}
 
 int stream_write(basic_stream_t* s, const char *buf, int len) 
 {
-    // Ensure we don't write more than buffer size
-    if (len > STREAM_BUF_SIZE - s->count) {
-        len = STREAM_BUF_SIZE - s->count;
-    }
-    
-    int written = 0;
-    while (written < len) 
-    {
-        s->data[s->head] = buf[written];
-        s->head = (s->head + 1) % STREAM_BUF_SIZE;
-        s->count++;
-        written++;
-    }
-    return written;
+    uint32_t n = stream_space(s);
+    if (len <= 0)
+        return 0;
+    if ((uint32_t)len < n)
+        n = len;
+
+    // The acquire in stream_space keeps these stores behind the reader's loads
+    uint32_t head = s->head;
+    uint32_t at = head & s->mask;
+    uint32_t first = s->mask + 1 - at;
+    if (first > n)
+        first = n;
+    kmemcpy(&s->data[at], buf, first);
+    kmemcpy(s->data, buf + first, n - first);
+
+    __atomic_store_n(&s->head, head + n, __ATOMIC_RELEASE);
+    return n;
 }
 
 int stream_read(basic_stream_t* s, char *buf, int len) 
 {
-    int read = 0;
-    while (read < len && s->count > 0) 
-    {
-        if(s->data[read] == '\n')
-            break;
-        buf[read] = s->data[s->tail];
-        s->tail = (s->tail + 1) % STREAM_BUF_SIZE;
-        s->count--;
-        read++;
-    }
-    return read;
-}
\ No newline at end of file
+    uint32_t n = stream_count(s);
+    if (len <= 0)
+        return 0;
+    if ((uint32_t)len < n)
+        n = len;
+
+    uint32_t tail = s->tail;
+    uint32_t at = tail & s->mask;
+    uint32_t first = s->mask + 1 - at;
+    if (first > n)
+        first = n;
+    kmemcpy(buf, &s->data[at], first);
+    kmemcpy(buf + first, s->data, n - first);
+
+    // Loads done before the writer may reuse the space
+    __atomic_store_n(&s->tail, tail + n, __ATOMIC_RELEASE);
+    return n;
+}
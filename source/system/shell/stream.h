@@ -1,18 +1,43 @@
 #ifndef K_STREAM_H
 #define K_STREAM_H
 
-#define STREAM_BUF_SIZE 1024
+#include <stdint.h>
+#include <stdbool.h>
 
-typedef struct __attribute__((packed))
+// Byte ring over storage the owner provides, sized a power of two. head and
+// tail are free-running byte counts masked on access, so a full ring needs
+// no separate count, and a transfer is at most two block copies: up to the
+// end of the storage, then on from its start.
+//
+// One writer and one reader may run at the same time without a lock: the
+// writer publishes head once the bytes are in place and only the reader
+// moves tail. Several writers, or several readers, serialize among themselves.
+typedef struct
 {
-    char data[STREAM_BUF_SIZE];
-    int head;  // write pointer
-    int tail;  // read pointer
-    int count; // number of bytes in buffer
+    char* data;
+    uint32_t mask;              // Size - 1
+    volatile uint32_t head;     // Bytes written so far, writer only
+    volatile uint32_t tail;     // Bytes read so far, reader only
 }
 basic_stream_t;
 
+// False unless size is a power of two
+bool stream_init(basic_stream_t* s, char* data, uint32_t size);
+
+// Bytes the reader can take
+static inline uint32_t stream_count(const basic_stream_t* s)
+{
+    return __atomic_load_n(&s->head, __ATOMIC_ACQUIRE) - s->tail;
+}
+
+// Bytes the writer can add
+static inline uint32_t stream_space(const basic_stream_t* s)
+{
+    return s->mask + 1 - (s->head - __atomic_load_n(&s->tail, __ATOMIC_ACQUIRE));
+}
+
+// Both copy what they can and return how much that was, neither waits
 int stream_write(basic_stream_t* s, const char* buf, int len);
 int stream_read(basic_stream_t* s, char* buf, int len);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,152 @@
+#include "smp.h"
+#include "../acpi/acpi.h"
+#include "../interrupts/apic.h"
+#include "../interrupts/interrupts.h"
+#include "../memory/physical.h"
+#include "../memory/virtual.h"
+#include "../time/clock.h"
+#include "../time/timer.h"
+#include "../usermode/scheduler.h"
+#include "../usermode/fpu.h"
+#include "../../arch/x86/cpu.h"
+
+extern uint8_t ap_trampoline_start[];
+extern uint8_t ap_trampoline_params[];
+extern uint8_t ap_trampoline_end[];
+
+static cpu_t smp_cpus[SMP_MAX_CPUS];
+static volatile uint32_t smp_online = 1;
+
+static int_action_t smp_resched_action;
+
+static void smp_load_percpu(void)
+{
+    __asm__ volatile("mov %0, %%gs" : : "r"((uint32_t)GDT_PERCPU_SEL));
+}
+
+static bool smp_resched_interrupt(interrupt_frame_t* frame, void* ctx)
+{
+    // Nothing to do here, the interrupt exit path looks at the run queue
+    (void)frame;
+    (void)ctx;
+    return true;
+}
+
+static void smp_ap_entry(cpu_t* cpu)
+{
+    // Own GDT (same segments, own TSS and per-CPU base), shared IDT.
+    // gdt_load resets GS, nothing before this point may touch per-CPU data.
+    gdt_load((uint32_t)&cpu->gdt_ptr);
+    smp_load_percpu();
+    __asm__ volatile ("ltr %%ax" : : "a" (GDT_TSS_SEL));
+    idt_install();
+    apic_init_ap();
+    fpu_init_cpu();
+
+    sched_init_cpu(cpu->id);
+
+    __sync_fetch_and_add(&smp_online, 1);
+    cpu->online = true;
+
+    __asm__ volatile("sti");
+    sched_idle_loop();
+}
+
+static bool smp_start_ap(cpu_t* cpu)
+{
+    uint8_t* stack = mem_phys_alloc_sectors(SMP_AP_STACK_SIZE / PMM_SECTOR_SIZE);
+    if (!stack)
+        return false;
+    cpu->stack_top = (uintptr_t)stack + SMP_AP_STACK_SIZE;
+
+    gdt_clone(cpu->gdt, &cpu->gdt_ptr);
+    gdt_set_percpu_base(cpu->gdt, (uint32_t)cpu);
+    tss_setup_in(&cpu->tss, cpu->gdt);
+    tss_register_cpu(cpu->id, &cpu->tss);
+
+    smp_trampoline_params_t* params = (smp_trampoline_params_t*)
+        (SMP_TRAMPOLINE_BASE + (ap_trampoline_params - ap_trampoline_start));
+    params->cr3 = (uint32_t)mem_virt_kernel_space();
+    params->stack = cpu->stack_top;
+    params->entry = (uint32_t)smp_ap_entry;
+    params->arg = (uint32_t)cpu;
+
+    // INIT, then two STARTUPs pointing at the trampoline page
+    apic_send_ipi(cpu->apic_id, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT);
+    timer_sleep_ns(10000000);
+    for (int i = 0; i < 2 && !cpu->online; i++)
+    {
+        apic_send_ipi(cpu->apic_id, LAPIC_ICR_STARTUP | (SMP_TRAMPOLINE_BASE >> 12));
+        timer_sleep_ns(200000);
+    }
+
+    uint64_t deadline = clock_monotonic_ns() + SMP_AP_START_TIMEOUT_NS;
+    while (!cpu->online && clock_monotonic_ns() < deadline)
+        timer_sleep_ns(1000000);
+
+    return cpu->online;
+}
+
+void smp_init_bsp(void)
+{
+    cpu_t* bsp = &smp_cpus[0];
+    bsp->self = bsp;
+    bsp->id = 0;
+    bsp->online = true;
+
+    gdt_set_percpu_base(0, (uint32_t)bsp);
+    smp_load_percpu();
+}
+
+void smp_init(void)
+{
+    cpu_t* bsp = &smp_cpus[0];
+
+    const acpi_madt_info_t* info = acpi_madt();
+    if (!apic_enabled() || !info->present || info->cpu_count < 2)
+        return;
+
+    bsp->apic_id = apic_local_id();
+
+    int_setup_action(&smp_resched_action, smp_resched_interrupt, 0, "resched");
+    int_register(SMP_RESCHED_VECTOR, &smp_resched_action, INT_FLAG_EOI);
+
+    // The trampoline is copied once, only its parameter block changes per AP
+    uint8_t* base = (uint8_t*)SMP_TRAMPOLINE_BASE;
+    for (uint32_t i = 0; i < (uint32_t)(ap_trampoline_end - ap_trampoline_start); i++)
+        base[i] = ap_trampoline_start[i];
+
+    uint32_t next = 1;
+    for (uint32_t i = 0; i < info->cpu_count && next < SMP_MAX_CPUS; i++)
+    {
+        uint8_t apic_id = info->cpu_apic_ids[i];
+        if (apic_id == bsp->apic_id)
+            continue;
+
+        cpu_t* cpu = &smp_cpus[next];
+        cpu->self = cpu;
+        cpu->id = next;
+        cpu->apic_id = apic_id;
+
+        // A CPU that never answers keeps its slot unused
+        if (smp_start_ap(cpu))
+            next++;
+    }
+}
+
+uint32_t smp_cpu_count(void)
+{
+    return smp_online;
+}
+
+cpu_t* smp_cpu(uint32_t id)
+{
+    return id < SMP_MAX_CPUS ? &smp_cpus[id] : 0;
+}
+
+void smp_send_ipi(uint32_t cpu, uint8_t vector)
+{
+    if (cpu >= SMP_MAX_CPUS || !smp_cpus[cpu].online)
+        return;
+    apic_send_ipi(smp_cpus[cpu].apic_id, LAPIC_ICR_FIXED | LAPIC_ICR_ASSERT | vector);
+}
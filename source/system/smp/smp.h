@@ -0,0 +1,71 @@
+#ifndef K_SMP_H
+#define K_SMP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "../../boot/gdt/gdt.h"
+#include "../../boot/idt/idt.h"
+
+#define SMP_MAX_CPUS            16          // Matches ACPI_MAX_CPUS
+#define SMP_TRAMPOLINE_BASE     0x8000      // Real mode start page, below 1MB
+#define SMP_AP_STACK_SIZE       0x4000      // Boot / idle stack of each AP
+#define SMP_RESCHED_VECTOR      0x41        // IPI: look at the run queue again
+#define SMP_AP_START_TIMEOUT_NS 100000000   // 100ms per AP
+
+// Parameter block at ap_trampoline_params (see ap_trampoline.asm)
+typedef struct __attribute__((packed))
+{
+    uint32_t cr3;
+    uint32_t stack;
+    uint32_t entry;
+    uint32_t arg;
+}
+smp_trampoline_params_t;
+
+struct process;
+
+// Per-CPU area. GS is based here in the kernel (GDT_PERCPU_SEL, reloaded on
+// every interrupt entry), so this_cpu() and the fields below cost one load.
+typedef struct cpu
+{
+    struct cpu* self;           // %gs:0
+    uint32_t id;                // Index in smp_cpus, 0 is the BSP
+    struct process* current;    // See proc_current
+    uint32_t int_depth;         // Hardware interrupt nesting, see interrupt_handler
+    struct process* fpu_owner;  // Whose FPU state the registers hold, see fpu.h
+    uint8_t apic_id;
+    volatile bool online;
+    uintptr_t stack_top;        // Boot stack, the idle task keeps running on it
+    gdt_entry_t gdt[GDT_ENTRIES_COUNT] __attribute__((aligned(8)));
+    gdt_ptr_t gdt_ptr;
+    tss_entry_t tss;
+}
+cpu_t;
+
+// Right after gdt_setup, before anything reads per-CPU data
+void smp_init_bsp(void);
+void smp_init(void);
+
+static inline cpu_t* this_cpu(void)
+{
+    cpu_t* cpu;
+    __asm__ volatile("mov %%gs:0, %0" : "=r"(cpu));
+    return cpu;
+}
+
+static inline uint32_t smp_cpu_id(void)
+{
+    uint32_t id;
+    __asm__ volatile("mov %%gs:%c1, %0" : "=r"(id) : "i"(offsetof(cpu_t, id)));
+    return id;
+}
+
+uint32_t smp_cpu_count(void);
+cpu_t* smp_cpu(uint32_t id);
+
+// Fixed-vector IPI to one CPU
+void smp_send_ipi(uint32_t cpu, uint8_t vector);
+
+#endif
@@ -0,0 +1,165 @@
+#include "futex.h"
+#include "spinlock.h"
+#include "waitqueue.h"
+#include "../usermode/processes.h"
+#include "../memory/uaccess.h"
+#include "../memory/virtual.h"
+
+// A sleeper, on its kernel stack while queued on a bucket
+typedef struct futex_waiter
+{
+    struct futex_waiter* next;
+    uintptr_t key;
+    volatile bool woken;        // Taken off the bucket by a waker
+}
+futex_waiter_t;
+
+// Keys that hash together share the queue, wakers pick their own waiters
+// off the list and the rest re-check and go back to sleep
+typedef struct
+{
+    spinlock_t lock;
+    futex_waiter_t* head;
+    wait_queue_t wait;
+}
+futex_bucket_t;
+
+static lock_stats_t futex_lock_stats = LOCK_STATS_INIT("futex");
+static futex_bucket_t futex_table[FUTEX_HASH_SIZE];
+
+void futex_init(void)
+{
+    for (int i = 0; i < FUTEX_HASH_SIZE; i++)
+    {
+        spin_init(&futex_table[i].lock);
+        futex_table[i].lock.stats = &futex_lock_stats;
+        futex_table[i].head = 0;
+        wait_queue_init(&futex_table[i].wait);
+    }
+    lock_stats_register(&futex_lock_stats);
+}
+
+static futex_bucket_t* futex_bucket(uintptr_t key)
+{
+    // Fibonacci hashing, words in the same line still spread out
+    return &futex_table[((key >> 2) * 0x9E3779B1u) >> (32 - FUTEX_HASH_BITS)];
+}
+
+// Physical address of the word in the current space, 0 if it is not
+// mapped. Faults it in first, an untouched page reads as zero.
+static uintptr_t futex_key(uintptr_t uaddr)
+{
+    if ((uaddr & 3) || !uaccess_range_ok((const void*)uaddr, sizeof(uint32_t)))
+        return 0;
+
+    process_t* proc = proc_current();
+    uint32_t pte = mem_virt_query(proc->page_dir, (void*)uaddr);
+    if (!(pte & PAGE_PRESENT))
+    {
+        uint32_t value;
+        if (copy_from_user(&value, (const void*)uaddr, sizeof(value)) != 0)
+            return 0;
+        pte = mem_virt_query(proc->page_dir, (void*)uaddr);
+        if (!(pte & PAGE_PRESENT))
+            return 0;
+    }
+    return (pte & PAGE_FRAME_MASK) | (uaddr & (PAGE_SIZE - 1));
+}
+
+// Bucket lock held
+static void futex_unlink(futex_bucket_t* bucket, futex_waiter_t* waiter)
+{
+    futex_waiter_t** link = &bucket->head;
+    while (*link && *link != waiter)
+        link = &(*link)->next;
+    if (*link)
+        *link = waiter->next;
+}
+
+static bool futex_woken(void* ctx)
+{
+    return ((futex_waiter_t*)ctx)->woken;
+}
+
+int32_t futex_wait(uintptr_t uaddr, uint32_t val, uint64_t timeout_ns)
+{
+    futex_waiter_t waiter;
+    futex_bucket_t* bucket;
+    uint32_t flags;
+
+    while (1)
+    {
+        uintptr_t key = futex_key(uaddr);
+        if (!key)
+            return FUTEX_ERR_FAULT;
+
+        bucket = futex_bucket(key);
+        flags = spin_lock_irqsave(&bucket->lock);
+
+        // A grant or exec may have moved the page since the lookup
+        uint32_t pte = mem_virt_query(proc_current()->page_dir, (void*)uaddr);
+        if ((pte & PAGE_PRESENT) && (pte & PAGE_FRAME_MASK) == (key & PAGE_FRAME_MASK))
+        {
+            waiter.key = key;
+            break;
+        }
+        spin_unlock_irqrestore(&bucket->lock, flags);
+    }
+
+    // Through the identity map, the page is pinned by the mapping we just checked
+    if (*(volatile uint32_t*)waiter.key != val)
+    {
+        spin_unlock_irqrestore(&bucket->lock, flags);
+        return FUTEX_ERR_AGAIN;
+    }
+
+    // Oldest first, FUTEX_WAKE of one hands over in arrival order
+    futex_waiter_t** link = &bucket->head;
+    while (*link)
+        link = &(*link)->next;
+    waiter.woken = false;
+    waiter.next = 0;
+    *link = &waiter;
+    spin_unlock_irqrestore(&bucket->lock, flags);
+
+    wait_event_timeout(&bucket->wait, futex_woken, &waiter, timeout_ns);
+
+    // A wake racing with the timeout still counts
+    flags = spin_lock_irqsave(&bucket->lock);
+    bool woken = waiter.woken;
+    if (!woken)
+        futex_unlink(bucket, &waiter);
+    spin_unlock_irqrestore(&bucket->lock, flags);
+    return woken ? FUTEX_OK : FUTEX_ERR_TIMEOUT;
+}
+
+int32_t futex_wake(uintptr_t uaddr, uint32_t count)
+{
+    uintptr_t key = futex_key(uaddr);
+    if (!key)
+        return FUTEX_ERR_FAULT;
+
+    futex_bucket_t* bucket = futex_bucket(key);
+    int32_t woken = 0;
+
+    uint32_t flags = spin_lock_irqsave(&bucket->lock);
+    futex_waiter_t** link = &bucket->head;
+    while (*link && (uint32_t)woken < count)
+    {
+        futex_waiter_t* waiter = *link;
+        if (waiter->key != key)
+        {
+            link = &waiter->next;
+            continue;
+        }
+
+        *link = waiter->next;
+        waiter->woken = true;
+        woken++;
+    }
+    spin_unlock_irqrestore(&bucket->lock, flags);
+
+    if (woken)
+        wake_up(&bucket->wait, 0);
+    return woken;
+}
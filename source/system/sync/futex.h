@@ -0,0 +1,30 @@
+#ifndef K_SYNC_FUTEX_H
+#define K_SYNC_FUTEX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Fast user-space mutexes: user code keeps its lock word in its own memory
+// and only enters the kernel to sleep on it or to wake sleepers, i.e. under
+// contention. Waiters are keyed by the physical address of the word, so
+// threads of one process and processes sharing the page (shm_map) meet on
+// the same key.
+#define FUTEX_WAIT          0   // Sleep if the word still holds val
+#define FUTEX_WAKE          1   // Wake up to val sleepers, returns how many
+
+#define FUTEX_HASH_BITS     6
+#define FUTEX_HASH_SIZE     (1 << FUTEX_HASH_BITS)
+
+#define FUTEX_OK            0
+#define FUTEX_ERR_FAULT     -1  // Unaligned or not a user address
+#define FUTEX_ERR_AGAIN     -2  // Word no longer held the expected value
+#define FUTEX_ERR_TIMEOUT   -3
+
+void futex_init(void);
+
+// The word is read under the bucket lock, a FUTEX_WAKE after the change
+// in user space cannot slip in before we are queued
+int32_t futex_wait(uintptr_t uaddr, uint32_t val, uint64_t timeout_ns);
+int32_t futex_wake(uintptr_t uaddr, uint32_t count);
+
+#endif
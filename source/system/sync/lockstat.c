@@ -0,0 +1,100 @@
+#include "lockstat.h"
+#include "spinlock.h"
+#include "../shell/shell.h"
+#include "../time/clock.h"
+#include "../lib/math64.h"
+#include "../../arch/x86/cpu.h"
+
+extern shell_instance_t* g_kernel_shell;
+
+static lock_stats_t* lock_stats_head = 0;
+static spinlock_t lock_stats_lock = SPINLOCK_INIT;
+
+static uint32_t lock_stats_sat32(uint64_t value)
+{
+    return value > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)value;
+}
+
+uint64_t lock_stats_now(void)
+{
+    return clock_has_tsc() ? rdtsc() : 0;
+}
+
+void lock_stats_acquired(lock_stats_t* stats, uint64_t spin_start)
+{
+    uint64_t now = lock_stats_now();
+
+    stats->acquired++;
+    if (spin_start)
+    {
+        stats->contended++;
+        stats->spin_cycles += now - spin_start;
+    }
+    stats->hold_start = now;
+}
+
+void lock_stats_released(lock_stats_t* stats)
+{
+    uint64_t held = lock_stats_now() - stats->hold_start;
+
+    stats->hold_cycles += held;
+    if (held > stats->max_hold_cycles)
+        stats->max_hold_cycles = held;
+}
+
+void lock_stats_register(lock_stats_t* stats)
+{
+    uint32_t flags = spin_lock_irqsave(&lock_stats_lock);
+
+    // Shared stats (one per lock class) may be registered more than once
+    lock_stats_t* it = lock_stats_head;
+    while (it && it != stats)
+        it = it->next;
+    if (!it)
+    {
+        stats->next = lock_stats_head;
+        lock_stats_head = stats;
+    }
+
+    spin_unlock_irqrestore(&lock_stats_lock, flags);
+}
+
+void lock_stats_reset(void)
+{
+    // Racy against concurrent holders, good enough to start a measurement
+    uint32_t flags = spin_lock_irqsave(&lock_stats_lock);
+    for (lock_stats_t* stats = lock_stats_head; stats; stats = stats->next)
+    {
+        stats->acquired = 0;
+        stats->contended = 0;
+        stats->spin_cycles = 0;
+        stats->hold_cycles = 0;
+        stats->max_hold_cycles = 0;
+    }
+    spin_unlock_irqrestore(&lock_stats_lock, flags);
+}
+
+void lock_stats_dump(void)
+{
+    if (!g_kernel_shell)
+        return;
+
+    // Printing takes the console lock, walk the list without holding ours,
+    // entries are only ever prepended
+    sh_puts(g_kernel_shell, "ACQUIRED   CONTENDED  AVG SPIN   AVG HOLD   MAX HOLD   NAME\r\n");
+    for (lock_stats_t* stats = lock_stats_head; stats; stats = stats->next)
+    {
+        if (!stats->acquired)
+            continue;
+
+        // Divisors are saturated to 32 bits, the columns are not
+        uint32_t acquired = lock_stats_sat32(stats->acquired);
+        uint32_t contended = lock_stats_sat32(stats->contended);
+        uint64_t avg_spin = contended ? udiv64_32(stats->spin_cycles, contended, 0) : 0;
+        uint64_t avg_hold = udiv64_32(stats->hold_cycles, acquired, 0);
+
+        sh_printf(g_kernel_shell, "%-10llu %-10llu %-10llu %-10llu %-10llu %s\r\n",
+                  stats->acquired, stats->contended, avg_spin, avg_hold,
+                  stats->max_hold_cycles, stats->name);
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef K_SYNC_LOCKSTAT_H
+#define K_SYNC_LOCKSTAT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Optional per-lock statistics. A lock created with one of the *_INIT_STATS
+// initializers counts acquisitions, how often and how long it was spun on,
+// and how long it was held (TSC cycles, zero without a TSC). All fields are
+// updated by the lock holder only, so no atomics are needed. Locks without
+// stats pay a single pointer test.
+typedef struct lock_stats
+{
+    struct lock_stats* next;    // Registry link, see lock_stats_register
+    const char* name;
+    uint64_t acquired;
+    uint64_t contended;         // Acquisitions that had to spin
+    uint64_t spin_cycles;
+    uint64_t hold_cycles;
+    uint64_t max_hold_cycles;
+    uint64_t hold_start;        // Valid while held
+}
+lock_stats_t;
+
+#define LOCK_STATS_INIT(lock_name)  { 0, (lock_name), 0, 0, 0, 0, 0, 0 }
+
+uint64_t lock_stats_now(void);
+
+// Called by the lock primitives with the lock held; spin_start is 0 for an
+// uncontended acquisition
+void lock_stats_acquired(lock_stats_t* stats, uint64_t spin_start);
+void lock_stats_released(lock_stats_t* stats);
+
+// Once per lock, makes it show up in lock_stats_dump
+void lock_stats_register(lock_stats_t* stats);
+void lock_stats_reset(void);
+void lock_stats_dump(void);
+
+#endif
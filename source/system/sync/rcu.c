@@ -0,0 +1,182 @@
+#include "rcu.h"
+#include "spinlock.h"
+#include "../interrupts/softirq.h"
+#include "../smp/smp.h"
+#include "../usermode/processes.h"
+#include "../usermode/scheduler.h"
+
+// A callback list with a tail pointer
+typedef struct
+{
+    rcu_head_t* head;
+    rcu_head_t** tail;
+}
+rcu_list_t;
+
+static lock_stats_t rcu_lock_stats = LOCK_STATS_INIT("rcu");
+static spinlock_t rcu_lock = SPINLOCK_INIT_STATS(&rcu_lock_stats);
+
+// CPUs that still have to pass a quiescent state in the current grace
+// period. Read without the lock on the fast path of rcu_qs.
+static volatile uint32_t rcu_pending_mask = 0;
+static bool rcu_gp_active = false;
+static uint32_t rcu_gp_ticks = 0;
+
+static rcu_list_t rcu_next;     // Queued, waiting for a grace period to start
+static rcu_list_t rcu_wait;     // Waiting for the current grace period
+static rcu_list_t rcu_done;     // Ready to run
+
+static void rcu_list_init(rcu_list_t* list)
+{
+    list->head = 0;
+    list->tail = &list->head;
+}
+
+static void rcu_list_splice(rcu_list_t* dst, rcu_list_t* src)
+{
+    if (!src->head)
+        return;
+    *dst->tail = src->head;
+    dst->tail = src->tail;
+    rcu_list_init(src);
+}
+
+// Lock held
+static void rcu_kick_pending(void)
+{
+    uint32_t self = smp_cpu_id();
+    for (uint32_t mask = rcu_pending_mask; mask; mask &= mask - 1)
+    {
+        uint32_t cpu = (uint32_t)__builtin_ctz(mask);
+        if (cpu != self)
+            smp_send_ipi(cpu, SMP_RESCHED_VECTOR);
+    }
+}
+
+// Lock held, rcu_next not empty
+static void rcu_start_gp(void)
+{
+    rcu_list_splice(&rcu_wait, &rcu_next);
+    rcu_gp_active = true;
+    rcu_gp_ticks = 0;
+
+    // Halted CPUs would never report, wake them right away. The IPI lands
+    // them in the idle loop or on a user return, both quiescent.
+    __sync_synchronize();
+    rcu_pending_mask = (smp_cpu_count() >= 32) ? 0xFFFFFFFF : (1u << smp_cpu_count()) - 1;
+    rcu_kick_pending();
+}
+
+// Lock held, the last CPU just reported
+static void rcu_end_gp(void)
+{
+    rcu_list_splice(&rcu_done, &rcu_wait);
+    rcu_gp_active = false;
+
+    if (rcu_next.head)
+        rcu_start_gp();
+
+    softirq_raise(SOFTIRQ_RCU);
+}
+
+static void rcu_softirq(void)
+{
+    uint32_t flags = spin_lock_irqsave(&rcu_lock);
+    rcu_head_t* list = rcu_done.head;
+    rcu_list_init(&rcu_done);
+    spin_unlock_irqrestore(&rcu_lock, flags);
+
+    while (list)
+    {
+        rcu_head_t* head = list;
+        list = list->next;
+        head->func(head);
+    }
+}
+
+void rcu_init(void)
+{
+    rcu_list_init(&rcu_next);
+    rcu_list_init(&rcu_wait);
+    rcu_list_init(&rcu_done);
+    lock_stats_register(&rcu_lock_stats);
+    softirq_register(SOFTIRQ_RCU, rcu_softirq);
+}
+
+void rcu_qs(void)
+{
+    uint32_t bit = 1u << smp_cpu_id();
+
+    // Fast path: nothing asked of this CPU
+    if (!(rcu_pending_mask & bit))
+        return;
+
+    uint32_t flags = spin_lock_irqsave(&rcu_lock);
+    if (rcu_pending_mask & bit)
+    {
+        rcu_pending_mask &= ~bit;
+        if (!rcu_pending_mask)
+            rcu_end_gp();
+    }
+    spin_unlock_irqrestore(&rcu_lock, flags);
+}
+
+void rcu_tick(void)
+{
+    if (!rcu_pending_mask)
+        return;
+
+    uint32_t flags = spin_lock_irqsave(&rcu_lock);
+    if (rcu_gp_active && ++rcu_gp_ticks >= RCU_KICK_TICKS)
+    {
+        rcu_gp_ticks = 0;
+        rcu_kick_pending();
+    }
+    spin_unlock_irqrestore(&rcu_lock, flags);
+}
+
+void call_rcu(rcu_head_t* head, void (*func)(rcu_head_t* head))
+{
+    head->next = 0;
+    head->func = func;
+
+    uint32_t flags = spin_lock_irqsave(&rcu_lock);
+    *rcu_next.tail = head;
+    rcu_next.tail = &head->next;
+    if (!rcu_gp_active)
+        rcu_start_gp();
+    spin_unlock_irqrestore(&rcu_lock, flags);
+}
+
+typedef struct
+{
+    rcu_head_t head;
+    volatile bool done;
+}
+rcu_sync_t;
+
+static void rcu_sync_done(rcu_head_t* head)
+{
+    ((rcu_sync_t*)head)->done = true;
+}
+
+void synchronize_rcu(void)
+{
+    rcu_sync_t sync;
+    sync.done = false;
+    call_rcu(&sync.head, rcu_sync_done);
+
+    while (!sync.done)
+    {
+        // The caller is outside any read section, so is this CPU
+        rcu_qs();
+        softirq_run();
+        if (sync.done)
+            break;
+
+        if (proc_current())
+            sched_sleep_ns(RCU_SYNC_POLL_NS);
+        else
+            __asm__ volatile("pause");
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef K_SYNC_RCU_H
+#define K_SYNC_RCU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Quiescent-state-based RCU. Kernel code is never preempted, so a read-side
+// section costs nothing beyond a compiler barrier: a CPU cannot be inside
+// one while it switches processes, returns to user mode or idles, and each
+// of those points reports a quiescent state. A grace period ends once every
+// CPU that was busy when it started has passed one; callbacks queued before
+// it started then run from SOFTIRQ_RCU.
+//
+// Read sections must not sleep. Writers publish with rcu_assign_pointer and
+// retire the old version with call_rcu or synchronize_rcu.
+#define RCU_KICK_TICKS          2       // Ticks before lagging CPUs get an IPI
+#define RCU_SYNC_POLL_NS        1000000 // synchronize_rcu sleeps this long per check
+
+typedef struct rcu_head
+{
+    struct rcu_head* next;
+    void (*func)(struct rcu_head* head);
+}
+rcu_head_t;
+
+static inline void rcu_read_lock(void)
+{
+    __asm__ volatile("" : : : "memory");
+}
+
+static inline void rcu_read_unlock(void)
+{
+    __asm__ volatile("" : : : "memory");
+}
+
+// Stores are not reordered with older stores on x86, a compiler barrier
+// is enough to order the initialisation before the publication
+#define rcu_assign_pointer(ptr, value) \
+    do { __asm__ volatile("" : : : "memory"); (ptr) = (value); } while (0)
+
+#define rcu_dereference(ptr) (*(__typeof__(ptr) volatile*)&(ptr))
+
+void rcu_init(void);
+
+// This CPU holds no RCU references (context switch, user return, idle loop)
+void rcu_qs(void);
+
+// From the periodic tick, nudges CPUs that hold up a grace period
+void rcu_tick(void);
+
+void call_rcu(rcu_head_t* head, void (*func)(rcu_head_t* head));
+
+// Process context (or the boot thread), never inside a read section
+void synchronize_rcu(void);
+
+#endif
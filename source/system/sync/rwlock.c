@@ -0,0 +1,38 @@
+#include "rwlock.h"
+
+void read_lock_contended(rwlock_t* lock)
+{
+    while (1)
+    {
+        uint32_t value = lock->value;
+        if (!(value & (RWLOCK_WRITER | RWLOCK_PENDING)) &&
+            __sync_bool_compare_and_swap(&lock->value, value, value + 1))
+            return;
+        __asm__ volatile("pause");
+    }
+}
+
+void write_lock_contended(rwlock_t* lock)
+{
+    uint64_t start = lock->stats ? lock_stats_now() | 1 : 0;
+
+    while (1)
+    {
+        uint32_t value = lock->value;
+
+        // No readers and no writer left, only (possibly) pending bits
+        if (!(value & ~RWLOCK_PENDING))
+        {
+            if (__sync_bool_compare_and_swap(&lock->value, value, RWLOCK_WRITER))
+                break;
+            continue;
+        }
+
+        if (!(value & RWLOCK_PENDING))
+            __sync_fetch_and_or(&lock->value, RWLOCK_PENDING);
+        __asm__ volatile("pause");
+    }
+
+    if (lock->stats)
+        lock_stats_acquired(lock->stats, start);
+}
@@ -0,0 +1,93 @@
+#ifndef K_SYNC_RWLOCK_H
+#define K_SYNC_RWLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lockstat.h"
+#include "../../arch/x86/cpu.h"
+
+// Spinning reader/writer lock. Any number of readers or one writer; a
+// waiting writer holds off new readers so it cannot be starved. Readers
+// must therefore not take the same lock recursively. Statistics only
+// cover the write side.
+#define RWLOCK_WRITER   0x80000000
+#define RWLOCK_PENDING  0x40000000  // A writer is waiting
+#define RWLOCK_READERS  0x3FFFFFFF
+
+typedef struct
+{
+    volatile uint32_t value;
+    lock_stats_t* stats;
+}
+rwlock_t;
+
+#define RWLOCK_INIT                 { 0, 0 }
+#define RWLOCK_INIT_STATS(stats)    { 0, (stats) }
+
+void read_lock_contended(rwlock_t* lock);
+void write_lock_contended(rwlock_t* lock);
+
+static inline void rwlock_init(rwlock_t* lock)
+{
+    lock->value = 0;
+    lock->stats = 0;
+}
+
+static inline void read_lock(rwlock_t* lock)
+{
+    uint32_t value = lock->value;
+    if (__builtin_expect((value & (RWLOCK_WRITER | RWLOCK_PENDING)) ||
+        !__sync_bool_compare_and_swap(&lock->value, value, value + 1), 0))
+        read_lock_contended(lock);
+}
+
+static inline void read_unlock(rwlock_t* lock)
+{
+    __sync_fetch_and_sub(&lock->value, 1);
+}
+
+static inline void write_lock(rwlock_t* lock)
+{
+    if (__builtin_expect(!__sync_bool_compare_and_swap(&lock->value, 0, RWLOCK_WRITER), 0))
+        write_lock_contended(lock);
+    else if (lock->stats)
+        lock_stats_acquired(lock->stats, 0);
+}
+
+static inline void write_unlock(rwlock_t* lock)
+{
+    if (lock->stats)
+        lock_stats_released(lock->stats);
+
+    // Keeps the pending bit of another waiting writer
+    __sync_fetch_and_and(&lock->value, ~RWLOCK_WRITER);
+}
+
+static inline uint32_t read_lock_irqsave(rwlock_t* lock)
+{
+    uint32_t flags = irq_save();
+    read_lock(lock);
+    return flags;
+}
+
+static inline void read_unlock_irqrestore(rwlock_t* lock, uint32_t flags)
+{
+    read_unlock(lock);
+    irq_restore(flags);
+}
+
+static inline uint32_t write_lock_irqsave(rwlock_t* lock)
+{
+    uint32_t flags = irq_save();
+    write_lock(lock);
+    return flags;
+}
+
+static inline void write_unlock_irqrestore(rwlock_t* lock, uint32_t flags)
+{
+    write_unlock(lock);
+    irq_restore(flags);
+}
+
+#endif
@@ -0,0 +1,29 @@
+#include "spinlock.h"
+
+void spin_lock_contended(spinlock_t* lock)
+{
+    uint64_t start = lock->stats ? lock_stats_now() | 1 : 0;
+
+    do
+    {
+        // Spin on a plain read, the cache line stays shared until it is released
+        while (lock->locked)
+            __asm__ volatile("pause");
+    }
+    while (__sync_lock_test_and_set(&lock->locked, 1));
+
+    if (lock->stats)
+        lock_stats_acquired(lock->stats, start);
+}
+
+void ticket_lock_contended(ticket_lock_t* lock, uint16_t ticket)
+{
+    uint64_t start = lock->stats ? lock_stats_now() | 1 : 0;
+
+    while (lock->owner != ticket)
+        __asm__ volatile("pause");
+    __asm__ volatile("" : : : "memory");
+
+    if (lock->stats)
+        lock_stats_acquired(lock->stats, start);
+}
@@ -0,0 +1,141 @@
+#ifndef K_SYNC_SPINLOCK_H
+#define K_SYNC_SPINLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lockstat.h"
+#include "../../arch/x86/cpu.h"
+
+// Test-and-test-and-set lock. Holders must not sleep; take the _irqsave
+// flavour whenever an interrupt handler may want the same lock.
+typedef struct
+{
+    volatile uint32_t locked;
+    lock_stats_t* stats;
+}
+spinlock_t;
+
+#define SPINLOCK_INIT               { 0, 0 }
+#define SPINLOCK_INIT_STATS(stats)  { 0, (stats) }
+
+// FIFO lock: each waiter draws a ticket and spins until it is served, so a
+// CPU hammering the lock cannot starve the others. Preferred for the hot,
+// contended locks.
+typedef struct
+{
+    union
+    {
+        volatile uint32_t value;
+        struct
+        {
+            volatile uint16_t owner;    // Ticket being served
+            volatile uint16_t next;     // Next ticket to hand out
+        };
+    };
+    lock_stats_t* stats;
+}
+ticket_lock_t;
+
+#define TICKET_LOCK_INIT                { { 0 }, 0 }
+#define TICKET_LOCK_INIT_STATS(stats)   { { 0 }, (stats) }
+
+// Slow paths (spinlock.c), only entered when the lock was already taken
+void spin_lock_contended(spinlock_t* lock);
+void ticket_lock_contended(ticket_lock_t* lock, uint16_t ticket);
+
+static inline void spin_init(spinlock_t* lock)
+{
+    lock->locked = 0;
+    lock->stats = 0;
+}
+
+static inline bool spin_trylock(spinlock_t* lock)
+{
+    if (__sync_lock_test_and_set(&lock->locked, 1))
+        return false;
+    if (lock->stats)
+        lock_stats_acquired(lock->stats, 0);
+    return true;
+}
+
+static inline void spin_lock(spinlock_t* lock)
+{
+    if (__builtin_expect(__sync_lock_test_and_set(&lock->locked, 1), 0))
+        spin_lock_contended(lock);
+    else if (lock->stats)
+        lock_stats_acquired(lock->stats, 0);
+}
+
+static inline void spin_unlock(spinlock_t* lock)
+{
+    if (lock->stats)
+        lock_stats_released(lock->stats);
+    __sync_lock_release(&lock->locked);
+}
+
+static inline uint32_t spin_lock_irqsave(spinlock_t* lock)
+{
+    uint32_t flags = irq_save();
+    spin_lock(lock);
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t* lock, uint32_t flags)
+{
+    spin_unlock(lock);
+    irq_restore(flags);
+}
+
+static inline void ticket_init(ticket_lock_t* lock)
+{
+    lock->value = 0;
+    lock->stats = 0;
+}
+
+static inline bool ticket_trylock(ticket_lock_t* lock)
+{
+    // Only when nobody holds or waits: owner == next
+    uint32_t value = lock->value;
+    if ((value >> 16) != (value & 0xFFFF))
+        return false;
+    if (!__sync_bool_compare_and_swap(&lock->value, value, value + 0x10000))
+        return false;
+    if (lock->stats)
+        lock_stats_acquired(lock->stats, 0);
+    return true;
+}
+
+static inline void ticket_lock(ticket_lock_t* lock)
+{
+    uint16_t ticket = (uint16_t)(__sync_fetch_and_add(&lock->value, 0x10000) >> 16);
+    if (__builtin_expect(lock->owner != ticket, 0))
+        ticket_lock_contended(lock, ticket);
+    else if (lock->stats)
+        lock_stats_acquired(lock->stats, 0);
+}
+
+static inline void ticket_unlock(ticket_lock_t* lock)
+{
+    if (lock->stats)
+        lock_stats_released(lock->stats);
+
+    // Only the holder writes owner, a 16-bit store cannot carry into next
+    __asm__ volatile("" : : : "memory");
+    lock->owner = (uint16_t)(lock->owner + 1);
+}
+
+static inline uint32_t ticket_lock_irqsave(ticket_lock_t* lock)
+{
+    uint32_t flags = irq_save();
+    ticket_lock(lock);
+    return flags;
+}
+
+static inline void ticket_unlock_irqrestore(ticket_lock_t* lock, uint32_t flags)
+{
+    ticket_unlock(lock);
+    irq_restore(flags);
+}
+
+#endif
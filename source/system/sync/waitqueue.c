@@ -0,0 +1,101 @@
+#include "waitqueue.h"
+#include "../usermode/processes.h"
+#include "../usermode/scheduler.h"
+#include "../time/timer.h"
+
+void wait_queue_init(wait_queue_t* wq)
+{
+    spin_init(&wq->lock);
+    wq->head = 0;
+    wq->tail = 0;
+}
+
+static void wait_queue_add(wait_queue_t* wq, wait_entry_t* entry)
+{
+    uint32_t flags = spin_lock_irqsave(&wq->lock);
+    entry->next = 0;
+    entry->prev = wq->tail;
+    if (wq->tail)
+        wq->tail->next = entry;
+    else
+        wq->head = entry;
+    wq->tail = entry;
+    spin_unlock_irqrestore(&wq->lock, flags);
+}
+
+static void wait_queue_remove(wait_queue_t* wq, wait_entry_t* entry)
+{
+    uint32_t flags = spin_lock_irqsave(&wq->lock);
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        wq->head = entry->next;
+    if (entry->next)
+        entry->next->prev = entry->prev;
+    else
+        wq->tail = entry->prev;
+    spin_unlock_irqrestore(&wq->lock, flags);
+}
+
+static void wait_timeout(void* ctx)
+{
+    sched_wake((process_t*)ctx, 0);
+}
+
+bool wait_event_timeout(wait_queue_t* wq, wait_cond_t cond, void* ctx, uint64_t timeout_ns)
+{
+    if (cond(ctx))
+        return true;
+
+    process_t* proc = proc_current();
+    if (!proc || !timeout_ns)
+        return false;
+
+    wait_entry_t entry;
+    entry.proc = proc;
+    wait_queue_add(wq, &entry);
+
+    // The callback only touches the process, never the timer itself, so
+    // the timer may go out of scope as soon as it is cancelled
+    timer_entry_t timer;
+    bool timed = timeout_ns != WAIT_FOREVER;
+    timer_setup(&timer, wait_timeout, proc);
+    if (timed)
+        timer_add(&timer, timeout_ns);
+
+    bool ready;
+    while (1)
+    {
+        // Paused before the check: a wake_up from here on cannot be lost
+        sched_prepare_wait();
+
+        if ((ready = cond(ctx)))
+            break;
+        if (timed && !timer_pending(&timer))
+            break;
+
+        sched_finish_wait();
+    }
+
+    sched_cancel_wait();
+    if (timed)
+        timer_cancel(&timer);
+    wait_queue_remove(wq, &entry);
+    return ready;
+}
+
+void wake_up(wait_queue_t* wq, uint32_t flags)
+{
+    uint32_t irq_flags = spin_lock_irqsave(&wq->lock);
+    for (wait_entry_t* entry = wq->head; entry; entry = entry->next)
+        sched_wake(entry->proc, flags);
+    spin_unlock_irqrestore(&wq->lock, irq_flags);
+}
+
+void wake_up_one(wait_queue_t* wq, uint32_t flags)
+{
+    uint32_t irq_flags = spin_lock_irqsave(&wq->lock);
+    if (wq->head)
+        sched_wake(wq->head->proc, flags);
+    spin_unlock_irqrestore(&wq->lock, irq_flags);
+}
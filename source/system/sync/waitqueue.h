@@ -0,0 +1,49 @@
+#ifndef K_SYNC_WAITQUEUE_H
+#define K_SYNC_WAITQUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "spinlock.h"
+
+struct process;
+
+#define WAIT_FOREVER    0xFFFFFFFFFFFFFFFFull
+
+// A waiter on the queue, lives on the waiting process's kernel stack
+typedef struct wait_entry
+{
+    struct wait_entry* next;
+    struct wait_entry* prev;
+    struct process* proc;
+}
+wait_entry_t;
+
+// Processes blocked until some condition holds. Wakers change the state
+// the condition looks at first, then call wake_up; waiters re-check the
+// condition after every wakeup, so spurious ones are harmless.
+typedef struct
+{
+    spinlock_t lock;
+    wait_entry_t* head;
+    wait_entry_t* tail;
+}
+wait_queue_t;
+
+#define WAIT_QUEUE_INIT { SPINLOCK_INIT, 0, 0 }
+
+typedef bool (*wait_cond_t)(void* ctx);
+
+void wait_queue_init(wait_queue_t* wq);
+
+// Sleeps until cond(ctx) is true or timeout_ns passes (WAIT_FOREVER for no
+// limit). Returns whether the condition holds. Process context only; the
+// idle thread just gets the current value of the condition.
+bool wait_event_timeout(wait_queue_t* wq, wait_cond_t cond, void* ctx, uint64_t timeout_ns);
+
+// Wakes every waiter / the longest waiting one. Any context; flags are
+// passed on to sched_wake (SCHED_WAKE_*).
+void wake_up(wait_queue_t* wq, uint32_t flags);
+void wake_up_one(wait_queue_t* wq, uint32_t flags);
+
+#endif
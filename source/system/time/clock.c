@@ -0,0 +1,169 @@
+#include "clock.h"
+#include "pit.h"
+#include "timer.h"
+#include "../usermode/vdata.h"
+#include "../lib/math64.h"
+#include "../../arch/x86/cpu.h"
+#include "../../arch/x86/ports.h"
+
+static bool clock_tsc = false;
+static uint32_t clock_khz = 0;
+static uint32_t clock_mult = 0;
+static uint64_t clock_tsc_base = 0;
+static uint64_t clock_wall_offset_ns = 0;   // CLOCK_REALTIME - CLOCK_MONOTONIC
+
+static uint32_t clock_calibrate_tsc_khz(void)
+{
+    // Count TSC cycles over 50ms of PIT channel 2
+    uint32_t count = PIT_BASE_HZ / 20;
+
+    uint32_t flags = irq_save();
+    pit_ch2_start(count);
+    uint64_t start = rdtsc();
+    while (!pit_ch2_done())
+        ;
+    uint64_t end = rdtsc();
+    irq_restore(flags);
+
+    // khz = cycles / (count / PIT_BASE_HZ) / 1000
+    return (uint32_t)udiv64_32((end - start) * PIT_BASE_HZ, count * 1000, 0);
+}
+
+static uint8_t clock_rtc_read(uint8_t reg)
+{
+    outb(RTC_INDEX_PORT, reg);
+    return inb(RTC_DATA_PORT);
+}
+
+static uint32_t clock_days_from_civil(uint32_t year, uint32_t month, uint32_t day)
+{
+    // Days since 1970-01-01 in the proleptic Gregorian calendar
+    year -= month <= 2;
+    uint32_t era = year / 400;
+    uint32_t yoe = year - era * 400;
+    uint32_t doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+static uint64_t clock_read_rtc_seconds(void)
+{
+    uint8_t sec, min, hour, day, month, year, century;
+
+    // Read twice outside of update cycles until two reads agree
+    uint8_t last[7] = { 0 };
+    for (int tries = 0; tries < 8; tries++)
+    {
+        while (clock_rtc_read(0x0A) & 0x80)
+            ;
+        sec = clock_rtc_read(0x00);
+        min = clock_rtc_read(0x02);
+        hour = clock_rtc_read(0x04);
+        day = clock_rtc_read(0x07);
+        month = clock_rtc_read(0x08);
+        year = clock_rtc_read(0x09);
+        century = clock_rtc_read(0x32);
+
+        if (sec == last[0] && min == last[1] && hour == last[2] && day == last[3] &&
+            month == last[4] && year == last[5] && century == last[6])
+            break;
+
+        last[0] = sec; last[1] = min; last[2] = hour; last[3] = day;
+        last[4] = month; last[5] = year; last[6] = century;
+    }
+
+    uint8_t status_b = clock_rtc_read(0x0B);
+    bool pm = hour & 0x80;
+    hour &= 0x7F;
+
+    if (!(status_b & 0x04))
+    {
+        // BCD encoded
+        sec = (sec & 0x0F) + (sec >> 4) * 10;
+        min = (min & 0x0F) + (min >> 4) * 10;
+        hour = (hour & 0x0F) + (hour >> 4) * 10;
+        day = (day & 0x0F) + (day >> 4) * 10;
+        month = (month & 0x0F) + (month >> 4) * 10;
+        year = (year & 0x0F) + (year >> 4) * 10;
+        century = (century & 0x0F) + (century >> 4) * 10;
+    }
+
+    if (!(status_b & 0x02))
+    {
+        // 12 hour clock
+        hour %= 12;
+        if (pm)
+            hour += 12;
+    }
+
+    uint32_t full_year = (century >= 19 && century <= 30) ? century * 100 + year : 2000 + year;
+    uint32_t days = clock_days_from_civil(full_year, month, day);
+    return (uint64_t)days * 86400 + hour * 3600 + min * 60 + sec;
+}
+
+void clock_init(void)
+{
+    if (cpu_has_feature_edx(CPUID_FEAT_EDX_TSC))
+    {
+        clock_khz = clock_calibrate_tsc_khz();
+        if (clock_khz >= CLOCK_TSC_MIN_KHZ)
+        {
+            // mult = 2^32 * 10^6 / khz, ns per cycle in 32.32 fixed point
+            clock_mult = (uint32_t)udiv64_32(1000000ULL << CLOCK_TSC_SHIFT, clock_khz, 0);
+            clock_tsc_base = rdtsc();
+            clock_tsc = true;
+
+            vdata_set_tsc((uint64_t)clock_khz * 1000, clock_mult, CLOCK_TSC_SHIFT, clock_tsc_base, 0);
+        }
+    }
+
+    // Wall clock is read once, then advanced by the monotonic clock
+    uint64_t wall_ns = clock_read_rtc_seconds() * 1000000000ULL;
+    clock_wall_offset_ns = wall_ns - clock_monotonic_ns();
+    vdata_set_wall_offset(clock_wall_offset_ns);
+}
+
+bool clock_has_tsc(void)
+{
+    return clock_tsc;
+}
+
+uint32_t clock_tsc_khz(void)
+{
+    return clock_khz;
+}
+
+uint64_t clock_cycles_to_ns(uint64_t cycles)
+{
+    // 96-bit product, avoids overflow for any realistic uptime
+    uint32_t lo = (uint32_t)cycles;
+    uint32_t hi = (uint32_t)(cycles >> 32);
+    return (uint64_t)hi * clock_mult + (((uint64_t)lo * clock_mult) >> CLOCK_TSC_SHIFT);
+}
+
+uint64_t clock_monotonic_ns(void)
+{
+    if (!clock_tsc)
+        return timer_now_ns();
+    return clock_cycles_to_ns(rdtsc() - clock_tsc_base);
+}
+
+uint64_t clock_realtime_ns(void)
+{
+    return clock_monotonic_ns() + clock_wall_offset_ns;
+}
+
+bool clock_get_ns(uint32_t clock_id, uint64_t* out_ns)
+{
+    switch (clock_id)
+    {
+        case CLOCK_REALTIME:
+            *out_ns = clock_realtime_ns();
+            return true;
+        case CLOCK_MONOTONIC:
+            *out_ns = clock_monotonic_ns();
+            return true;
+        default:
+            return false;
+    }
+}
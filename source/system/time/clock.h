@@ -0,0 +1,27 @@
+#ifndef K_TIME_CLOCK_H
+#define K_TIME_CLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CLOCK_REALTIME      0
+#define CLOCK_MONOTONIC     1
+
+// TSC to ns: ns = ((delta_hi * mult) + ((delta_lo * mult) >> 32))
+#define CLOCK_TSC_SHIFT     32
+#define CLOCK_TSC_MIN_KHZ   250000      // Slower TSCs would overflow a 32-bit mult
+
+// RTC (MC146818 in the CMOS)
+#define RTC_INDEX_PORT      0x70
+#define RTC_DATA_PORT       0x71
+
+void clock_init(void);
+bool clock_has_tsc(void);
+uint32_t clock_tsc_khz(void);
+
+uint64_t clock_cycles_to_ns(uint64_t cycles);
+uint64_t clock_monotonic_ns(void);
+uint64_t clock_realtime_ns(void);
+bool clock_get_ns(uint32_t clock_id, uint64_t* out_ns);
+
+#endif
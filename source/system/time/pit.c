@@ -0,0 +1,54 @@
+#include "pit.h"
+#include "../../arch/x86/ports.h"
+
+static uint16_t pit_programmed = 0;
+
+void pit_oneshot(uint16_t count)
+{
+    if (count == 0)
+        count = 1;
+
+    pit_programmed = count;
+    outb(PIT_COMMAND, 0x30);                    // Channel 0, lobyte/hibyte, mode 0 (terminal count)
+    outb(PIT_CHANNEL0, count & 0xFF);
+    outb(PIT_CHANNEL0, (count >> 8) & 0xFF);
+}
+
+void pit_stop(void)
+{
+    // Mode 0 with no count loaded never reaches terminal count
+    pit_programmed = 0;
+    outb(PIT_COMMAND, 0x30);
+}
+
+uint16_t pit_elapsed(void)
+{
+    if (!pit_programmed)
+        return 0;
+
+    // Read-back: latch status and count of channel 0
+    outb(PIT_COMMAND, 0xC2);
+    uint8_t status = inb(PIT_CHANNEL0);
+    uint16_t count = inb(PIT_CHANNEL0);
+    count |= (uint16_t)inb(PIT_CHANNEL0) << 8;
+
+    // OUT goes high at terminal count, after which the counter wraps
+    if (status & 0x80)
+        return pit_programmed;
+    return pit_programmed - count;
+}
+
+void pit_ch2_start(uint16_t count)
+{
+    // Gate low, speaker off, program, then raise the gate to start counting
+    outb(PIT_GATE_PORT, inb(PIT_GATE_PORT) & ~0x03);
+    outb(PIT_COMMAND, 0xB0);                    // Channel 2, lobyte/hibyte, mode 0
+    outb(PIT_CHANNEL2, count & 0xFF);
+    outb(PIT_CHANNEL2, (count >> 8) & 0xFF);
+    outb(PIT_GATE_PORT, (inb(PIT_GATE_PORT) & ~0x02) | 0x01);
+}
+
+bool pit_ch2_done(void)
+{
+    return (inb(PIT_GATE_PORT) & 0x20) != 0;
+}
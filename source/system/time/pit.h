@@ -0,0 +1,24 @@
+#ifndef K_TIME_PIT_H
+#define K_TIME_PIT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PIT_BASE_HZ     1193182     // Input clock of the 8253/8254
+#define PIT_MAX_COUNT   0xFFFF
+
+#define PIT_CHANNEL0    0x40
+#define PIT_CHANNEL2    0x42
+#define PIT_COMMAND     0x43
+#define PIT_GATE_PORT   0x61        // Channel 2 gate (bit 0) and output (bit 5)
+
+// Channel 0: one-shot (mode 0), raises IRQ0 once when the count runs out
+void pit_oneshot(uint16_t count);
+void pit_stop(void);
+uint16_t pit_elapsed(void);
+
+// Channel 2: polled countdown used to calibrate other clocks
+void pit_ch2_start(uint16_t count);
+bool pit_ch2_done(void);
+
+#endif
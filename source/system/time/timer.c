@@ -0,0 +1,502 @@
+#include "timer.h"
+#include "pit.h"
+#include "clock.h"
+#include "../interrupts/apic.h"
+#include "../interrupts/interrupts.h"
+#include "../usermode/vdata.h"
+#include "../smp/smp.h"
+#include "../sync/spinlock.h"
+#include "../sync/rcu.h"
+#include "../lib/math64.h"
+#include "../../arch/x86/cpu.h"
+
+// Hierarchical timing wheel: a level L slot holds timers that are
+// 64^L to 64^(L+1) jiffies out, they cascade down as the wheel turns.
+// The extra level is the list of timers currently being expired.
+#define TIMER_EXPIRING_LEVEL    TIMER_WHEEL_LEVELS
+
+static timer_entry_t* timer_wheel[TIMER_WHEEL_LEVELS + 1][TIMER_WHEEL_SIZE];
+static uint64_t timer_wheel_bitmap[TIMER_WHEEL_LEVELS + 1];
+static uint64_t timer_wheel_clk = 0;    // Next jiffy to process
+static uint32_t timer_count = 0;
+
+// One-shot clock event device (local APIC timer, or PIT channel 0)
+static bool timer_use_lapic = false;
+static uint32_t timer_lapic_per_ms = 0;
+static uint64_t timer_max_shot_ns = 0;
+static uint64_t timer_base_ns = 0;      // Time at which the current shot started
+static uint64_t timer_shot_ns = 0;      // Length of the current shot, 0 if stopped
+static uint32_t timer_shot_count = 0;
+
+// The wheel is shared, the one-shot device belongs to the BSP. Other CPUs
+// that need an earlier expiry kick the BSP with an IPI on TIMER_VECTOR.
+static lock_stats_t timer_lock_stats = LOCK_STATS_INIT("timer");
+static ticket_lock_t timer_lock = TICKET_LOCK_INIT_STATS(&timer_lock_stats);
+
+static bool timer_ready = false;
+static uint32_t timer_busy_mask = 1;    // CPUs not idle, the tick runs while any is set
+static timer_entry_t timer_tick_entry;
+static int_action_t timer_action;
+
+static inline uint32_t timer_ctz64(uint64_t v)
+{
+    uint32_t lo = (uint32_t)v;
+    return lo ? (uint32_t)__builtin_ctz(lo) : 32 + (uint32_t)__builtin_ctz((uint32_t)(v >> 32));
+}
+
+static void timer_wheel_insert(timer_entry_t* timer)
+{
+    uint64_t expires = timer->expires;
+    int64_t delta = (int64_t)(expires - timer_wheel_clk);
+    int level = 0;
+
+    if (delta < 0)
+    {
+        expires = timer_wheel_clk; // Already due, runs on the next jiffy processed
+    }
+    else
+    {
+        while (level < TIMER_WHEEL_LEVELS - 1 &&
+               (uint64_t)delta >= (1ULL << (TIMER_WHEEL_BITS * (level + 1))))
+            level++;
+
+        // Beyond the last level: park in the farthest slot, it re-cascades later
+        if ((uint64_t)delta >= (1ULL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)))
+            expires = timer_wheel_clk + (1ULL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1;
+    }
+
+    uint8_t slot = (expires >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+
+    timer->level = level;
+    timer->slot = slot;
+    timer->prev = 0;
+    timer->next = timer_wheel[level][slot];
+    if (timer->next)
+        timer->next->prev = timer;
+    timer_wheel[level][slot] = timer;
+    timer_wheel_bitmap[level] |= 1ULL << slot;
+    timer_count++;
+}
+
+static void timer_wheel_remove(timer_entry_t* timer)
+{
+    if (timer->prev)
+        timer->prev->next = timer->next;
+    else
+        timer_wheel[timer->level][timer->slot] = timer->next;
+    if (timer->next)
+        timer->next->prev = timer->prev;
+
+    if (!timer_wheel[timer->level][timer->slot])
+        timer_wheel_bitmap[timer->level] &= ~(1ULL << timer->slot);
+
+    timer->level = -1;
+    timer->next = 0;
+    timer->prev = 0;
+    timer_count--;
+}
+
+static void timer_cascade(int level, uint32_t slot)
+{
+    timer_entry_t* timer = timer_wheel[level][slot];
+    timer_wheel[level][slot] = 0;
+    timer_wheel_bitmap[level] &= ~(1ULL << slot);
+
+    while (timer)
+    {
+        timer_entry_t* next = timer->next;
+        timer_count--;
+        timer_wheel_insert(timer);
+        timer = next;
+    }
+}
+
+static void timer_run_jiffy(void)
+{
+    uint64_t clk = timer_wheel_clk;
+
+    // Pull the next slot of each higher level down whenever the level below wraps
+    for (int level = 1; level < TIMER_WHEEL_LEVELS; level++)
+    {
+        if (clk & ((1ULL << (TIMER_WHEEL_BITS * level)) - 1))
+            break;
+        timer_cascade(level, (clk >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK);
+    }
+
+    // Move the due slot aside so callbacks can cancel or re-add timers freely
+    uint32_t slot = clk & TIMER_WHEEL_MASK;
+    timer_entry_t* timer = timer_wheel[0][slot];
+    timer_wheel[0][slot] = 0;
+    timer_wheel_bitmap[0] &= ~(1ULL << slot);
+
+    timer_wheel[TIMER_EXPIRING_LEVEL][0] = timer;
+    if (timer)
+        timer_wheel_bitmap[TIMER_EXPIRING_LEVEL] = 1;
+    for (; timer; timer = timer->next)
+    {
+        timer->level = TIMER_EXPIRING_LEVEL;
+        timer->slot = 0;
+    }
+
+    timer_wheel_clk = clk + 1;
+
+    while ((timer = timer_wheel[TIMER_EXPIRING_LEVEL][0]))
+    {
+        timer_wheel_remove(timer);
+
+        // Callbacks may add or cancel timers themselves
+        ticket_unlock(&timer_lock);
+        timer->callback(timer->ctx);
+        ticket_lock(&timer_lock);
+    }
+}
+
+static void timer_run_expired(uint64_t now_ns)
+{
+    uint64_t now = udiv64_32(now_ns, TIMER_NS_PER_JIFFY, 0);
+
+    // Nothing queued, the wheel can jump straight to the present
+    if (!timer_count)
+    {
+        if (timer_wheel_clk <= now)
+            timer_wheel_clk = now + 1;
+        return;
+    }
+
+    while (timer_wheel_clk <= now)
+        timer_run_jiffy();
+}
+
+// Earliest jiffy at which the wheel has work (an expiry or a cascade)
+static bool timer_next_jiffy(uint64_t* out)
+{
+    uint64_t clk = timer_wheel_clk;
+    uint64_t best = 0;
+    bool found = false;
+
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++)
+    {
+        uint64_t bitmap = timer_wheel_bitmap[level];
+        if (!bitmap)
+            continue;
+
+        uint32_t shift = TIMER_WHEEL_BITS * level;
+        uint64_t period = clk >> shift;
+        uint32_t cur = period & TIMER_WHEEL_MASK;
+
+        // Bit i of rot stands for the slot i periods from now
+        uint64_t rot = cur ? (bitmap >> cur) | (bitmap << (TIMER_WHEEL_SIZE - cur)) : bitmap;
+        uint64_t when;
+
+        if (level == 0)
+        {
+            when = clk + timer_ctz64(rot);
+        }
+        else
+        {
+            // The current slot was already cascaded unless we sit right on its boundary
+            uint32_t k;
+            bool at_boundary = (clk & ((1ULL << shift) - 1)) == 0;
+            if ((rot & 1) && at_boundary)
+                k = 0;
+            else if (rot & ~1ULL)
+                k = timer_ctz64(rot & ~1ULL);
+            else
+                k = TIMER_WHEEL_SIZE;
+            when = (period + k) << shift;
+        }
+
+        if (!found || when < best)
+        {
+            best = when;
+            found = true;
+        }
+    }
+
+    *out = best;
+    return found;
+}
+
+static uint64_t timer_device_elapsed_ns(void)
+{
+    if (!timer_shot_ns)
+        return 0;
+
+    if (timer_use_lapic)
+    {
+        uint32_t done = timer_shot_count - apic_read(LAPIC_REG_TIMER_CUR);
+        return udiv64_32((uint64_t)done * 1000000, timer_lapic_per_ms, 0);
+    }
+
+    return udiv64_32((uint64_t)pit_elapsed() * 1000000000, PIT_BASE_HZ, 0);
+}
+
+static void timer_device_stop(void)
+{
+    if (timer_use_lapic)
+        apic_write(LAPIC_REG_TIMER_INIT, 0);
+    else
+        pit_stop();
+    timer_shot_ns = 0;
+}
+
+static void timer_device_program(uint64_t ns)
+{
+    if (ns > timer_max_shot_ns)
+        ns = timer_max_shot_ns;
+
+    if (timer_use_lapic)
+    {
+        uint32_t count = (uint32_t)udiv64_32(ns * timer_lapic_per_ms, 1000000, 0);
+        if (!count)
+            count = 1;
+        timer_shot_count = count;
+        timer_shot_ns = udiv64_32((uint64_t)count * 1000000, timer_lapic_per_ms, 0);
+        apic_write(LAPIC_REG_TIMER_INIT, count);
+    }
+    else
+    {
+        uint32_t count = (uint32_t)udiv64_32(ns * PIT_BASE_HZ, 1000000000, 0);
+        if (!count)
+            count = 1;
+        timer_shot_count = count;
+        timer_shot_ns = udiv64_32((uint64_t)count * 1000000000, PIT_BASE_HZ, 0);
+        pit_oneshot((uint16_t)count);
+    }
+}
+
+// Fold the running shot into the time base, then arm the next expiry (if any)
+// The TSC clocksource once calibrated, else the sum of the shots run so far
+static uint64_t timer_clock_ns(void)
+{
+    if (clock_has_tsc())
+        return clock_monotonic_ns();
+    return timer_base_ns + timer_device_elapsed_ns();
+}
+
+static void timer_reprogram(void)
+{
+    uint64_t now = timer_clock_ns();
+    timer_base_ns = now;
+
+    uint64_t next;
+    if (!timer_next_jiffy(&next))
+    {
+        timer_device_stop();
+        return;
+    }
+
+    uint64_t deadline = next * TIMER_NS_PER_JIFFY;
+    uint64_t delta = deadline > now ? deadline - now : 0;
+    if (delta < TIMER_MIN_SHOT_NS)
+        delta = TIMER_MIN_SHOT_NS;
+
+    timer_device_program(delta);
+}
+
+static void timer_tick(void* ctx)
+{
+    timer_entry_t* tick = (timer_entry_t*)ctx;
+
+    // Re-arm directly, timer_interrupt reprograms the device after callbacks
+    ticket_lock(&timer_lock);
+    tick->expires = timer_wheel_clk - 1 + TIMER_HZ / TIMER_TICK_HZ;
+    timer_wheel_insert(tick);
+    ticket_unlock(&timer_lock);
+
+    rcu_tick();
+}
+
+static uint32_t timer_calibrate_lapic(void)
+{
+    // Count local APIC timer ticks over 10ms of PIT channel 2
+    apic_write(LAPIC_REG_TIMER_DIV, 0x3); // Divide by 16
+    apic_write(LAPIC_REG_LVT_TIMER, LAPIC_LVT_MASKED);
+
+    pit_ch2_start(PIT_BASE_HZ / 100);
+    apic_write(LAPIC_REG_TIMER_INIT, 0xFFFFFFFF);
+    while (!pit_ch2_done())
+        ;
+    uint32_t elapsed = 0xFFFFFFFF - apic_read(LAPIC_REG_TIMER_CUR);
+    apic_write(LAPIC_REG_TIMER_INIT, 0);
+
+    return elapsed / 10;
+}
+
+static bool timer_interrupt(interrupt_frame_t* frame, void* ctx)
+{
+    (void)frame;
+    (void)ctx;
+
+    if (!timer_ready)
+        return true;
+
+    ticket_lock(&timer_lock);
+
+    // Account for the shot that just ran out (or whatever part of it did)
+    timer_base_ns = timer_clock_ns();
+    timer_shot_ns = 0;
+
+    timer_run_expired(timer_base_ns);
+    vdata_set_ticks(timer_wheel_clk - 1);
+    timer_reprogram();
+
+    ticket_unlock(&timer_lock);
+    return true;
+}
+
+void timer_init(void)
+{
+    uint32_t flags = irq_save();
+
+    int_setup_action(&timer_action, timer_interrupt, 0, "timer");
+    lock_stats_register(&timer_lock_stats);
+
+    if (apic_enabled())
+    {
+        timer_lapic_per_ms = timer_calibrate_lapic();
+        timer_use_lapic = timer_lapic_per_ms != 0;
+    }
+
+    if (timer_use_lapic)
+    {
+        // One-shot mode, the PIT is not needed anymore
+        int_register(TIMER_VECTOR, &timer_action, INT_FLAG_EOI);
+        apic_write(LAPIC_REG_LVT_TIMER, TIMER_VECTOR);
+        timer_max_shot_ns = (uint64_t)(0xFFFFFFFF / timer_lapic_per_ms) * 1000000;
+        irq_disable(0);
+        pit_stop();
+    }
+    else
+    {
+        timer_max_shot_ns = udiv64_32((uint64_t)PIT_MAX_COUNT * 1000000000, PIT_BASE_HZ, 0);
+        pit_stop();
+        irq_register(0, &timer_action);
+        irq_enable(0);
+    }
+
+    timer_setup(&timer_tick_entry, timer_tick, &timer_tick_entry);
+    timer_ready = true;
+    irq_restore(flags);
+
+    timer_add(&timer_tick_entry, TIMER_NS_PER_JIFFY * (TIMER_HZ / TIMER_TICK_HZ));
+}
+
+void timer_setup(timer_entry_t* timer, timer_callback_t callback, void* ctx)
+{
+    timer->next = 0;
+    timer->prev = 0;
+    timer->expires = 0;
+    timer->callback = callback;
+    timer->ctx = ctx;
+    timer->level = -1;
+    timer->slot = 0;
+}
+
+void timer_add(timer_entry_t* timer, uint64_t delay_ns)
+{
+    bool kick = false;
+    uint32_t flags = ticket_lock_irqsave(&timer_lock);
+
+    if (timer->level >= 0)
+        timer_wheel_remove(timer);
+
+    // Round up so a timer never fires early
+    uint32_t rem;
+    uint64_t now = timer_clock_ns();
+    timer->expires = udiv64_32(now + delay_ns, TIMER_NS_PER_JIFFY, &rem) + (rem ? 1 : 0);
+    timer_wheel_insert(timer);
+
+    // Only touch the device if this expiry comes before the armed one
+    if (timer_ready &&
+        (!timer_shot_ns || timer->expires * TIMER_NS_PER_JIFFY < timer_base_ns + timer_shot_ns))
+    {
+        if (smp_cpu_id() == 0)
+            timer_reprogram();
+        else
+            kick = true;
+    }
+
+    ticket_unlock_irqrestore(&timer_lock, flags);
+
+    if (kick)
+        smp_send_ipi(0, TIMER_VECTOR);
+}
+
+void timer_cancel(timer_entry_t* timer)
+{
+    // An already armed shot may still fire, it will simply find nothing due
+    uint32_t flags = ticket_lock_irqsave(&timer_lock);
+    if (timer->level >= 0)
+        timer_wheel_remove(timer);
+    ticket_unlock_irqrestore(&timer_lock, flags);
+}
+
+bool timer_pending(const timer_entry_t* timer)
+{
+    return timer->level >= 0;
+}
+
+uint64_t timer_now_ns(void)
+{
+    if (clock_has_tsc())
+        return clock_monotonic_ns();
+
+    uint32_t flags = ticket_lock_irqsave(&timer_lock);
+    uint64_t now = timer_clock_ns();
+    ticket_unlock_irqrestore(&timer_lock, flags);
+    return now;
+}
+
+uint64_t timer_jiffies(void)
+{
+    return udiv64_32(timer_now_ns(), TIMER_NS_PER_JIFFY, 0);
+}
+
+void timer_idle_enter(void)
+{
+    uint32_t bit = 1u << smp_cpu_id();
+    uint32_t flags = ticket_lock_irqsave(&timer_lock);
+
+    // The last CPU to go idle stops the tick
+    if ((timer_busy_mask & bit) && !(timer_busy_mask &= ~bit) && timer_tick_entry.level >= 0)
+        timer_wheel_remove(&timer_tick_entry);
+
+    ticket_unlock_irqrestore(&timer_lock, flags);
+}
+
+void timer_idle_exit(void)
+{
+    uint32_t bit = 1u << smp_cpu_id();
+    uint32_t flags = ticket_lock_irqsave(&timer_lock);
+    bool start = !timer_busy_mask;
+    timer_busy_mask |= bit;
+    ticket_unlock_irqrestore(&timer_lock, flags);
+
+    // The first CPU to wake restarts it
+    if (start)
+        timer_add(&timer_tick_entry, TIMER_NS_PER_JIFFY * (TIMER_HZ / TIMER_TICK_HZ));
+}
+
+static void timer_sleep_wake(void* ctx)
+{
+    *(volatile bool*)ctx = true;
+}
+
+void timer_sleep_ns(uint64_t ns)
+{
+    volatile bool done = false;
+    timer_entry_t timer;
+    timer_setup(&timer, timer_sleep_wake, (void*)&done);
+
+    uint32_t flags = irq_save();
+    timer_add(&timer, ns);
+    timer_idle_enter();
+
+    // sti;hlt is atomic, a wakeup cannot slip in between the check and the halt
+    while (!done)
+        __asm__ volatile("sti\n\thlt\n\tcli" : : : "memory");
+
+    timer_idle_exit();
+    irq_restore(flags);
+}
@@ -0,0 +1,50 @@
+#ifndef K_TIME_TIMER_H
+#define K_TIME_TIMER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TIMER_HZ                1000        // Wheel resolution (one jiffy = 1ms)
+#define TIMER_NS_PER_JIFFY      1000000
+#define TIMER_TICK_HZ           100         // Housekeeping tick, only while not idle
+
+#define TIMER_WHEEL_BITS        6
+#define TIMER_WHEEL_SIZE        (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK        (TIMER_WHEEL_SIZE - 1)
+#define TIMER_WHEEL_LEVELS      5           // 64^5 jiffies, a bit over 12 days
+
+#define TIMER_VECTOR            0x40        // Local APIC timer
+#define TIMER_MIN_SHOT_NS       10000
+
+typedef void (*timer_callback_t)(void* ctx);
+
+typedef struct timer_entry
+{
+    struct timer_entry* next;
+    struct timer_entry* prev;
+    uint64_t expires;               // Absolute jiffy
+    timer_callback_t callback;      // Runs in interrupt context
+    void* ctx;
+    int8_t level;                   // Wheel position, -1 if not pending
+    uint8_t slot;
+}
+timer_entry_t;
+
+void timer_init(void);
+
+void timer_setup(timer_entry_t* timer, timer_callback_t callback, void* ctx);
+void timer_add(timer_entry_t* timer, uint64_t delay_ns);
+void timer_cancel(timer_entry_t* timer);
+bool timer_pending(const timer_entry_t* timer);
+
+uint64_t timer_now_ns(void);
+uint64_t timer_jiffies(void);
+
+// Stop / restart the housekeeping tick around idle periods
+void timer_idle_enter(void);
+void timer_idle_exit(void);
+
+// Halts until the delay has passed (interrupts must be deliverable)
+void timer_sleep_ns(uint64_t ns);
+
+#endif
@@ -0,0 +1,141 @@
+#include "fpu.h"
+#include "processes.h"
+#include "../smp/smp.h"
+#include "../interrupts/interrupts.h"
+#include "../../arch/x86/cpu.h"
+
+#define FPU_NM_VECTOR   7
+
+static fpu_state_t fpu_clean_state;     // After fninit, what a process starts from
+static int_action_t fpu_nm_action;
+static bool fpu_enabled = false;
+
+static inline void fpu_clts(void)
+{
+    __asm__ volatile ("clts");
+}
+
+static inline void fpu_stts(void)
+{
+    write_cr0(read_cr0() | CR0_TS);
+}
+
+static inline void fpu_save(fpu_state_t* state)
+{
+    __asm__ volatile ("fxsave %0" : "=m"(*state));
+}
+
+static inline void fpu_restore(const fpu_state_t* state)
+{
+    __asm__ volatile ("fxrstor %0" : : "m"(*state));
+}
+
+// Registers on this CPU still hold proc's state
+static inline bool fpu_loaded(cpu_t* cpu, process_t* proc)
+{
+    return cpu->fpu_owner == proc && proc->fpu_used && proc->fpu_cpu == cpu->id;
+}
+
+// First FP or SSE instruction since TS was set. Interrupt gate, nothing
+// switches us out between loading the state and returning to it.
+static bool fpu_nm(interrupt_frame_t* frame, void* ctx)
+{
+    (void)frame;
+    (void)ctx;
+
+    process_t* proc = proc_current();
+    if (!fpu_enabled || !proc)
+        return false; // The kernel does not use the FPU, this is a bug
+
+    cpu_t* cpu = this_cpu();
+    fpu_clts();
+    if (!fpu_loaded(cpu, proc))
+        fpu_restore(proc->fpu_used ? &proc->fpu : &fpu_clean_state);
+
+    proc->fpu_used = true;
+    proc->fpu_cpu = cpu->id;
+    cpu->fpu_owner = proc;
+    return true;
+}
+
+void fpu_init_cpu(void)
+{
+    if (!fpu_enabled)
+        return;
+
+    write_cr0((read_cr0() & ~CR0_EM) | CR0_MP | CR0_NE);
+    write_cr4(read_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT);
+    __asm__ volatile ("fninit");
+    this_cpu()->fpu_owner = 0;
+    fpu_stts();
+}
+
+void fpu_init(void)
+{
+    // FXSAVE and SSE came together, every CPU we boot on has both or neither
+    if (!cpu_has_feature_edx(CPUID_FEAT_EDX_FXSR) || !cpu_has_feature_edx(CPUID_FEAT_EDX_SSE))
+        return;
+    fpu_enabled = true;
+
+    fpu_init_cpu();
+    fpu_clts();
+    fpu_save(&fpu_clean_state);     // fninit leaves MXCSR alone, it is still at its reset value
+    fpu_stts();
+
+    int_setup_action(&fpu_nm_action, fpu_nm, 0, "lazy fpu");
+    int_register(FPU_NM_VECTOR, &fpu_nm_action, 0);
+}
+
+void fpu_switch(process_t* prev, process_t* next)
+{
+    if (!fpu_enabled)
+        return;
+
+    // TS clear: the outgoing process used the FPU this slice, so the
+    // registers are newer than its save area. Saving now keeps the area
+    // valid while it is off the CPU, whichever CPU picks it up next.
+    cpu_t* cpu = this_cpu();
+    if (!(read_cr0() & CR0_TS) && cpu->fpu_owner == prev)
+        fpu_save(&prev->fpu);
+
+    // Back on the CPU nobody else used the FPU on since: nothing to load
+    if (fpu_loaded(cpu, next))
+        fpu_clts();
+    else
+        fpu_stts();
+}
+
+void fpu_reset(process_t* proc)
+{
+    if (!fpu_enabled)
+        return;
+
+    uint32_t flags = irq_save();
+    proc->fpu_used = false;
+    cpu_t* cpu = this_cpu();
+    if (cpu->fpu_owner == proc)
+        cpu->fpu_owner = 0;
+    fpu_stts();
+    irq_restore(flags);
+}
+
+bool fpu_kernel_begin(void)
+{
+    if (!fpu_enabled)
+        return false;
+
+    // TS clear: the owner is running and its registers are newer than its
+    // save area. Either way they are about to be overwritten.
+    cpu_t* cpu = this_cpu();
+    if (cpu->fpu_owner && !(read_cr0() & CR0_TS))
+        fpu_save(&cpu->fpu_owner->fpu);
+    cpu->fpu_owner = 0;
+    fpu_clts();
+    return true;
+}
+
+void fpu_kernel_end(void)
+{
+    if (fpu_enabled)
+        fpu_stts();
+}
@@ -0,0 +1,41 @@
+#ifndef K_FPU_H
+#define K_FPU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct process;
+
+// Lazy FPU/SSE switching. CR0.TS is set whenever a process is switched in
+// whose state is not in the registers already; its first FP or SSE
+// instruction raises #NM, which loads the state and clears TS. A process
+// that used the FPU during its slice has the registers saved as it is
+// switched out, so the save area is current whenever it is not running and
+// it may migrate freely. Processes that never touch the FPU pay nothing.
+// The kernel itself does not use FP or SSE registers.
+#define FPU_STATE_SIZE  512     // FXSAVE image
+
+typedef struct
+{
+    uint8_t data[FPU_STATE_SIZE];
+}
+__attribute__((aligned(16))) fpu_state_t;
+
+// BSP: feature check, clean state template and the #NM handler.
+// Every CPU (APs from their entry) then calls fpu_init_cpu.
+void fpu_init(void);
+void fpu_init_cpu(void);
+
+// Context switch hook, interrupts off
+void fpu_switch(struct process* prev, struct process* next);
+
+// Next FP instruction of the current process starts from a clean state (exec)
+void fpu_reset(struct process* proc);
+
+// SSE in the kernel, interrupts off from begin to end and no nesting. The
+// owner's registers are saved first and reloaded lazily afterwards. False
+// without SSE: nothing to end, use the integer path.
+bool fpu_kernel_begin(void);
+void fpu_kernel_end(void);
+
+#endif
@@ -0,0 +1,42 @@
+#include "kthread.h"
+#include "scheduler.h"
+#include "../sync/rcu.h"
+#include "../../arch/x86/cpu.h"
+
+// First code a thread runs, reached by context_switch's ret. The switch
+// happened with interrupts off, a process would re-enable them on iret.
+static void kthread_entry(kthread_fn_t fn, void* ctx)
+{
+    __asm__ volatile("sti" : : : "memory");
+    fn(ctx);
+    proc_exit(0);
+}
+
+process_t* kthread_start(kthread_fn_t fn, void* ctx)
+{
+    process_t* proc = proc_create_kernel();
+    if (!proc)
+        return 0;
+
+    // What context_switch pops, then a frame as if kthread_entry was called
+    uint32_t* stack = (uint32_t*)proc->kernel_stack_top;
+    *--stack = (uint32_t)ctx;
+    *--stack = (uint32_t)fn;
+    *--stack = 0; // Return address, never used
+    *--stack = (uint32_t)kthread_entry;
+    *--stack = 0; // ebp
+    *--stack = 0; // ebx
+    *--stack = 0; // esi
+    *--stack = 0; // edi
+    proc->kernel_esp = (uintptr_t)stack;
+    proc->frame = 0;
+
+    sched_add(proc);
+    return proc;
+}
+
+void kthread_preempt_point(void)
+{
+    rcu_qs();
+    sched_preempt();
+}
@@ -0,0 +1,22 @@
+#ifndef K_KTHREAD_H
+#define K_KTHREAD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "processes.h"
+
+// Kernel threads: processes with a kernel stack and no address space of
+// their own, scheduled like any other. The kernel is not preemptible, so a
+// thread keeps the CPU until it blocks, sleeps or reaches a safe point with
+// kthread_preempt_point. Returning from fn ends the thread; nobody waits
+// for it, it is reaped like an orphan.
+typedef void (*kthread_fn_t)(void* ctx);
+
+process_t* kthread_start(kthread_fn_t fn, void* ctx);
+
+// Holds no locks and no RCU references: reports a quiescent state and
+// switches if the time slice ran out or something more important woke up
+void kthread_preempt_point(void);
+
+#endif
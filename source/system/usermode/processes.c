@@ -1,47 +1,399 @@
 #include "processes.h"
 #include "usermode.h"
+#include "vdata.h"
+#include "scheduler.h"
+#include "../smp/smp.h"
+#include "../memory/physical.h"
+#include "../memory/virtual.h"
+#include "../sync/spinlock.h"
+#include "../sync/futex.h"
+#include "../memory/uaccess.h"
+#include "../../boot/idt/idt.h"
+
+// Guards slot allocation and the parent links in the process table. Lookups
+// do not take it, they rely on RCU (see proc_find); the current process is per-CPU.
+static lock_stats_t proc_table_lock_stats = LOCK_STATS_INIT("proc_table");
+static spinlock_t proc_table_lock = SPINLOCK_INIT_STATS(&proc_table_lock_stats);
 
 static process_t process_table[PROC_MAX_COUNT];
 
-static process_t* current_process = 0;
+// Free slots in release order, so a pid is reused as late as possible
+static uint8_t proc_free_slots[PROC_MAX_COUNT];
+static uint32_t proc_free_head = 0;
+static uint32_t proc_free_count = 0;
+
+// Lock held
+static void proc_free_push(process_t* proc)
+{
+    proc_free_slots[(proc_free_head + proc_free_count) % PROC_MAX_COUNT] = proc->id - 1;
+    proc_free_count++;
+}
+
+// Lock held
+static process_t* proc_free_pop(void)
+{
+    if (proc_free_count == 0)
+        return 0;
+
+    process_t* proc = &process_table[proc_free_slots[proc_free_head]];
+    proc_free_head = (proc_free_head + 1) % PROC_MAX_COUNT;
+    proc_free_count--;
+    return proc;
+}
 
 void proc_mgr_init()
 {
     for(int pid = 0; pid < PROC_MAX_COUNT; ++pid)
     {
-        process_table[pid].id = pid;
+        process_table[pid].id = pid + 1; // pid 0 is the kernel
         process_table[pid].state = PROC_UNUSED;
-        int r = 0;
-        while(r < 16)
-        {
-            process_table[pid].regs[r] = 0x0; r++;
-            process_table[pid].regs[r] = 0x0; r++;
-            process_table[pid].regs[r] = 0x0; r++;
-            process_table[pid].regs[r] = 0x0; r++;
-        }
-        process_table[pid].kernel_stack_top = 0x0;
         process_table[pid].kernel_stack_top = 0x0;
+        process_table[pid].page_dir = 0x0;
+        process_table[pid].vdata_page = 0x0;
+        process_table[pid].space_users = 0;
+        process_table[pid].kernel_esp = 0x0;
+        process_table[pid].frame = 0x0;
+        process_table[pid].run_next = 0x0;
+        process_table[pid].cpu = 0;
+        process_table[pid].on_cpu = 0;
+        process_table[pid].exit_code = 0;
+        process_table[pid].parent = 0x0;
+        process_table[pid].zombie = false;
+
+        // Never re-initialized: a late wake_up from an exiting child may
+        // still reach the queue after the slot was reused
+        wait_queue_init(&process_table[pid].child_wait);
+        ipc_proc_init(&process_table[pid]);
+        proc_free_push(&process_table[pid]);
+    }
+
+    lock_stats_register(&proc_table_lock_stats);
+}
+
+static void proc_free_stack(process_t* proc)
+{
+    if (proc->kernel_stack_top)
+        mem_phys_free_sectors((void*)(proc->kernel_stack_top - PROC_KERNEL_STACK_SIZE),
+                              PROC_KERNEL_STACK_SIZE / PMM_SECTOR_SIZE);
+    proc->kernel_stack_top = 0;
+}
+
+static void proc_free_space(process_t* proc)
+{
+    if (proc->page_dir)
+        mem_virt_destroy_space(proc->page_dir); // Takes the vdata page along
+    proc->page_dir = 0;
+    proc->vdata_page = 0;
+}
+
+static void proc_free_resources(process_t* proc)
+{
+    proc_free_space(proc);
+    proc_free_stack(proc);
+}
+
+// Kernel threads get no address space, they run on whatever is loaded
+static process_t* proc_alloc(bool user)
+{
+    // Claim a free slot under the lock, set it up outside of it
+    uint32_t flags = spin_lock_irqsave(&proc_table_lock);
+    process_t* proc = proc_free_pop();
+    if (proc)
+        proc->state = PROC_CLAIMED;
+    spin_unlock_irqrestore(&proc_table_lock, flags);
+
+    if (!proc)
+        return 0;
+
+    proc->kernel_stack_top = 0;
+    proc->page_dir = 0;
+    proc->vdata_page = 0;
+    proc->group = proc;
+    proc->group_refs = 1;
+    proc->clear_tid = 0;
+
+    uint8_t* stack = mem_phys_alloc_sectors(PROC_KERNEL_STACK_SIZE / PMM_SECTOR_SIZE);
+    if (stack)
+        proc->kernel_stack_top = (uintptr_t)stack + PROC_KERNEL_STACK_SIZE;
+    if (user)
+        proc->page_dir = mem_virt_create_space();
+
+    if (!stack || (user && (!proc->page_dir || !vdata_map(proc)))) 
+    {
+        // Never visible to proc_find, so the slot goes straight back
+        proc_free_resources(proc);
+        flags = spin_lock_irqsave(&proc_table_lock);
+        proc->state = PROC_UNUSED;
+        proc_free_push(proc);
+        spin_unlock_irqrestore(&proc_table_lock, flags);
+        return 0;
     }
+
+    proc->user_stack_top = USER_STACK_TOP;
+    proc->exit_code = 0;
+    proc->parent = 0;
+    proc->zombie = false;
+    proc->on_cpu = 0;
+    proc->fpu_used = false;
+    ipc_proc_reset(proc);
+    proc->static_prio = SCHED_PRIO_DEFAULT;
+    timer_setup(&proc->sleep_timer, 0, proc);
+
+    // Published to proc_find only once fully set up
+    rcu_assign_pointer(proc->state, PROC_PAUSED); // Runnable once handed to sched_add
+    return proc;
 }
 
 process_t* proc_create(void)
 {
-    // Find free process slot
-    for(int pid = 0; pid < PROC_MAX_COUNT; ++pid) 
+    return proc_alloc(true);
+}
+
+process_t* proc_create_kernel(void)
+{
+    return proc_alloc(false);
+}
+
+process_t* proc_create_thread(process_t* owner)
+{
+    process_t* leader = owner->group;
+    process_t* thread = proc_alloc(false);
+    if (!thread)
+        return 0;
+
+    // owner runs on the space and holds a reference, the leader cannot go away
+    __sync_fetch_and_add(&leader->group_refs, 1);
+    thread->group = leader;
+    thread->page_dir = leader->page_dir;
+    thread->vdata_page = leader->vdata_page;
+    return thread;
+}
+
+process_t* proc_find(uint16_t pid)
+{
+    if (pid == 0 || pid > PROC_MAX_COUNT)
+        return 0;
+
+    // pid - 1 is the slot, no scan needed
+    process_t* proc = &process_table[pid - 1];
+    uint8_t state = rcu_dereference(proc->state);
+    if (state == PROC_UNUSED || state == PROC_CLAIMED)
+        return 0;
+    return proc;
+}
+
+static void proc_release_rcu(rcu_head_t* head)
+{
+    process_t* proc = (process_t*)((uint8_t*)head - __builtin_offsetof(process_t, rcu));
+
+    uint32_t flags = spin_lock_irqsave(&proc_table_lock);
+    proc->state = PROC_UNUSED;
+    proc_free_push(proc);
+    spin_unlock_irqrestore(&proc_table_lock, flags);
+}
+
+void proc_release(process_t* proc)
+{
+    // Hidden from new lookups now, reusable once current readers are done
+    proc->state = PROC_CLAIMED;
+    call_rcu(&proc->rcu, proc_release_rcu);
+}
+
+// Last one out frees the space and the leader's slot. A leader reaped by
+// its parent while threads still run stays an unreachable zombie until then.
+static void proc_group_put(process_t* leader)
+{
+    if (__sync_sub_and_fetch(&leader->group_refs, 1) != 0)
+        return;
+
+    proc_free_space(leader);
+    proc_release(leader);
+}
+
+void proc_destroy(process_t* proc)
+{
+    process_t* leader = proc->group;
+    proc_free_stack(proc);
+    if (proc != leader)
     {
-        if(process_table[pid].state == PROC_UNUSED) 
+        proc->page_dir = 0;
+        proc->vdata_page = 0;
+        proc_release(proc);
+    }
+    proc_group_put(leader);
+}
+
+void proc_reap(process_t* proc)
+{
+    // It may still be on its way out of sched_exit on another CPU.
+    // on_cpu stays set from proc_exit until context_switch left its stack.
+    while (proc->on_cpu)
+        __asm__ volatile("pause");
+
+    proc_space_wait(proc);
+    proc_destroy(proc);
+}
+
+bool proc_space_get(process_t* proc)
+{
+    // The locked add orders the pin before the zombie check, proc_exit
+    // sets zombie before anyone reaps, so either we back off or the reaper waits
+    __sync_fetch_and_add(&proc->space_users, 1);
+    if (proc->zombie || proc->state == PROC_UNUSED || proc->state == PROC_CLAIMED || !proc->page_dir)
+    {
+        __sync_fetch_and_sub(&proc->space_users, 1);
+        return false;
+    }
+    return true;
+}
+
+void proc_space_put(process_t* proc)
+{
+    __sync_fetch_and_sub(&proc->space_users, 1);
+}
+
+void proc_space_wait(process_t* proc)
+{
+    // Our earlier stores (zombie, a new page_dir) must be visible before the load
+    __sync_synchronize();
+    while (proc->space_users)
+        __asm__ volatile("pause");
+}
+
+static void proc_reap_rcu(rcu_head_t* head)
+{
+    proc_reap((process_t*)((uint8_t*)head - __builtin_offsetof(process_t, rcu)));
+}
+
+void proc_exit(int32_t code)
+{
+    process_t* proc = proc_current();
+    process_t* orphans[PROC_MAX_COUNT];
+    int orphan_count = 0;
+
+    proc->exit_code = code;
+    ipc_exit(proc);
+
+    // Joiners sleep on the thread's id word
+    if (proc->clear_tid)
+    {
+        uint32_t zero = 0;
+        if (copy_to_user((void*)proc->clear_tid, &zero, sizeof(zero)) == 0)
+            futex_wake(proc->clear_tid, 0xFFFFFFFF);
+    }
+
+    // Children lose their parent, the ones that already exited are reaped here
+    uint32_t flags = spin_lock_irqsave(&proc_table_lock);
+    for (int i = 0; i < PROC_MAX_COUNT; i++)
+    {
+        process_t* child = &process_table[i];
+        if (child->parent != proc)
+            continue;
+
+        child->parent = 0;
+        if (child->zombie)
+            orphans[orphan_count++] = child;
+    }
+
+    proc->zombie = true;
+    process_t* parent = proc->parent;
+    spin_unlock_irqrestore(&proc_table_lock, flags);
+
+    for (int i = 0; i < orphan_count; i++)
+        proc_reap(orphans[i]);
+
+    // Nobody waits for it: the grace period ends after this CPU switched away
+    if (parent)
+        wake_up(&parent->child_wait, 0);
+    else
+        call_rcu(&proc->rcu, proc_reap_rcu);
+
+    sched_exit(code);
+}
+
+typedef struct
+{
+    process_t* proc;
+    int32_t pid;
+    bool has_child;
+    process_t* found;
+}
+proc_wait_ctx_t;
+
+static bool proc_wait_cond(void* arg)
+{
+    proc_wait_ctx_t* ctx = (proc_wait_ctx_t*)arg;
+    ctx->has_child = false;
+
+    uint32_t flags = spin_lock_irqsave(&proc_table_lock);
+    for (int i = 0; i < PROC_MAX_COUNT; i++)
+    {
+        process_t* child = &process_table[i];
+        if (child->parent != ctx->proc || (ctx->pid != -1 && child->id != ctx->pid))
+            continue;
+
+        ctx->has_child = true;
+        if (child->zombie)
         {
-            process_table[pid].state = PROC_RUNNING;
-            process_table[pid].kernel_stack_top = (uintptr_t)mem_phys_alloc();
-            process_table[pid].user_stack_top = USER_STACK_TOP;
-            current_process = &process_table[pid];
-            return current_process;
+            // Claimed: a concurrent waiter will not see it again
+            child->parent = 0;
+            ctx->found = child;
+            break;
         }
     }
-    return 0;
+    spin_unlock_irqrestore(&proc_table_lock, flags);
+
+    return ctx->found || !ctx->has_child;
+}
+
+int32_t proc_wait(int32_t pid, int32_t* code, bool nohang)
+{
+    proc_wait_ctx_t ctx = { proc_current(), pid, false, 0 };
+    if (!ctx.proc)
+        return -1;
+
+    wait_event_timeout(&ctx.proc->child_wait, proc_wait_cond, &ctx, nohang ? 0 : WAIT_FOREVER);
+    if (!ctx.found)
+        return ctx.has_child ? 0 : -1;
+
+    int32_t found_pid = ctx.found->id;
+    if (code)
+        *code = ctx.found->exit_code;
+    proc_reap(ctx.found);
+    return found_pid;
 }
 
 process_t* proc_current(void)
 {
-    return current_process;
-}
\ No newline at end of file
+    return this_cpu()->current;
+}
+
+void proc_set_current(process_t* proc)
+{
+    this_cpu()->current = proc;
+}
+
+// Lays out a fresh kernel stack: the user frame on top, below it what
+// context_switch pops, returning into interrupt_return and from there to ring 3.
+void proc_init_context(process_t* proc, uintptr_t entry, uintptr_t user_stack)
+{
+    interrupt_frame_t* frame = (interrupt_frame_t*)(proc->kernel_stack_top - sizeof(interrupt_frame_t));
+    for (int i = 0; i < (int)sizeof(interrupt_frame_t); i++)
+        ((uint8_t*)frame)[i] = 0;
+
+    frame->gs = frame->fs = frame->es = frame->ds = GDT_USER_DATA_SEL | 3;
+    frame->eip = entry;
+    frame->cs = GDT_USER_CODE_SEL | 3;
+    frame->eflags = PROC_USER_EFLAGS;
+    frame->useresp = user_stack;
+    frame->ss = GDT_USER_DATA_SEL | 3;
+    proc->frame = frame;
+
+    uint32_t* stack = (uint32_t*)frame;
+    *--stack = (uint32_t)interrupt_return;
+    *--stack = 0; // ebp
+    *--stack = 0; // ebx
+    *--stack = 0; // esi
+    *--stack = 0; // edi
+    proc->kernel_esp = (uintptr_t)stack;
+}
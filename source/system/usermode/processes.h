@@ -2,21 +2,98 @@
 #define K_PROC_MGR_H
 
 #include <stdint.h>
+#include <stdbool.h>
+
+#include "../interrupts/interrupts.h"
+#include "../time/timer.h"
+#include "../sync/rcu.h"
+#include "../sync/waitqueue.h"
+#include "../ipc/ipc.h"
+#include "fpu.h"
 
 #define PROC_MAX_COUNT  64
 
+#define PROC_KERNEL_STACK_SIZE  0x2000  // 8KB per process
+
 #define PROC_UNUSED     0
-#define PROC_RUNNING    1
-#define PROC_PAUSED     2
+#define PROC_RUNNING    1       // On the CPU or in the run queue
+#define PROC_PAUSED     2       // Blocked until woken
+#define PROC_EXITED     3       // Off the run queues for good, see proc_exit
+#define PROC_CLAIMED    4       // Slot taken but invisible to lookups (set up or torn down)
+
+#define PROC_USER_EFLAGS    0x202   // IF set
 
-typedef struct
+typedef struct process
 {
     uint16_t id;
     uint8_t state;
     uintptr_t kernel_stack_top;
     uintptr_t user_stack_top;
-    uint64_t regs[16];
+    uint32_t* page_dir;         // Address space (see mem_virt_create_space)
+    uintptr_t vdata_page;       // Per-process vdata_proc_t page, owned by page_dir
+    struct process* group;      // Thread group leader, owns page_dir; itself for a process
+    volatile uint32_t group_refs; // Leader only: threads on its space, itself included
+    uintptr_t clear_tid;        // User word zeroed and futex-woken when the thread exits
+    volatile uint32_t space_users; // Other processes editing page_dir, see proc_space_get
+    uintptr_t kernel_esp;       // Saved by context_switch while switched out
+    interrupt_frame_t* frame;   // User mode state, top of the kernel stack
+    struct process* run_next;   // Run queue link
+    uint8_t cpu;                // Run queue it belongs to
+    volatile uint32_t on_cpu;   // Still executing on its stack, cleared by context_switch
+    uint8_t static_prio;        // 0 is the highest, see SCHED_PRIO_LEVELS
+    uint8_t prio;               // Static priority adjusted by the interactivity bonus
+    uint32_t slice_ns;          // Time slice left
+    uint32_t sleep_avg;         // Recent blocked time, SCHED_TIME_SHIFT units
+    uint64_t timestamp;         // When it last started running or blocking
+    timer_entry_t sleep_timer;
+    int32_t exit_code;
+    struct process* parent;     // Reaps it through proc_wait, 0 if nobody will
+    volatile bool zombie;       // Exit code is final, waiting to be reaped
+    wait_queue_t child_wait;    // Woken when one of its children exits
+    ipc_state_t ipc;            // Synchronous IPC endpoint, see ipc.h
+    rcu_head_t rcu;             // Deferred reaping and slot reuse, see proc_release
+    bool fpu_used;              // fpu holds its state, otherwise it starts clean
+    uint8_t fpu_cpu;            // Where it last loaded the FPU, see fpu_switch
+    fpu_state_t fpu;            // FXSAVE area, current whenever it is off the CPU
 }
 process_t;
 
-#endif
\ No newline at end of file
+void proc_mgr_init(void);
+process_t* proc_create(void);
+process_t* proc_create_kernel(void);    // Stack only, see kthread.h
+
+// Another thread on owner's address space. Threads are detached: the kernel
+// reaps them as they exit, joining goes through clear_tid and a futex.
+// The space and the leader's slot stay until the last thread is gone.
+process_t* proc_create_thread(process_t* owner);
+process_t* proc_current(void);
+void proc_set_current(process_t* proc);
+
+// Lock-free pid lookup, under rcu_read_lock. The slot is not reused before
+// every reader that could have found it is gone.
+process_t* proc_find(uint16_t pid);
+void proc_release(process_t* proc);
+
+// Frees the kernel stack, then the slot. The address space goes with the
+// last thread of the group. The process must never run again; proc_reap
+// also waits for it to be off its stack.
+void proc_destroy(process_t* proc);
+void proc_reap(process_t* proc);
+
+// Pins the address space of another process while its page tables are
+// edited (shared memory). Fails once it started exiting; reaping and exec
+// wait for the pins to go.
+bool proc_space_get(process_t* proc);
+void proc_space_put(process_t* proc);
+void proc_space_wait(process_t* proc);
+
+// Ends the current process. Its parent collects the exit code with
+// proc_wait, orphans are reaped by the kernel.
+void proc_exit(int32_t code) __attribute__((noreturn));
+
+// Reaps an exited child (pid, or any child for -1) and returns its pid.
+// 0 if none has exited and nohang is set, -1 if there is no such child.
+int32_t proc_wait(int32_t pid, int32_t* code, bool nohang);
+void proc_init_context(process_t* proc, uintptr_t entry, uintptr_t user_stack);
+
+#endif
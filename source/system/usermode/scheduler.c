@@ -0,0 +1,609 @@
+#include "scheduler.h"
+#include "fpu.h"
+#include "../interrupts/softirq.h"
+#include "../memory/virtual.h"
+#include "../smp/smp.h"
+#include "../sync/spinlock.h"
+#include "../sync/rcu.h"
+#include "../time/timer.h"
+#include "../time/clock.h"
+#include "../../boot/idt/idt.h"
+#include "../../arch/x86/cpu.h"
+
+#define SCHED_NO_CPU    0xFFFFFFFF
+
+// One FIFO per priority level, the bitmap marks the non-empty ones
+typedef struct
+{
+    uint32_t bitmap;
+    uint32_t count;
+    process_t* head[SCHED_PRIO_LEVELS];
+    process_t* tail[SCHED_PRIO_LEVELS];
+}
+sched_prio_array_t;
+
+// Per-CPU run queue. Processes that used up their slice wait in the expired
+// array until the active one drains, then the two swap. The running one is
+// in neither. Only one run queue lock is ever held at a time; the timer lock
+// nests inside it.
+typedef struct
+{
+    ticket_lock_t lock;
+    lock_stats_t lock_stats;
+    uint32_t id;
+    bool online;
+
+    // Stands in for the CPU's boot thread while it idles, never queued
+    process_t idle_proc;
+    process_t* running;
+
+    sched_prio_array_t arrays[2];
+    sched_prio_array_t* active;
+    sched_prio_array_t* expired;
+
+    timer_entry_t slice_timer;
+    volatile bool need_resched;
+}
+sched_cpu_t;
+
+static sched_cpu_t sched_cpus[SMP_MAX_CPUS];
+
+// Interrupts must be off for the result to stay valid
+static sched_cpu_t* sched_this_cpu(void)
+{
+    return &sched_cpus[smp_cpu_id()];
+}
+
+static void sched_enqueue(sched_prio_array_t* array, process_t* proc)
+{
+    uint8_t prio = proc->prio;
+    proc->run_next = 0;
+    if (array->tail[prio])
+        array->tail[prio]->run_next = proc;
+    else
+        array->head[prio] = proc;
+    array->tail[prio] = proc;
+    array->bitmap |= 1u << prio;
+    array->count++;
+}
+
+static process_t* sched_dequeue_level(sched_prio_array_t* array, uint32_t prio)
+{
+    process_t* proc = array->head[prio];
+
+    array->head[prio] = proc->run_next;
+    if (!array->head[prio])
+    {
+        array->tail[prio] = 0;
+        array->bitmap &= ~(1u << prio);
+    }
+    array->count--;
+    proc->run_next = 0;
+    return proc;
+}
+
+static process_t* sched_dequeue(sched_prio_array_t* array)
+{
+    if (!array->bitmap)
+        return 0;
+
+    // bsf: lowest set bit is the highest priority
+    return sched_dequeue_level(array, (uint32_t)__builtin_ctz(array->bitmap));
+}
+
+static process_t* sched_dequeue_lowest(sched_prio_array_t* array)
+{
+    if (!array->bitmap)
+        return 0;
+
+    // bsr: highest set bit is the lowest priority
+    return sched_dequeue_level(array, 31 - (uint32_t)__builtin_clz(array->bitmap));
+}
+
+static uint32_t sched_queued(const sched_cpu_t* rq)
+{
+    return rq->active->count + rq->expired->count;
+}
+
+static bool sched_is_idle(const sched_cpu_t* rq)
+{
+    return rq->running == &rq->idle_proc;
+}
+
+static uint32_t sched_slice_for(uint8_t static_prio)
+{
+    return SCHED_SLICE_MIN_NS + (SCHED_PRIO_LEVELS - 1 - static_prio) * SCHED_SLICE_STEP_NS;
+}
+
+static int sched_bonus(const process_t* proc)
+{
+    // 0 .. SCHED_MAX_SLEEP_AVG maps onto -SCHED_MAX_BONUS .. +SCHED_MAX_BONUS
+    return (int)((proc->sleep_avg * SCHED_MAX_BONUS * 2) / SCHED_MAX_SLEEP_AVG) - SCHED_MAX_BONUS;
+}
+
+static void sched_update_prio(process_t* proc)
+{
+    int prio = (int)proc->static_prio - sched_bonus(proc);
+    if (prio < 0)
+        prio = 0;
+    if (prio > SCHED_PRIO_LEVELS - 1)
+        prio = SCHED_PRIO_LEVELS - 1;
+    proc->prio = (uint8_t)prio;
+}
+
+// Charges the time since it was switched in to its slice and sleep average
+static void sched_account(process_t* proc, uint64_t now)
+{
+    uint64_t ran = now - proc->timestamp;
+    proc->slice_ns = ran >= proc->slice_ns ? 0 : proc->slice_ns - (uint32_t)ran;
+
+    uint32_t units = (uint32_t)(ran >> SCHED_TIME_SHIFT);
+    proc->sleep_avg = units >= proc->sleep_avg ? 0 : proc->sleep_avg - units;
+    proc->timestamp = now;
+}
+
+static void sched_requeue(sched_cpu_t* rq, process_t* proc)
+{
+    if (proc->slice_ns)
+    {
+        // Preempted or yielding with time left, back of its level
+        sched_enqueue(rq->active, proc);
+        return;
+    }
+
+    proc->slice_ns = sched_slice_for(proc->static_prio);
+    sched_update_prio(proc);
+
+    if (sched_bonus(proc) >= SCHED_INTERACTIVE_BONUS)
+        sched_enqueue(rq->active, proc);
+    else
+        sched_enqueue(rq->expired, proc);
+}
+
+static process_t* sched_pick_next(sched_cpu_t* rq)
+{
+    if (!rq->active->count)
+    {
+        sched_prio_array_t* swap = rq->active;
+        rq->active = rq->expired;
+        rq->expired = swap;
+    }
+    return sched_dequeue(rq->active);
+}
+
+// Lock held: proc was just queued on rq. Returns the CPU to send a
+// reschedule IPI to once the lock is dropped, or SCHED_NO_CPU.
+static uint32_t sched_check_preempt(sched_cpu_t* rq, process_t* proc)
+{
+    if (proc->prio < rq->running->prio)
+    {
+        rq->need_resched = true;
+        return rq->id == smp_cpu_id() ? SCHED_NO_CPU : rq->id;
+    }
+
+    // It has to wait here, an idle CPU can come and take it
+    for (uint32_t i = 0; i < SMP_MAX_CPUS; i++)
+    {
+        if (i != rq->id && sched_cpus[i].online && sched_is_idle(&sched_cpus[i]))
+            return i;
+    }
+    return SCHED_NO_CPU;
+}
+
+static void sched_kick(uint32_t cpu)
+{
+    if (cpu != SCHED_NO_CPU)
+        smp_send_ipi(cpu, SMP_RESCHED_VECTOR);
+}
+
+// Runs on whichever CPU services the timer wheel
+static void sched_slice_expired(void* ctx)
+{
+    sched_cpu_t* rq = (sched_cpu_t*)ctx;
+    rq->need_resched = true;
+    if (rq->id != smp_cpu_id())
+        smp_send_ipi(rq->id, SMP_RESCHED_VECTOR);
+}
+
+// Only worth a timer when someone is waiting for the CPU
+static void sched_arm_slice(sched_cpu_t* rq, uint64_t now)
+{
+    process_t* proc = rq->running;
+    if (sched_is_idle(rq) || !sched_queued(rq))
+    {
+        timer_cancel(&rq->slice_timer);
+        return;
+    }
+
+    if (timer_pending(&rq->slice_timer))
+        return;
+
+    uint64_t ran = now - proc->timestamp;
+    timer_add(&rq->slice_timer, ran >= proc->slice_ns ? 0 : proc->slice_ns - ran);
+}
+
+// Takes a waiting process from the busiest other run queue, the lowest
+// priority expired one first since it is the least urgent there
+static process_t* sched_steal(sched_cpu_t* rq)
+{
+    sched_cpu_t* victim = 0;
+    uint32_t most = 0;
+
+    // Unlocked peek, only a hint
+    for (uint32_t i = 0; i < SMP_MAX_CPUS; i++)
+    {
+        sched_cpu_t* other = &sched_cpus[i];
+        if (other != rq && other->online && sched_queued(other) > most)
+        {
+            most = sched_queued(other);
+            victim = other;
+        }
+    }
+
+    if (!victim)
+        return 0;
+
+    ticket_lock(&victim->lock);
+    process_t* proc = sched_dequeue_lowest(victim->expired);
+    if (!proc)
+        proc = sched_dequeue_lowest(victim->active);
+    if (proc)
+        proc->cpu = (uint8_t)rq->id;
+    if (!sched_queued(victim))
+        timer_cancel(&victim->slice_timer);
+    ticket_unlock(&victim->lock);
+
+    return proc;
+}
+
+static void sched_switch_finish(sched_cpu_t* rq, process_t* prev, process_t* next, uint64_t now);
+
+// Interrupts off, rq->lock held and released here. Callers set the state
+// of the running process under the lock so a wakeup on another CPU cannot
+// slip in between.
+static void sched_switch(sched_cpu_t* rq)
+{
+    rcu_qs(); // Read sections never span a switch
+
+    uint64_t now = clock_monotonic_ns();
+    process_t* prev = rq->running;
+
+    if (prev != &rq->idle_proc)
+    {
+        sched_account(prev, now);
+        if (prev->state == PROC_RUNNING)
+            sched_requeue(rq, prev);
+    }
+
+    process_t* next = sched_pick_next(rq);
+    if (!next)
+        next = &rq->idle_proc;
+
+    sched_switch_finish(rq, prev, next, now);
+}
+
+// Second half of a switch, rq->lock held and released here. next is off
+// the run queues already.
+static void sched_switch_finish(sched_cpu_t* rq, process_t* prev, process_t* next, uint64_t now)
+{
+    rq->need_resched = false;
+    timer_cancel(&rq->slice_timer);
+    next->timestamp = now;
+
+    if (next == prev)
+    {
+        sched_arm_slice(rq, now);
+        ticket_unlock(&rq->lock);
+        return;
+    }
+
+    // Idle and kernel threads run on the kernel space: a process space left
+    // loaded here could be freed by its reaper on another CPU
+    mem_virt_switch(next->page_dir ? next->page_dir : mem_virt_kernel_space());
+    fpu_switch(prev, next);
+
+    if (next != &rq->idle_proc)
+    {
+        tss_set_kernel_stack(next->kernel_stack_top);
+
+        if (prev == &rq->idle_proc)
+            timer_idle_exit();
+    }
+
+    rq->running = next;
+    proc_set_current(next == &rq->idle_proc ? 0 : next);
+    sched_arm_slice(rq, now);
+    ticket_unlock(&rq->lock);
+
+    // Freshly stolen or woken, its old CPU may still be on its stack
+    while (next->on_cpu)
+        __asm__ volatile("pause");
+    next->on_cpu = 1;
+
+    context_switch(&prev->kernel_esp, next->kernel_esp, &prev->on_cpu);
+}
+
+void sched_init_cpu(uint32_t cpu)
+{
+    sched_cpu_t* rq = &sched_cpus[cpu];
+
+    ticket_init(&rq->lock);
+    rq->lock_stats = (lock_stats_t)LOCK_STATS_INIT("runqueue");
+    rq->lock.stats = &rq->lock_stats;
+    lock_stats_register(&rq->lock_stats);
+    rq->id = cpu;
+    rq->idle_proc.id = 0;
+    rq->idle_proc.state = PROC_RUNNING;
+    rq->idle_proc.prio = SCHED_PRIO_LEVELS; // Below every real level
+    rq->idle_proc.cpu = (uint8_t)cpu;
+    rq->idle_proc.on_cpu = 1;
+    rq->running = &rq->idle_proc;
+    rq->active = &rq->arrays[0];
+    rq->expired = &rq->arrays[1];
+    timer_setup(&rq->slice_timer, sched_slice_expired, rq);
+
+    proc_set_current(0);
+    __sync_synchronize();
+    rq->online = true;
+}
+
+void sched_init(void)
+{
+    sched_init_cpu(0);
+}
+
+void sched_add(process_t* proc)
+{
+    // Least loaded CPU, counting the running process
+    sched_cpu_t* rq = &sched_cpus[0];
+    uint32_t best = SCHED_NO_CPU;
+    for (uint32_t i = 0; i < SMP_MAX_CPUS; i++)
+    {
+        sched_cpu_t* other = &sched_cpus[i];
+        uint32_t load = sched_queued(other) + !sched_is_idle(other);
+        if (other->online && load < best)
+        {
+            best = load;
+            rq = other;
+        }
+    }
+
+    uint32_t flags = ticket_lock_irqsave(&rq->lock);
+
+    proc->cpu = (uint8_t)rq->id;
+    proc->state = PROC_RUNNING;
+    proc->sleep_avg = SCHED_MAX_SLEEP_AVG / 2; // No bonus either way
+    proc->slice_ns = sched_slice_for(proc->static_prio);
+    sched_update_prio(proc);
+    sched_enqueue(rq->active, proc);
+
+    uint32_t kick = sched_check_preempt(rq, proc);
+    sched_arm_slice(rq, clock_monotonic_ns());
+
+    ticket_unlock_irqrestore(&rq->lock, flags);
+    sched_kick(kick);
+}
+
+void sched_wake(process_t* proc, uint32_t flags)
+{
+    uint32_t kick = SCHED_NO_CPU;
+
+    // A paused process cannot be stolen, its cpu is stable until it runs
+    sched_cpu_t* rq = &sched_cpus[proc->cpu];
+    uint32_t irq_flags = ticket_lock_irqsave(&rq->lock);
+
+    if (proc->state == PROC_PAUSED && proc == rq->running)
+    {
+        // Between sched_prepare_wait and sched_finish_wait: still on the
+        // CPU, it just does not go to sleep
+        proc->state = PROC_RUNNING;
+        if (flags & SCHED_WAKE_STDIN)
+            proc->sleep_avg = SCHED_MAX_SLEEP_AVG;
+    }
+    else if (proc->state == PROC_PAUSED)
+    {
+        uint64_t now = clock_monotonic_ns();
+
+        // Blocked time counts towards the interactivity bonus
+        uint32_t slept = (uint32_t)((now - proc->timestamp) >> SCHED_TIME_SHIFT);
+        proc->sleep_avg = slept >= SCHED_MAX_SLEEP_AVG - proc->sleep_avg ?
+            SCHED_MAX_SLEEP_AVG : proc->sleep_avg + slept;
+        if (flags & SCHED_WAKE_STDIN)
+            proc->sleep_avg = SCHED_MAX_SLEEP_AVG;
+
+        sched_update_prio(proc);
+        proc->state = PROC_RUNNING;
+        sched_enqueue(rq->active, proc);
+
+        kick = sched_check_preempt(rq, proc);
+        sched_arm_slice(rq, now);
+    }
+
+    ticket_unlock_irqrestore(&rq->lock, irq_flags);
+    sched_kick(kick);
+}
+
+bool sched_switch_to(process_t* next)
+{
+    uint32_t flags = irq_save();
+    sched_cpu_t* rq = sched_this_cpu();
+    ticket_lock(&rq->lock);
+
+    // Only a blocked process of this CPU can be taken without the run queue
+    process_t* prev = rq->running;
+    if (prev == &rq->idle_proc || next->cpu != rq->id || next->state != PROC_PAUSED || next == prev)
+    {
+        ticket_unlock(&rq->lock);
+        irq_restore(flags);
+        return false;
+    }
+
+    // Both sides were blocked for a few instructions, neither gains
+    // interactivity credit from it
+    uint64_t now = clock_monotonic_ns();
+    sched_account(prev, now);
+    if (prev->state == PROC_RUNNING)
+        sched_requeue(rq, prev);
+
+    next->state = PROC_RUNNING;
+    sched_switch_finish(rq, prev, next, now);
+    irq_restore(flags);
+    return true;
+}
+
+void sched_set_priority(process_t* proc, uint8_t static_prio)
+{
+    if (static_prio >= SCHED_PRIO_LEVELS)
+        static_prio = SCHED_PRIO_LEVELS - 1;
+
+    // Queued processes pick it up on their next requeue
+    sched_cpu_t* rq = &sched_cpus[proc->cpu];
+    uint32_t flags = ticket_lock_irqsave(&rq->lock);
+    proc->static_prio = static_prio;
+    if (proc == rq->running)
+        sched_update_prio(proc);
+    ticket_unlock_irqrestore(&rq->lock, flags);
+}
+
+void sched_yield(void)
+{
+    uint32_t flags = irq_save();
+    sched_cpu_t* rq = sched_this_cpu();
+    ticket_lock(&rq->lock);
+    sched_switch(rq);
+    irq_restore(flags);
+}
+
+void sched_block(void)
+{
+    uint32_t flags = irq_save();
+    sched_cpu_t* rq = sched_this_cpu();
+    ticket_lock(&rq->lock);
+    rq->running->state = PROC_PAUSED;
+    sched_switch(rq);
+    irq_restore(flags);
+}
+
+void sched_prepare_wait(void)
+{
+    uint32_t flags = irq_save();
+    sched_cpu_t* rq = sched_this_cpu();
+    ticket_lock(&rq->lock);
+    rq->running->state = PROC_PAUSED;
+    ticket_unlock(&rq->lock);
+    irq_restore(flags);
+}
+
+void sched_finish_wait(void)
+{
+    uint32_t flags = irq_save();
+    sched_cpu_t* rq = sched_this_cpu();
+    ticket_lock(&rq->lock);
+
+    // A wakeup since sched_prepare_wait already made it runnable again
+    if (rq->running->state == PROC_PAUSED)
+        sched_switch(rq);
+    else
+        ticket_unlock(&rq->lock);
+
+    irq_restore(flags);
+}
+
+void sched_cancel_wait(void)
+{
+    uint32_t flags = irq_save();
+    sched_cpu_t* rq = sched_this_cpu();
+    ticket_lock(&rq->lock);
+    rq->running->state = PROC_RUNNING;
+    ticket_unlock(&rq->lock);
+    irq_restore(flags);
+}
+
+static void sched_sleep_wake(void* ctx)
+{
+    sched_wake((process_t*)ctx, 0);
+}
+
+void sched_sleep_ns(uint64_t ns)
+{
+    process_t* proc = proc_current();
+    if (!proc)
+    {
+        timer_sleep_ns(ns);
+        return;
+    }
+
+    uint32_t flags = irq_save();
+    sched_cpu_t* rq = sched_this_cpu();
+    ticket_lock(&rq->lock);
+
+    // Paused before the timer can fire elsewhere, its wakeup waits for the lock
+    proc->state = PROC_PAUSED;
+    timer_setup(&proc->sleep_timer, sched_sleep_wake, proc);
+    timer_add(&proc->sleep_timer, ns);
+    sched_switch(rq);
+    irq_restore(flags);
+}
+
+void sched_exit(int32_t code)
+{
+    irq_save();
+
+    sched_cpu_t* rq = sched_this_cpu();
+    ticket_lock(&rq->lock);
+
+    process_t* proc = rq->running;
+    proc->exit_code = code;
+    proc->state = PROC_EXITED;
+    timer_cancel(&proc->sleep_timer);
+    sched_switch(rq);
+
+    // Never picked again
+    while (1) __asm__ volatile("hlt");
+}
+
+void sched_preempt(void)
+{
+    uint32_t flags = irq_save();
+    sched_cpu_t* rq = sched_this_cpu();
+    if (rq->need_resched)
+    {
+        ticket_lock(&rq->lock);
+        sched_switch(rq);
+    }
+    irq_restore(flags);
+}
+
+void sched_idle_loop(void)
+{
+    while (1)
+    {
+        softirq_run(); // Whatever the interrupt exits left behind
+        rcu_qs();
+
+        __asm__ volatile("cli");
+        sched_cpu_t* rq = sched_this_cpu();
+
+        ticket_lock(&rq->lock);
+        if (!sched_queued(rq))
+        {
+            ticket_unlock(&rq->lock);
+            process_t* proc = sched_steal(rq);
+            ticket_lock(&rq->lock);
+            if (proc)
+                sched_enqueue(rq->active, proc);
+        }
+
+        if (sched_queued(rq))
+        {
+            sched_switch(rq);
+            __asm__ volatile("sti");
+            continue;
+        }
+        ticket_unlock(&rq->lock);
+
+        // sti;hlt is atomic, a wakeup IPI cannot slip in between the check and the halt
+        timer_idle_enter();
+        __asm__ volatile("sti\n\thlt" : : : "memory");
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef K_SCHEDULER_H
+#define K_SCHEDULER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "processes.h"
+
+// Priority levels, one bit each in the run queue bitmap, 0 is the highest
+#define SCHED_PRIO_LEVELS       32
+#define SCHED_PRIO_DEFAULT      16
+
+// Time slices grow with priority: 5ms at the lowest level, 160ms at the highest
+#define SCHED_SLICE_MIN_NS      5000000
+#define SCHED_SLICE_STEP_NS     5000000
+
+// Interactivity: blocked time earns up to +-SCHED_MAX_BONUS levels
+#define SCHED_TIME_SHIFT        20          // ns >> 20, about a millisecond
+#define SCHED_MAX_SLEEP_AVG     1024        // About a second, power of two
+#define SCHED_MAX_BONUS         5
+#define SCHED_INTERACTIVE_BONUS 2           // Goes back to the active array when its slice runs out
+
+// sched_wake flags
+#define SCHED_WAKE_STDIN        0x01        // Was waiting for keyboard input, full boost
+
+// Saves ebp/ebx/esi/edi and the stack pointer, resumes new_esp, then clears
+// *old_on_cpu (switch.asm)
+extern void context_switch(uintptr_t* old_esp, uintptr_t new_esp, volatile uint32_t* old_on_cpu);
+
+// BSP run queue, then one per application processor as it comes online
+void sched_init(void);
+void sched_init_cpu(uint32_t cpu);
+
+// New or woken process joins its priority level in the active array.
+// New ones go to the least loaded CPU, woken ones back to the CPU they ran on.
+void sched_add(process_t* proc);
+void sched_wake(process_t* proc, uint32_t flags);
+void sched_set_priority(process_t* proc, uint8_t static_prio);
+
+// Only from process context (system calls)
+void sched_yield(void);
+void sched_block(void);
+
+// Race-free blocking on a condition (see wait_event_timeout): mark the
+// process paused, re-check the condition, then either sleep or cancel.
+// A sched_wake in between turns sched_finish_wait into a no-op.
+void sched_prepare_wait(void);
+void sched_finish_wait(void);
+void sched_cancel_wait(void);
+
+// Between sched_prepare_wait and sched_finish_wait: hands the CPU straight to
+// next, a process blocked on this CPU, without going through the run queue
+// (IPC call/reply). Returns once the caller runs again; false if next cannot
+// be taken this way and has to be woken normally.
+bool sched_switch_to(process_t* next);
+void sched_sleep_ns(uint64_t ns);
+void sched_exit(int32_t code) __attribute__((noreturn));
+
+// Interrupt exit hook, switches if the time slice ran out or a higher priority woke up
+void sched_preempt(void);
+
+// The boot thread (and each AP's boot thread) becomes its CPU's idle task,
+// it pulls work from the busiest run queue before halting
+void sched_idle_loop(void) __attribute__((noreturn));
+
+#endif
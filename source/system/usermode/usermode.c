@@ -1,70 +1,199 @@
 #include "usermode.h"
 #include "processes.h"
+#include "scheduler.h"
+#include "vdata.h"
+#include "fpu.h"
 #include "../shell/shell.h"
 #include "../filesystem/ext2/ext2.h"
+#include "../memory/virtual.h"
+#include "../memory/uaccess.h"
+#include "../sync/spinlock.h"
+#include "../time/clock.h"
+#include "../lib/math64.h"
+#include "../log/klog.h"
 
 extern ext2_fs_t g_ext2_fs;
 extern shell_instance_t* g_kernel_shell;
+uint32_t ext2_find_file_inode_by_name(ext2_fs_t* fs, const char* filename);
 
-void um_setup_env(const char* program_name) 
+// Time from um_spawn entry to the child being runnable
+static spinlock_t um_spawn_lock = SPINLOCK_INIT;
+static uint32_t um_spawn_count = 0;
+static uint64_t um_spawn_total_ns = 0;
+static uint64_t um_spawn_max_ns = 0;
+
+// Reads the program into the current address space.
+// Pages are faulted in as they are written.
+static bool um_load(const char* program_name, uint32_t inode_num)
 {
-    // Create new process
-    process_t* proc = proc_create();
-    if (!proc) 
+    ext2_inode_t inode;
+    if (!inode_num || !ext2_read_inode(&g_ext2_fs, inode_num, &inode))
     {
-        sh_puts(g_kernel_shell, "Failed to create process\r\n");
-        return;
+        klog(KLOG_ERR, "Failed to find program: %s", program_name);
+        return false;
     }
 
-    // Set up TSS with kernel stack for when we return from user mode
-    tss_set_kernel_stack(proc->kernel_stack_top);
-    
-    // Find program file
-    ext2_inode_t inode;
-    uint32_t inode_num = ext2_find_file_inode_by_name(&g_ext2_fs, program_name);
-    if (!inode_num || !ext2_read_inode(&g_ext2_fs, inode_num, &inode)) 
+    if (inode.i_size_lo > USER_STACK_TOP - USER_STACK_SIZE - USER_CODE_BASE)
     {
-        sh_printf(g_kernel_shell, "Failed to find program: %s\r\n", program_name);
-        return;
+        klog(KLOG_ERR, "Program too large: %s", program_name);
+        return false;
     }
 
-    // Read program into user space
     uint8_t* user_code = (uint8_t*)USER_CODE_BASE;
     size_t bytes_read = ext2_read_file(&g_ext2_fs, &inode, user_code, inode.i_size_lo, 0);
-    
-    if (bytes_read != inode.i_size_lo) 
+
+    if (bytes_read != inode.i_size_lo)
     {
-        sh_printf(g_kernel_shell, "Failed to read complete program (read %d of %d bytes)\r\n", 
-                 bytes_read, inode.i_size_lo);
-        return;
+        klog(KLOG_ERR, "Failed to read complete program (read %d of %d bytes)",
+             bytes_read, inode.i_size_lo);
+        return false;
+    }
+    return true;
+}
+
+static process_t* um_create(const char* program_name, uint32_t inode_num, process_t* parent)
+{
+    process_t* proc = proc_create();
+    if (!proc)
+    {
+        klog(KLOG_ERR, "Failed to create process");
+        return 0;
+    }
+
+    // Nothing can switch us out in here, the caller's space comes back before returning
+    uint32_t* prev_space = mem_virt_current_space();
+    mem_virt_switch(proc->page_dir);
+    bool loaded = um_load(program_name, inode_num);
+    mem_virt_switch(prev_space);
+
+    if (!loaded)
+    {
+        proc_destroy(proc);
+        return 0;
+    }
+
+    // First switch to it irets straight into the program
+    proc->parent = parent;
+    proc_init_context(proc, USER_CODE_BASE, proc->user_stack_top);
+    sched_add(proc);
+    return proc;
+}
+
+process_t* um_setup_env(const char* program_name)
+{
+    return um_create(program_name, ext2_find_file_inode_by_name(&g_ext2_fs, program_name), 0);
+}
+
+process_t* um_spawn(const char* program_name, process_t* parent)
+{
+    uint64_t start = clock_monotonic_ns();
+
+    // Straight through the name cache, no directory dump
+    process_t* proc = um_create(program_name, ext2_lookup(&g_ext2_fs, EXT2_ROOT_INO, program_name), parent);
+    if (!proc)
+        return 0;
+
+    uint64_t elapsed = clock_monotonic_ns() - start;
+    uint32_t flags = spin_lock_irqsave(&um_spawn_lock);
+    um_spawn_count++;
+    um_spawn_total_ns += elapsed;
+    if (elapsed > um_spawn_max_ns)
+        um_spawn_max_ns = elapsed;
+    spin_unlock_irqrestore(&um_spawn_lock, flags);
+    return proc;
+}
+
+bool um_exec(const char* program_name, interrupt_frame_t* frame)
+{
+    process_t* proc = proc_current();
+    if (proc->group != proc || proc->group_refs != 1)
+        return false; // Other threads still run on the old image
+
+    uint32_t inode_num = ext2_lookup(&g_ext2_fs, EXT2_ROOT_INO, program_name);
+    if (!inode_num)
+        return false;
+
+    // Build the new image in a fresh space, the old one stays intact until it succeeded
+    uint32_t* old_space = proc->page_dir;
+    uintptr_t old_vdata = proc->vdata_page;
+    proc->page_dir = mem_virt_create_space();
+    if (!proc->page_dir || !vdata_map(proc))
+    {
+        if (proc->page_dir)
+            mem_virt_destroy_space(proc->page_dir);
+        proc->page_dir = old_space;
+        proc->vdata_page = old_vdata;
+        return false;
+    }
+
+    mem_virt_switch(proc->page_dir);
+    if (!um_load(program_name, inode_num))
+    {
+        uint32_t* new_space = proc->page_dir;
+        proc->page_dir = old_space;
+        proc->vdata_page = old_vdata;
+        mem_virt_switch(old_space);
+        mem_virt_destroy_space(new_space);
+        return false;
+    }
+
+    // Only this CPU ever had the old space loaded while this process ran on it.
+    // Shared memory set up by others from here on goes to the new one.
+    proc_space_wait(proc);
+    mem_virt_destroy_space(old_space);
+
+    // Start over at the entry point with a clean register file
+    fpu_reset(proc);
+    for (int i = 0; i < (int)sizeof(interrupt_frame_t); i++)
+        ((uint8_t*)frame)[i] = 0;
+
+    frame->gs = frame->fs = frame->es = frame->ds = GDT_USER_DATA_SEL | 3;
+    frame->eip = USER_CODE_BASE;
+    frame->cs = GDT_USER_CODE_SEL | 3;
+    frame->eflags = PROC_USER_EFLAGS;
+    frame->useresp = proc->user_stack_top;
+    frame->ss = GDT_USER_DATA_SEL | 3;
+    return true;
+}
+
+process_t* um_thread(uintptr_t entry, uintptr_t stack_top, uint32_t arg, uintptr_t tid_addr)
+{
+    if (entry < USER_CODE_BASE || entry >= USER_STACK_TOP ||
+        stack_top <= USER_CODE_BASE || stack_top > USER_STACK_TOP || (stack_top & 3))
+        return 0;
+
+    process_t* proc = proc_current();
+    process_t* thread = proc_create_thread(proc);
+    if (!thread)
+        return 0;
+
+    uint32_t tid = thread->id;
+    if (tid_addr && copy_to_user((void*)tid_addr, &tid, sizeof(tid)) != 0)
+    {
+        proc_destroy(thread);
+        return 0;
     }
+
+    thread->clear_tid = tid_addr;
+    thread->static_prio = proc->static_prio;
+    proc_init_context(thread, entry, stack_top);
+    thread->frame->eax = arg;
+    sched_add(thread);
+    return thread;
 }
 
-void um_switch(void) 
+void um_spawn_stats_dump(void)
 {
-    // Set up user data segment
-    __asm__ volatile (
-        "mov $0x23, %%ax\n\t"      // User data selector (GDT entry 4, RPL=3)
-        "mov %%ax, %%ds\n\t"
-        "mov %%ax, %%es\n\t"
-        "mov %%ax, %%fs\n\t"
-        "mov %%ax, %%gs\n\t"
-        :
-        :
-        : "ax"
-    );
-    
-    // Push values for iret to user mode
-    __asm__ volatile (
-        "pushl $0x23\n\t"              // SS (user data selector)
-        "pushl %0\n\t"                 // ESP (user stack)
-        "pushf\n\t"                    // EFLAGS
-        "orl $0x200, (%%esp)\n\t"      // Enable interrupts in EFLAGS
-        "pushl $0x1B\n\t"              // CS (user code selector)
-        "pushl %1\n\t"                 // EIP (user program address)
-        "iret\n\t"                     // Switch to user mode
-        :
-        : "r" (USER_STACK_TOP), "r" (USER_CODE_BASE)
-        : "memory"
-    );
-}
\ No newline at end of file
+    if (!g_kernel_shell)
+        return;
+
+    uint32_t flags = spin_lock_irqsave(&um_spawn_lock);
+    uint32_t count = um_spawn_count;
+    uint64_t total = um_spawn_total_ns;
+    uint64_t max = um_spawn_max_ns;
+    spin_unlock_irqrestore(&um_spawn_lock, flags);
+
+    uint64_t avg = count ? udiv64_32(total, count, 0) : 0;
+    sh_printf(g_kernel_shell, "SPAWNS %u, AVG %u us, MAX %u us\r\n", count,
+              (uint32_t)udiv64_32(avg, 1000, 0), (uint32_t)udiv64_32(max, 1000, 0));
+}
@@ -2,14 +2,34 @@
 #define K_USERMODE_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "../../boot/gdt/gdt.h"
+#include "../interrupts/interrupts.h"
+
+struct process;
 
 #define USER_STACK_SIZE     0x2000      // 8KB user stack
-#define USER_STACK_TOP      0x800000    // 8MB mark for user stack
+#define USER_STACK_TOP      0x7FE000    // Just below the kernel data pages
 #define USER_CODE_BASE      0x400000    // 4MB mark for user code
+#define USER_VDATA_BASE     0x7FE000    // Read-only kernel data pages (see vdata.h)
+
+// Loads a program into a new process and hands it to the scheduler
+struct process* um_setup_env(const char* program_name);
+
+// Same as um_setup_env without the boot diagnostics; the child is reaped by
+// parent (0 for the kernel). No fork, the program starts from its entry point.
+struct process* um_spawn(const char* program_name, struct process* parent);
+
+// Replaces the current process image. On success frame returns into the
+// new program, on failure nothing changed. Only for single threaded processes.
+bool um_exec(const char* program_name, interrupt_frame_t* frame);
 
-void um_switch(void);
+// Starts a thread of the current process at entry with eax = arg on its own
+// user stack. If tid_addr is set the thread id is stored there before it runs,
+// and cleared with a FUTEX_WAKE when it exits.
+struct process* um_thread(uintptr_t entry, uintptr_t stack_top, uint32_t arg, uintptr_t tid_addr);
 
-void um_setup_env(const char* program_name);
+// Spawn count and latency (entry to runnable), in microseconds
+void um_spawn_stats_dump(void);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,91 @@
+#include "vdata.h"
+#include "../memory/physical.h"
+#include "../memory/virtual.h"
+#include "../time/timer.h"
+
+static vdata_clock_t* vdata_clock = 0;
+
+static void vdata_write_begin(void)
+{
+    vdata_clock->seq++;
+    __asm__ volatile("" ::: "memory");
+}
+
+static void vdata_write_end(void)
+{
+    __asm__ volatile("" ::: "memory");
+    vdata_clock->seq++;
+}
+
+static void vdata_zero_page(void* page)
+{
+    uint32_t* words = (uint32_t*)page;
+    for (int i = 0; i < PAGE_SIZE / 4; i++)
+        words[i] = 0;
+}
+
+bool vdata_init(void)
+{
+    vdata_clock = (vdata_clock_t*)mem_phys_alloc();
+    if (!vdata_clock)
+        return false;
+
+    vdata_zero_page(vdata_clock);
+    vdata_clock->tick_hz = TIMER_HZ;
+    return true;
+}
+
+bool vdata_map(process_t* proc)
+{
+    vdata_proc_t* page = (vdata_proc_t*)mem_phys_alloc();
+    if (!page)
+        return false;
+
+    vdata_zero_page(page);
+    page->pid = proc->id;
+    proc->vdata_page = (uintptr_t)page;
+
+    // Mapped without PAGE_WRITABLE, with CR0.WP set not even ring 0 may write through these.
+    // The process page belongs to the space and goes with it, the clock page is shared.
+    if (!mem_virt_map_in(proc->page_dir, (void*)VDATA_PROC_ADDR, page, PAGE_USER))
+    {
+        mem_phys_free(page);
+        proc->vdata_page = 0;
+        return false;
+    }
+    return mem_virt_map_in(proc->page_dir, (void*)VDATA_CLOCK_ADDR, vdata_clock, PAGE_USER | PAGE_SHARED);
+}
+
+void vdata_set_ticks(uint64_t ticks)
+{
+    if (!vdata_clock)
+        return;
+
+    vdata_write_begin();
+    vdata_clock->ticks = ticks;
+    vdata_write_end();
+}
+
+void vdata_set_tsc(uint64_t tsc_hz, uint32_t mult, uint32_t shift, uint64_t tsc_base, uint64_t ns_base)
+{
+    if (!vdata_clock)
+        return;
+
+    vdata_write_begin();
+    vdata_clock->tsc_hz = tsc_hz;
+    vdata_clock->tsc_mult = mult;
+    vdata_clock->tsc_shift = shift;
+    vdata_clock->tsc_base = tsc_base;
+    vdata_clock->ns_base = ns_base;
+    vdata_write_end();
+}
+
+void vdata_set_wall_offset(uint64_t offset_ns)
+{
+    if (!vdata_clock)
+        return;
+
+    vdata_write_begin();
+    vdata_clock->wall_offset = offset_ns;
+    vdata_write_end();
+}
@@ -0,0 +1,42 @@
+#ifndef K_VDATA_H
+#define K_VDATA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "processes.h"
+#include "usermode.h"
+
+// Two read-only pages at the top of every user window:
+// a clock page shared by all processes and one page per process.
+// Layouts are mirrored by user/lib/vdso.asm, keep both in sync.
+#define VDATA_CLOCK_ADDR    (USER_VDATA_BASE)
+#define VDATA_PROC_ADDR     (USER_VDATA_BASE + 0x1000)
+
+typedef struct
+{
+    volatile uint32_t seq;          // 0: odd while the kernel is updating
+    volatile uint32_t tick_hz;      // 4: rate of the tick counter (timer wheel jiffies)
+    volatile uint64_t ticks;        // 8: monotonic jiffies since boot, updated on timer interrupts
+    volatile uint64_t tsc_hz;       // 16: TSC frequency, 0 if not calibrated
+    volatile uint32_t tsc_mult;     // 24: ns = ((tsc - tsc_base) * tsc_mult) >> tsc_shift
+    volatile uint32_t tsc_shift;    // 28
+    volatile uint64_t tsc_base;     // 32
+    volatile uint64_t ns_base;      // 40: monotonic ns at tsc_base
+    volatile uint64_t wall_offset;  // 48: CLOCK_REALTIME - CLOCK_MONOTONIC in ns
+}
+vdata_clock_t;
+
+typedef struct
+{
+    volatile uint32_t pid;          // 0
+}
+vdata_proc_t;
+
+bool vdata_init(void);
+bool vdata_map(process_t* proc);
+void vdata_set_ticks(uint64_t ticks);
+void vdata_set_tsc(uint64_t tsc_hz, uint32_t mult, uint32_t shift, uint64_t tsc_base, uint64_t ns_base);
+void vdata_set_wall_offset(uint64_t offset_ns);
+
+#endif
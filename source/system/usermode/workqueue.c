@@ -0,0 +1,115 @@
+#include "workqueue.h"
+#include "kthread.h"
+#include "../smp/smp.h"
+
+workqueue_t g_system_wq;
+
+void work_init(work_t* work, work_fn_t func, void* ctx)
+{
+    work->next = 0;
+    work->func = func;
+    work->ctx = ctx;
+    work->state = 0;
+}
+
+static bool workqueue_has_work(void* ctx)
+{
+    return ((workqueue_t*)ctx)->head != 0;
+}
+
+static work_t* workqueue_take(workqueue_t* wq)
+{
+    uint32_t flags = spin_lock_irqsave(&wq->lock);
+    work_t* work = wq->head;
+    if (work)
+    {
+        wq->head = work->next;
+        if (!wq->head)
+            wq->tail = &wq->head;
+        work->next = 0;
+
+        // Pending cleared first, so the item may queue itself again
+        work->state = WORK_RUNNING;
+    }
+    spin_unlock_irqrestore(&wq->lock, flags);
+    return work;
+}
+
+static void workqueue_worker(void* ctx)
+{
+    workqueue_t* wq = (workqueue_t*)ctx;
+
+    while (1)
+    {
+        wait_event_timeout(&wq->more, workqueue_has_work, wq, WAIT_FOREVER);
+
+        work_t* work = workqueue_take(wq);
+        if (!work)
+            continue;
+
+        work->func(work);
+
+        uint32_t flags = spin_lock_irqsave(&wq->lock);
+        work->state &= ~WORK_RUNNING;
+        spin_unlock_irqrestore(&wq->lock, flags);
+        wake_up(&wq->done, 0);
+
+        // Between items nothing is held, a long queue must not hog the CPU
+        kthread_preempt_point();
+    }
+}
+
+bool workqueue_create(workqueue_t* wq, const char* name, uint32_t threads)
+{
+    spin_init(&wq->lock);
+    wq->head = 0;
+    wq->tail = &wq->head;
+    wait_queue_init(&wq->more);
+    wait_queue_init(&wq->done);
+    wq->name = name;
+    wq->threads = 0;
+
+    if (threads > WORKQUEUE_MAX_THREADS)
+        threads = WORKQUEUE_MAX_THREADS;
+
+    for (uint32_t i = 0; i < threads; i++)
+    {
+        if (kthread_start(workqueue_worker, wq))
+            wq->threads++;
+    }
+    return wq->threads != 0;
+}
+
+void workqueue_init(void)
+{
+    workqueue_create(&g_system_wq, "system", smp_cpu_count());
+}
+
+bool queue_work(workqueue_t* wq, work_t* work)
+{
+    uint32_t flags = spin_lock_irqsave(&wq->lock);
+    if (work->state & WORK_PENDING)
+    {
+        spin_unlock_irqrestore(&wq->lock, flags);
+        return false;
+    }
+
+    work->state |= WORK_PENDING;
+    work->next = 0;
+    *wq->tail = work;
+    wq->tail = &work->next;
+    spin_unlock_irqrestore(&wq->lock, flags);
+
+    wake_up_one(&wq->more, 0);
+    return true;
+}
+
+static bool work_idle(void* ctx)
+{
+    return (((work_t*)ctx)->state & (WORK_PENDING | WORK_RUNNING)) == 0;
+}
+
+void work_flush(workqueue_t* wq, work_t* work)
+{
+    wait_event_timeout(&wq->done, work_idle, work, WAIT_FOREVER);
+}
@@ -0,0 +1,57 @@
+#ifndef K_WORKQUEUE_H
+#define K_WORKQUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "processes.h"
+#include "../sync/spinlock.h"
+#include "../sync/waitqueue.h"
+
+// Deferred work in process context: items queued from anywhere (IRQ
+// handlers included) run on a pool of kernel threads, so they may sleep.
+#define WORKQUEUE_MAX_THREADS   8
+
+#define WORK_PENDING            0x01    // Queued, not started yet
+#define WORK_RUNNING            0x02
+
+struct work;
+typedef void (*work_fn_t)(struct work* work);
+
+typedef struct work
+{
+    struct work* next;
+    work_fn_t func;
+    void* ctx;
+    volatile uint32_t state;
+}
+work_t;
+
+typedef struct
+{
+    spinlock_t lock;
+    work_t* head;                   // FIFO
+    work_t** tail;
+    wait_queue_t more;              // Idle workers
+    wait_queue_t done;              // work_flush callers
+    uint32_t threads;
+    const char* name;
+}
+workqueue_t;
+
+// Shared pool for short jobs, one thread per CPU up to WORKQUEUE_MAX_THREADS
+extern workqueue_t g_system_wq;
+
+void work_init(work_t* work, work_fn_t func, void* ctx);
+
+// Starts the worker threads, false if none could be started
+bool workqueue_create(workqueue_t* wq, const char* name, uint32_t threads);
+void workqueue_init(void);
+
+// False if the item was pending already, it then runs only once
+bool queue_work(workqueue_t* wq, work_t* work);
+
+// Sleeps until the item is neither pending nor running. Process context.
+void work_flush(workqueue_t* wq, work_t* work);
+
+#endif
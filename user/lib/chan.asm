@@ -0,0 +1,122 @@
+; chan.asm - shared memory channels (SYS_CHAN_CREATE)
+;
+; %include "chan.asm" into a program (after its code, and after ipc.asm).
+; Layout mirrors shm_chan_t in source/system/ipc/shm.h, keep both in sync.
+; head and tail only ever grow, the data offset is (pos & (size - 1)).
+; Payload bytes never go through the kernel; a side only rings the other
+; when it may be asleep: the producer when the ring was empty, the
+; consumer when it was full. The doorbell shows up as an IPC receive
+; from pid 0 with CHAN_DOORBELL set in ecx.
+
+CHAN_HEAD           equ 0
+CHAN_TAIL           equ 64
+CHAN_SIZE           equ 128
+CHAN_PRODUCER       equ 132
+CHAN_CONSUMER       equ 136
+CHAN_DATA           equ 4096
+
+CHAN_DOORBELL       equ 1
+
+SYS_CHAN_CREATE     equ 0x202
+
+; uint32_t chan_write(ebx = channel, esi = src, ecx = len) -> eax
+; Copies as much as fits (two segments at most), returns the byte count.
+chan_write:
+    push edi
+    push edx
+    mov edx, [ebx + CHAN_HEAD]
+    mov eax, edx
+    sub eax, [ebx + CHAN_TAIL]      ; used
+    push eax
+    neg eax
+    add eax, [ebx + CHAN_SIZE]      ; free
+    cmp ecx, eax
+    jbe chan_write_fits
+    mov ecx, eax
+chan_write_fits:
+    push ecx                        ; total
+    mov eax, [ebx + CHAN_SIZE]
+    dec eax
+    and edx, eax                    ; offset of head
+    lea edi, [ebx + CHAN_DATA + edx]
+    mov eax, [ebx + CHAN_SIZE]
+    sub eax, edx                    ; room before the wrap
+    cmp eax, ecx
+    jae chan_write_tail
+    sub ecx, eax
+    xchg ecx, eax
+    rep movsb                       ; up to the end
+    mov ecx, eax
+    lea edi, [ebx + CHAN_DATA]
+chan_write_tail:
+    rep movsb
+    pop eax                         ; total
+    pop edx                         ; used before
+    add [ebx + CHAN_HEAD], eax      ; Stores stay in order on x86: data first, then head
+
+    test eax, eax
+    jz chan_write_done
+    test edx, edx
+    jnz chan_write_done
+    push eax
+    push ebx
+    mov ecx, CHAN_DOORBELL
+    mov ebx, [ebx + CHAN_CONSUMER]
+    mov eax, IPC_NOTIFY
+    int IPC_VECTOR
+    pop ebx
+    pop eax
+chan_write_done:
+    pop edx
+    pop edi
+    ret
+
+; uint32_t chan_read(ebx = channel, edi = dst, ecx = max) -> eax
+; Copies what is there, up to max bytes, returns the byte count.
+chan_read:
+    push esi
+    push edx
+    mov edx, [ebx + CHAN_TAIL]
+    mov eax, [ebx + CHAN_HEAD]
+    sub eax, edx                    ; used
+    push eax
+    cmp ecx, eax
+    jbe chan_read_fits
+    mov ecx, eax
+chan_read_fits:
+    push ecx                        ; total
+    mov eax, [ebx + CHAN_SIZE]
+    dec eax
+    and edx, eax                    ; offset of tail
+    lea esi, [ebx + CHAN_DATA + edx]
+    mov eax, [ebx + CHAN_SIZE]
+    sub eax, edx                    ; bytes before the wrap
+    cmp eax, ecx
+    jae chan_read_tail
+    sub ecx, eax
+    xchg ecx, eax
+    rep movsb
+    mov ecx, eax
+    lea esi, [ebx + CHAN_DATA]
+chan_read_tail:
+    rep movsb
+    pop eax                         ; total
+    pop edx                         ; used before
+    add [ebx + CHAN_TAIL], eax
+
+    test eax, eax
+    jz chan_read_done
+    cmp edx, [ebx + CHAN_SIZE]
+    jne chan_read_done
+    push eax
+    push ebx
+    mov ecx, CHAN_DOORBELL
+    mov ebx, [ebx + CHAN_PRODUCER]
+    mov eax, IPC_NOTIFY
+    int IPC_VECTOR
+    pop ebx
+    pop eax
+chan_read_done:
+    pop edx
+    pop esi
+    ret
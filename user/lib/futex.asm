@@ -0,0 +1,89 @@
+; futex.asm - threads, mutexes and joins on top of SYS_THREAD and SYS_FUTEX
+;
+; %include "futex.asm" into a program (after its code).
+; Values mirror source/system/sync/futex.h and syscalls.h, keep both in sync.
+; A mutex is one dword: 0 free, 1 locked, 2 locked with (maybe) sleepers.
+; Uncontended lock and unlock are a single locked instruction each, the
+; kernel is only entered to sleep or to wake a sleeper.
+
+SYS_GETTID          equ 0xE0
+SYS_FUTEX           equ 0xF0
+SYS_THREAD          equ 0x203
+
+FUTEX_WAIT          equ 0
+FUTEX_WAKE          equ 1
+
+FUTEX_OK            equ 0
+FUTEX_ERR_FAULT     equ -1
+FUTEX_ERR_AGAIN     equ -2
+FUTEX_ERR_TIMEOUT   equ -3
+
+; uint32_t thread_start(ebx = entry, ecx = stack top, edx = arg, esi = tid word) -> eax
+; Returns the thread id, or -1. The thread starts with eax = arg and ends
+; through SYS_EXIT, which clears the tid word and wakes its joiners.
+thread_start:
+    mov eax, SYS_THREAD
+    int 0x80
+    ret
+
+; void thread_join(ebx = tid word)
+thread_join:
+    push ecx
+    push edx
+    push esi
+thread_join_check:
+    mov edx, [ebx]
+    test edx, edx
+    jz thread_join_done
+    mov ecx, FUTEX_WAIT
+    xor esi, esi
+    mov eax, SYS_FUTEX
+    int 0x80
+    jmp thread_join_check
+thread_join_done:
+    pop esi
+    pop edx
+    pop ecx
+    ret
+
+; void mutex_lock(ebx = mutex)
+mutex_lock:
+    push ecx
+    push edx
+    push esi
+    xor eax, eax
+    mov ecx, 1
+    lock cmpxchg [ebx], ecx         ; 0 -> 1: ours, no sleepers
+    jz mutex_lock_done
+mutex_lock_slow:
+    mov eax, 2
+    xchg [ebx], eax                 ; Mark contended, ours if it was free
+    test eax, eax
+    jz mutex_lock_done
+    mov ecx, FUTEX_WAIT
+    mov edx, 2
+    xor esi, esi
+    mov eax, SYS_FUTEX
+    int 0x80
+    jmp mutex_lock_slow
+mutex_lock_done:
+    pop esi
+    pop edx
+    pop ecx
+    ret
+
+; void mutex_unlock(ebx = mutex)
+mutex_unlock:
+    lock dec dword [ebx]            ; 1 -> 0: nobody sleeps
+    jz mutex_unlock_done
+    push ecx
+    push edx
+    mov dword [ebx], 0
+    mov ecx, FUTEX_WAKE
+    mov edx, 1
+    mov eax, SYS_FUTEX
+    int 0x80
+    pop edx
+    pop ecx
+mutex_unlock_done:
+    ret
@@ -0,0 +1,28 @@
+; ipc.asm - user side of the synchronous IPC fast path
+;
+; %include "ipc.asm" anywhere, it only defines constants.
+; Values mirror source/system/ipc/ipc.h, keep both in sync.
+;
+; in:  eax = operation, ebx = partner pid (0: any sender, receive only),
+;      ecx, edx, esi, edi = message words
+; out: eax = IPC_OK or an IPC_ERR_*, ebx = sender pid (receiving operations),
+;      ecx, edx, esi, edi = received message words
+
+IPC_VECTOR          equ 0x81
+
+IPC_SEND            equ 1
+IPC_RECEIVE         equ 2
+IPC_CALL            equ 3
+IPC_REPLY           equ 4
+IPC_REPLY_WAIT      equ 5
+IPC_NOTIFY          equ 6   ; Doorbell: ORs ecx into the partner's pending bits
+
+IPC_OK              equ 0
+IPC_ERR_NOPROC      equ -1
+IPC_ERR_ABORTED     equ -2
+IPC_ERR_STATE       equ -3
+IPC_ERR_INVALID     equ -4
+
+; Protocol of ipc_echo.bin: every message comes back unchanged,
+; a first word of IPC_ECHO_STOP also makes it exit after replying
+IPC_ECHO_STOP       equ 0xFFFFFFFF
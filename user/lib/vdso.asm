@@ -0,0 +1,90 @@
+; vdso.asm - user side readers for the kernel data pages
+;
+; %include "vdso.asm" into a program (after its code) to read
+; the pid and clock without an int 0x80 round trip.
+; Offsets mirror vdata_clock_t / vdata_proc_t in source/system/usermode/vdata.h
+
+VDATA_CLOCK         equ 0x7FE000
+VDATA_PROC          equ 0x7FF000
+
+VCLOCK_SEQ          equ VDATA_CLOCK + 0
+VCLOCK_TICK_HZ      equ VDATA_CLOCK + 4
+VCLOCK_TICKS        equ VDATA_CLOCK + 8
+VCLOCK_TSC_HZ       equ VDATA_CLOCK + 16
+VCLOCK_TSC_MULT     equ VDATA_CLOCK + 24
+VCLOCK_TSC_SHIFT    equ VDATA_CLOCK + 28
+VCLOCK_TSC_BASE     equ VDATA_CLOCK + 32
+VCLOCK_NS_BASE      equ VDATA_CLOCK + 40
+VCLOCK_WALL_OFFSET  equ VDATA_CLOCK + 48
+
+VPROC_PID           equ VDATA_PROC + 0
+
+; uint32_t vdso_getpid(void) -> eax
+vdso_getpid:
+    mov eax, [VPROC_PID]
+    ret
+
+; uint32_t vdso_tick_hz(void) -> eax
+vdso_tick_hz:
+    mov eax, [VCLOCK_TICK_HZ]
+    ret
+
+; uint64_t vdso_ticks(void) -> edx:eax
+; Retries while the kernel is halfway through an update
+vdso_ticks:
+    push ebx
+vdso_ticks_retry:
+    mov ebx, [VCLOCK_SEQ]
+    test ebx, 1
+    jnz vdso_ticks_busy
+    mov eax, [VCLOCK_TICKS]
+    mov edx, [VCLOCK_TICKS + 4]
+    cmp ebx, [VCLOCK_SEQ]
+    jne vdso_ticks_retry
+    pop ebx
+    ret
+vdso_ticks_busy:
+    pause
+    jmp vdso_ticks_retry
+
+; uint64_t vdso_monotonic_ns(void) -> edx:eax
+; TSC based, the kernel always publishes tsc_shift = 32 so
+; ns = ns_base + delta_hi * mult + ((delta_lo * mult) >> 32).
+; Returns 0 when the TSC was not calibrated (tsc_mult = 0).
+vdso_monotonic_ns:
+    push ebx
+    push esi
+    push edi
+vdso_monotonic_ns_retry:
+    mov ebx, [VCLOCK_SEQ]
+    test ebx, 1
+    jnz vdso_monotonic_ns_busy
+    rdtsc
+    sub eax, [VCLOCK_TSC_BASE]
+    sbb edx, [VCLOCK_TSC_BASE + 4]
+    mov ecx, [VCLOCK_TSC_MULT]
+    mov esi, edx                ; delta_hi
+    mul ecx
+    mov edi, edx                ; (delta_lo * mult) >> 32
+    mov eax, esi
+    mul ecx
+    add eax, edi
+    adc edx, 0
+    add eax, [VCLOCK_NS_BASE]
+    adc edx, [VCLOCK_NS_BASE + 4]
+    cmp ebx, [VCLOCK_SEQ]
+    jne vdso_monotonic_ns_retry
+    pop edi
+    pop esi
+    pop ebx
+    ret
+vdso_monotonic_ns_busy:
+    pause
+    jmp vdso_monotonic_ns_retry
+
+; uint64_t vdso_realtime_ns(void) -> edx:eax, ns since the Unix epoch
+vdso_realtime_ns:
+    call vdso_monotonic_ns
+    add eax, [VCLOCK_WALL_OFFSET]
+    adc edx, [VCLOCK_WALL_OFFSET + 4]
+    ret